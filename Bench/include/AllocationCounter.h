@@ -0,0 +1,29 @@
+#ifndef ALLOCATION_COUNTER
+#define ALLOCATION_COUNTER
+
+#include <cstdint>
+
+/**
+ * Heap allocations made by any thread of the process so far, counted by interposing malloc and friends
+ * (operator new and libdbus both end up there). Only for executables linking AllocationCounter.cpp.
+ */
+uint64_t allocationCount();
+
+/**
+ * Leaves the current thread's allocations out of allocationCount() while alive,
+ * e.g. around the benchmark's own bookkeeping.
+ */
+class AllocationPause
+{
+    public:
+        AllocationPause();
+        ~AllocationPause();
+
+        AllocationPause(const AllocationPause&) = delete;
+        AllocationPause& operator=(const AllocationPause&) = delete;
+
+    private:
+        bool mPrevious;
+};
+
+#endif // ALLOCATION_COUNTER
@@ -0,0 +1,32 @@
+#ifndef MOCK_BUS
+#define MOCK_BUS
+
+#include <string>
+#include <sys/types.h>
+
+/**
+ * Private dbus-daemon for the lifetime of the object, nothing else connects to it.
+ * The daemon gets a minimal bus config (any name may be owned, every message is allowed),
+ * its address is what NetworkProvider::Options::busAddress and MockServices connect to.
+ * Throws std::runtime_error when the daemon cannot be started.
+ */
+class MockBus
+{
+    public:
+        explicit MockBus(const std::string& daemonPath = "dbus-daemon");
+        ~MockBus();
+
+        MockBus(const MockBus&) = delete;
+        MockBus& operator=(const MockBus&) = delete;
+
+        const std::string& getAddress() const;
+
+    private:
+        void stop();
+
+        pid_t mPid;
+        std::string mAddress;
+        std::string mConfigPath;
+};
+
+#endif // MOCK_BUS
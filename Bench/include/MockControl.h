@@ -0,0 +1,55 @@
+#ifndef MOCK_CONTROL
+#define MOCK_CONTROL
+
+#include "MockServices.h"
+#include <dbus/dbus.h>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/**
+ * Drives a MockServices instance over its bus, e.g. one running in network_mock.
+ * Every call blocks until the mock replied and returns false when it failed.
+ * Throws std::runtime_error when the bus cannot be reached.
+ */
+class MockControl
+{
+    public:
+        explicit MockControl(const std::string& address);
+        ~MockControl();
+
+        MockControl(const MockControl&) = delete;
+        MockControl& operator=(const MockControl&) = delete;
+
+        /**
+         * The signals are sent before the reply, so they are on their way once this returns.
+         */
+        bool emitStorm(uint32_t count);
+        bool emitAdapterChanged();
+
+        /**
+         * One Timestamp signal from G_MOCK_CONTROL_PATH carrying the mock's std::chrono::steady_clock
+         * time in nanoseconds, a clock every process on the machine shares.
+         */
+        bool emitTimestamp();
+
+        /**
+         * InterfacesRemoved for up to count discoverable devices, earliest announced first.
+         */
+        bool emitRemoved(uint32_t count);
+        bool setStormRate(uint32_t rate);
+        bool setReplyLatency(std::chrono::milliseconds latency);
+        bool injectError(const std::string& member, const std::string& errorName);
+        bool setSilent(const std::string& member);
+        bool clearErrors();
+        std::optional<MockServices::Counters> getCounters();
+
+    private:
+        DBusMessage* newCall(const char* member) const;
+        DBusMessage* call(DBusMessage* message);
+
+        DBusConnection* mConnection;
+};
+
+#endif // MOCK_CONTROL
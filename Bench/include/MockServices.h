@@ -0,0 +1,180 @@
+#ifndef MOCK_SERVICES
+#define MOCK_SERVICES
+
+#include <dbus/dbus.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Object and interface through which another process drives MockServices, see MockControl.
+ */
+static constexpr const char* G_MOCK_CONTROL_PATH = "/org/networkmock/Control";
+static constexpr const char* G_MOCK_CONTROL_INTERFACE = "org.networkmock.Control";
+
+/**
+ * Scripted behavior of MockServices.
+ */
+struct MockScript
+{
+    /**
+     * Devices returned by GetManagedObjects, indices [0, pairedDevices).
+     */
+    size_t pairedDevices = 5;
+
+    /**
+     * Devices announced by InterfacesAdded while discovering, indices following the paired ones.
+     */
+    size_t discoverableDevices = 5;
+
+    /**
+     * Inquiry and advertising reports per second while discovering: InterfacesAdded for every
+     * discoverable device not announced yet, then RSSI PropertiesChanged of random devices.
+     * Reports excluded by SetDiscoveryFilter send nothing. 0 announces nothing.
+     */
+    uint32_t stormRate = 0;
+
+    /**
+     * Delay added to every reply, errors included.
+     */
+    std::chrono::milliseconds replyLatency{0};
+
+    /**
+     * Method member -> DBus error name replied instead of the normal reply.
+     */
+    std::map<std::string, std::string> errors;
+
+    /**
+     * Method members never answered, callers run into their timeout.
+     */
+    std::set<std::string> silent;
+};
+
+/**
+ * Stand-ins for org.bluez (ObjectManager, Adapter1 on /org/bluez/hci0, Device1) and
+ * org.freedesktop.NetworkManager, served from their own thread on one connection to the bus at address.
+ * Device i has address AA:BB:CC:xx:xx:xx with i in the low three bytes and is named "dev<i>".
+ * Paired devices are classic audio devices, discoverable ones a mix of classic, LE peripherals,
+ * beacons and anonymous LE advertisers with spread out signal strengths, see MockServices.cpp.
+ * SetDiscoveryFilter is honored like bluetoothd does, one filter shared by every client.
+ * The scripted behavior can also be changed over the bus through G_MOCK_CONTROL_INTERFACE,
+ * those calls are neither delayed, failed nor counted.
+ * Throws std::runtime_error when the bus cannot be reached or a name is already owned.
+ */
+class MockServices
+{
+    public:
+        MockServices(const std::string& address, const MockScript& script);
+        ~MockServices();
+
+        MockServices(const MockServices&) = delete;
+        MockServices& operator=(const MockServices&) = delete;
+
+        struct Counters
+        {
+            uint64_t calls = 0;
+            uint64_t errors = 0;
+            uint64_t signals = 0;
+            uint64_t filtered = 0; // Storm reports dropped by the discovery filter
+        };
+
+        void setReplyLatency(std::chrono::milliseconds latency);
+        void setStormRate(uint32_t rate);
+        void injectError(const std::string& member, const std::string& errorName);
+        void clearErrors();
+
+        /**
+         * Send count storm signals on the next service iteration (within a few milliseconds), discovering or not.
+         * The EmitStorm control method sends them before replying instead.
+         */
+        void emitStorm(size_t count);
+
+        /**
+         * Adapter PropertiesChanged with Powered flipped and back, the other signal kind the library ingests.
+         */
+        void emitAdapterChanged();
+
+        Counters getCounters() const;
+        static std::string deviceAddress(size_t index);
+
+    private:
+        struct Device
+        {
+            std::string path;
+            std::string address;
+            std::string name;
+            bool paired = false;
+            bool connected = false;
+            bool announced = false;
+            uint8_t kind = 0; // Index into the device mix
+            int16_t baseRssi = -60;
+            int16_t rssi = -60; // Last reported
+            int16_t txPower = 0;
+        };
+
+        /**
+         * Adapter1.SetDiscoveryFilter arguments, an empty dictionary resets them.
+         */
+        struct DiscoveryFilter
+        {
+            std::string transport = "auto";
+            std::optional<int16_t> rssi;
+            std::optional<uint16_t> pathloss;
+            std::set<std::string> uuids;
+            bool duplicateData = true;
+        };
+
+        void serviceHandler();
+        void handleCall(DBusMessage* message);
+        DBusMessage* handleControl(DBusMessage* message, const std::string& member);
+        DBusMessage* handleProperties(DBusMessage* message, const std::string& path, const std::string& member);
+        DBusMessage* handleDevice(DBusMessage* message, Device& device, const std::string& member);
+        DBusMessage* getManagedObjects(DBusMessage* message);
+        DBusMessage* setDiscoveryFilter(DBusMessage* message);
+        bool matchesFilter(const Device& device, int16_t rssi) const;
+        void reply(DBusMessage* reply);
+        void sendDue();
+        void emitStormSignal();
+        void emitSignal(DBusMessage* signal);
+        void emitInterfacesAdded(const Device& device);
+        void emitInterfacesRemoved(const Device& device);
+        void emitDeviceChanged(const Device& device, const char* property);
+        void emitBoolChanged(const char* path, const char* interface, const char* property, bool value);
+        Device* findDevice(const std::string& path);
+
+        static void appendAdapterProperties(DBusMessageIter* iter, bool powered, bool discovering);
+        static void appendDeviceProperties(DBusMessageIter* iter, const Device& device);
+
+        DBusConnection* mConnection;
+        std::thread mServiceThread;
+        std::atomic<bool> mStopping;
+
+        // Owned by the service thread
+        std::vector<Device> mDevices;
+        std::unordered_map<std::string, size_t> mDeviceIndex; // Object path -> mDevices position
+        std::multimap<std::chrono::steady_clock::time_point, DBusMessage*> mDelayed;
+        std::mt19937 mRandom;
+        size_t mNextAnnounced;
+        DiscoveryFilter mFilter;
+        bool mPowered;
+        bool mDiscovering;
+        bool mWirelessEnabled;
+
+        // Shared with the controlling thread
+        mutable std::mutex mMutex;
+        MockScript mScript;
+        size_t mPendingStorm;
+        size_t mPendingAdapterChanged;
+        Counters mCounters;
+};
+
+#endif // MOCK_SERVICES
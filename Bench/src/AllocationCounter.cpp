@@ -0,0 +1,85 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* pointer);
+}
+
+static std::atomic<uint64_t> gAllocations(0);
+
+// Zero-initialized and without destructor, safe to touch from inside malloc on any thread
+static thread_local bool tPaused = false;
+
+static inline void countAllocation()
+{
+    if (!tPaused) {
+        gAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint64_t allocationCount()
+{
+    return gAllocations.load(std::memory_order_relaxed);
+}
+
+AllocationPause::AllocationPause() : mPrevious(tPaused)
+{
+    tPaused = true;
+}
+
+AllocationPause::~AllocationPause()
+{
+    tPaused = mPrevious;
+}
+
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        countAllocation();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        countAllocation();
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        countAllocation();
+        return __libc_realloc(pointer, size);
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        countAllocation();
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        countAllocation();
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** pointer, size_t alignment, size_t size)
+    {
+        countAllocation();
+        *pointer = __libc_memalign(alignment, size);
+        return (nullptr != *pointer) ? 0 : ENOMEM;
+    }
+
+    void free(void* pointer)
+    {
+        __libc_free(pointer);
+    }
+}
@@ -0,0 +1,120 @@
+#include "MockBus.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static constexpr int G_DAEMON_START_TIMEOUT_MS = 5000;
+
+static constexpr const char* G_BUS_CONFIG =
+    "<!DOCTYPE busconfig PUBLIC \"-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN\"\n"
+    " \"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"
+    "<busconfig>\n"
+    "  <type>session</type>\n"
+    "  <listen>unix:tmpdir=/tmp</listen>\n"
+    "  <auth>EXTERNAL</auth>\n"
+    "  <policy context=\"default\">\n"
+    "    <allow send_destination=\"*\" eavesdrop=\"true\"/>\n"
+    "    <allow eavesdrop=\"true\"/>\n"
+    "    <allow own=\"*\"/>\n"
+    "  </policy>\n"
+    "</busconfig>\n";
+
+MockBus::MockBus(const std::string& daemonPath) : mPid(-1)
+{
+    char configPath[] = "/tmp/network-mock-bus-XXXXXX";
+    int configFd = mkstemp(configPath);
+    if (configFd < 0) {
+        throw std::runtime_error("MockBus: cannot create bus config");
+    }
+    mConfigPath = configPath;
+    size_t length = strlen(G_BUS_CONFIG);
+    bool written = (write(configFd, G_BUS_CONFIG, length) == static_cast<ssize_t>(length));
+    close(configFd);
+    if (!written) {
+        stop();
+        throw std::runtime_error("MockBus: cannot write bus config");
+    }
+
+    // The daemon prints its address on the write end, one line
+    int fds[2];
+    if (pipe(fds) < 0) {
+        stop();
+        throw std::runtime_error("MockBus: cannot create pipe");
+    }
+
+    mPid = fork();
+    if (mPid == 0) {
+        // Signals blocked by the parent would survive exec and keep SIGTERM from stopping the daemon
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigprocmask(SIG_SETMASK, &signals, nullptr);
+        close(fds[0]);
+        std::string config = "--config-file=" + mConfigPath;
+        std::string print = "--print-address=" + std::to_string(fds[1]);
+        execlp(daemonPath.c_str(), daemonPath.c_str(), config.c_str(), "--nofork", "--nopidfile", print.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    close(fds[1]);
+    if (mPid < 0) {
+        close(fds[0]);
+        stop();
+        throw std::runtime_error("MockBus: cannot fork");
+    }
+
+    char buffer[512];
+    size_t received = 0;
+    while (received < sizeof(buffer) - 1) {
+        pollfd item = {fds[0], POLLIN, 0};
+        if (poll(&item, 1, G_DAEMON_START_TIMEOUT_MS) <= 0) {
+            break;
+        }
+        ssize_t count = read(fds[0], buffer + received, sizeof(buffer) - 1 - received);
+        if (count <= 0) {
+            break;
+        }
+        received += count;
+        if (nullptr != memchr(buffer, '\n', received)) {
+            break;
+        }
+    }
+    close(fds[0]);
+
+    buffer[received] = '\0';
+    char* end = strchr(buffer, '\n');
+    if (nullptr == end) {
+        stop();
+        throw std::runtime_error("MockBus: " + daemonPath + " did not report an address");
+    }
+    *end = '\0';
+    mAddress = buffer;
+}
+
+MockBus::~MockBus()
+{
+    stop();
+}
+
+const std::string& MockBus::getAddress() const
+{
+    return mAddress;
+}
+
+void MockBus::stop()
+{
+    if (mPid > 0) {
+        kill(mPid, SIGTERM);
+        while ((waitpid(mPid, nullptr, 0) < 0) && (errno == EINTR)) {
+        }
+        mPid = -1;
+    }
+    if (!mConfigPath.empty()) {
+        unlink(mConfigPath.c_str());
+        mConfigPath.clear();
+    }
+}
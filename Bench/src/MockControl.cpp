@@ -0,0 +1,149 @@
+#include "MockControl.h"
+#include <stdexcept>
+
+static constexpr const char* G_MOCK_SERVICE = "org.bluez";
+
+MockControl::MockControl(const std::string& address) : mConnection(nullptr)
+{
+    DBusError error;
+    dbus_error_init(&error);
+    mConnection = dbus_connection_open_private(address.c_str(), &error);
+    if ((nullptr != mConnection) && !dbus_bus_register(mConnection, &error)) {
+        dbus_connection_close(mConnection);
+        dbus_connection_unref(mConnection);
+        mConnection = nullptr;
+    }
+    if (nullptr == mConnection) {
+        std::string message = std::string("MockControl: ") + (dbus_error_is_set(&error) ? error.message : "cannot connect to the bus");
+        dbus_error_free(&error);
+        throw std::runtime_error(message);
+    }
+    dbus_connection_set_exit_on_disconnect(mConnection, FALSE);
+}
+
+MockControl::~MockControl()
+{
+    dbus_connection_close(mConnection);
+    dbus_connection_unref(mConnection);
+}
+
+DBusMessage* MockControl::newCall(const char* member) const
+{
+    return dbus_message_new_method_call(G_MOCK_SERVICE, G_MOCK_CONTROL_PATH, G_MOCK_CONTROL_INTERFACE, member);
+}
+
+/**
+ * Send and release message, the reply is the caller's to unref. nullptr on any error.
+ */
+DBusMessage* MockControl::call(DBusMessage* message)
+{
+    if (nullptr == message) {
+        return nullptr;
+    }
+    DBusError error;
+    dbus_error_init(&error);
+    DBusMessage* reply = dbus_connection_send_with_reply_and_block(mConnection, message, DBUS_TIMEOUT_USE_DEFAULT, &error);
+    dbus_message_unref(message);
+    if (dbus_error_is_set(&error)) {
+        dbus_error_free(&error);
+        return nullptr;
+    }
+    return reply;
+}
+
+static bool succeeded(DBusMessage* reply)
+{
+    if (nullptr == reply) {
+        return false;
+    }
+    dbus_message_unref(reply);
+    return true;
+}
+
+bool MockControl::emitStorm(uint32_t count)
+{
+    DBusMessage* message = newCall("EmitStorm");
+    dbus_uint32_t value = count;
+    dbus_message_append_args(message, DBUS_TYPE_UINT32, &value, DBUS_TYPE_INVALID);
+    return succeeded(call(message));
+}
+
+bool MockControl::emitAdapterChanged()
+{
+    return succeeded(call(newCall("EmitAdapterChanged")));
+}
+
+bool MockControl::emitTimestamp()
+{
+    return succeeded(call(newCall("EmitTimestamp")));
+}
+
+bool MockControl::emitRemoved(uint32_t count)
+{
+    DBusMessage* message = newCall("EmitRemoved");
+    dbus_uint32_t value = count;
+    dbus_message_append_args(message, DBUS_TYPE_UINT32, &value, DBUS_TYPE_INVALID);
+    return succeeded(call(message));
+}
+
+bool MockControl::setStormRate(uint32_t rate)
+{
+    DBusMessage* message = newCall("SetStormRate");
+    dbus_uint32_t value = rate;
+    dbus_message_append_args(message, DBUS_TYPE_UINT32, &value, DBUS_TYPE_INVALID);
+    return succeeded(call(message));
+}
+
+bool MockControl::setReplyLatency(std::chrono::milliseconds latency)
+{
+    DBusMessage* message = newCall("SetReplyLatency");
+    dbus_uint32_t value = static_cast<dbus_uint32_t>(latency.count());
+    dbus_message_append_args(message, DBUS_TYPE_UINT32, &value, DBUS_TYPE_INVALID);
+    return succeeded(call(message));
+}
+
+bool MockControl::injectError(const std::string& member, const std::string& errorName)
+{
+    DBusMessage* message = newCall("InjectError");
+    const char* first = member.c_str();
+    const char* second = errorName.c_str();
+    dbus_message_append_args(message, DBUS_TYPE_STRING, &first, DBUS_TYPE_STRING, &second, DBUS_TYPE_INVALID);
+    return succeeded(call(message));
+}
+
+bool MockControl::setSilent(const std::string& member)
+{
+    DBusMessage* message = newCall("SetSilent");
+    const char* value = member.c_str();
+    dbus_message_append_args(message, DBUS_TYPE_STRING, &value, DBUS_TYPE_INVALID);
+    return succeeded(call(message));
+}
+
+bool MockControl::clearErrors()
+{
+    return succeeded(call(newCall("ClearErrors")));
+}
+
+std::optional<MockServices::Counters> MockControl::getCounters()
+{
+    DBusMessage* reply = call(newCall("GetCounters"));
+    if (nullptr == reply) {
+        return std::nullopt;
+    }
+    dbus_uint64_t calls = 0;
+    dbus_uint64_t errors = 0;
+    dbus_uint64_t signals = 0;
+    dbus_uint64_t filtered = 0;
+    bool decoded = dbus_message_get_args(reply, nullptr, DBUS_TYPE_UINT64, &calls, DBUS_TYPE_UINT64, &errors, DBUS_TYPE_UINT64, &signals,
+                                         DBUS_TYPE_UINT64, &filtered, DBUS_TYPE_INVALID);
+    dbus_message_unref(reply);
+    if (!decoded) {
+        return std::nullopt;
+    }
+    MockServices::Counters ret;
+    ret.calls = calls;
+    ret.errors = errors;
+    ret.signals = signals;
+    ret.filtered = filtered;
+    return ret;
+}
@@ -0,0 +1,89 @@
+#include "MockBus.h"
+#include "MockServices.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+static void usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [--paired N] [--discoverable N] [--storm RATE] [--latency MS]\n"
+              << "       [--error MEMBER=ERROR_NAME]... [--silent MEMBER]... [--daemon PATH]\n"
+              << "Starts a private dbus-daemon with org.bluez and NetworkManager stand-ins and prints its address.\n";
+}
+
+/**
+ * Standalone fixture: run it, then point the library (Options::busAddress or
+ * DBUS_SYSTEM_BUS_ADDRESS) at the printed address. Runs until SIGINT or SIGTERM.
+ */
+int main(int argc, char** argv)
+{
+    MockScript script;
+    std::string daemonPath = "dbus-daemon";
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if ((i + 1 >= argc) || (option.compare(0, 2, "--") != 0)) {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (option == "--paired") {
+            script.pairedDevices = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--discoverable") {
+            script.discoverableDevices = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--storm") {
+            script.stormRate = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--latency") {
+            script.replyLatency = std::chrono::milliseconds(strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (option == "--error") {
+            size_t separator = value.find('=');
+            if (separator == std::string::npos) {
+                usage(argv[0]);
+                return 1;
+            }
+            script.errors[value.substr(0, separator)] = value.substr(separator + 1);
+        }
+        else if (option == "--silent") {
+            script.silent.insert(value);
+        }
+        else if (option == "--daemon") {
+            daemonPath = value;
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    // Blocked before any thread starts so that only sigwait() below sees them
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    try {
+        MockBus bus(daemonPath);
+        MockServices services(bus.getAddress(), script);
+        std::cout << "DBUS_SYSTEM_BUS_ADDRESS=" << bus.getAddress() << std::endl;
+
+        int received = 0;
+        sigwait(&signals, &received);
+
+        MockServices::Counters counters = services.getCounters();
+        std::cerr << "calls=" << counters.calls << " errors=" << counters.errors << " signals=" << counters.signals << std::endl;
+    }
+    catch (const std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,867 @@
+#include "MockServices.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+
+static constexpr const char* G_BLUEZ_SERVICE = "org.bluez";
+static constexpr const char* G_ADAPTER_PATH = "/org/bluez/hci0";
+static constexpr const char* G_ADAPTER_INTERFACE = "org.bluez.Adapter1";
+static constexpr const char* G_DEVICE_INTERFACE = "org.bluez.Device1";
+static constexpr const char* G_ADAPTER_ADDRESS = "00:11:22:33:44:55";
+static constexpr const char* G_ADAPTER_ALIAS = "mock-hci0";
+static constexpr const char* G_NM_SERVICE = "org.freedesktop.NetworkManager";
+static constexpr const char* G_NM_PATH = "/org/freedesktop/NetworkManager";
+static constexpr const char* G_NM_INTERFACE = "org.freedesktop.NetworkManager";
+static constexpr const char* G_PROPERTIES_INTERFACE = "org.freedesktop.DBus.Properties";
+static constexpr const char* G_OBJECT_MANAGER_INTERFACE = "org.freedesktop.DBus.ObjectManager";
+static constexpr uint32_t G_NM_STATE_CONNECTED_GLOBAL = 70;
+static constexpr uint32_t G_NM_CONNECTIVITY_FULL = 4;
+static constexpr int G_SERVICE_POLL_MS = 5;
+static constexpr int G_RSSI_JITTER = 6; // Reports scatter this many dBm around a device's level
+static constexpr int G_RSSI_DUPLICATE_DELTA = 8; // Move that still gets a duplicate advertisement through
+
+/**
+ * Devices of one kind, share is their percentage of the discoverable devices.
+ */
+struct DeviceKind
+{
+    bool le;
+    bool txPower;
+    int strongestRssi;
+    int weakestRssi;
+    std::vector<const char*> uuids;
+    uint32_t share;
+};
+
+/**
+ * What a scan in a busy place finds: a few classic audio devices, some LE peripherals and mostly
+ * beacons and phones advertising without services. The first kind (HFP, audio source and AVRCP)
+ * is also every paired device, enough for the library's profile lookups.
+ */
+static const DeviceKind G_DEVICE_KINDS[] = {
+    {false, false, -50, -85, {"0000111f-0000-1000-8000-00805f9b34fb", "0000110a-0000-1000-8000-00805f9b34fb", "0000110f-0000-1000-8000-00805f9b34fb"}, 15},
+    {true, true, -55, -90, {"00001812-0000-1000-8000-00805f9b34fb", "0000180f-0000-1000-8000-00805f9b34fb"}, 10}, // HID over GATT, battery
+    {true, true, -65, -100, {"0000feaa-0000-1000-8000-00805f9b34fb"}, 35}, // Eddystone
+    {true, false, -60, -100, {}, 40}
+};
+
+static void appendEntry(DBusMessageIter* dict, const char* key, int type, const void* value)
+{
+    char signature[2] = {static_cast<char>(type), '\0'};
+    DBusMessageIter entry;
+    DBusMessageIter variant;
+    dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, nullptr, &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, signature, &variant);
+    dbus_message_iter_append_basic(&variant, type, value);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(dict, &entry);
+}
+
+static void appendString(DBusMessageIter* dict, const char* key, const char* value, int type = DBUS_TYPE_STRING)
+{
+    appendEntry(dict, key, type, &value);
+}
+
+static void appendBool(DBusMessageIter* dict, const char* key, bool value)
+{
+    dbus_bool_t item = value;
+    appendEntry(dict, key, DBUS_TYPE_BOOLEAN, &item);
+}
+
+static void appendVariant(DBusMessageIter* iter, int type, const void* value)
+{
+    char signature[2] = {static_cast<char>(type), '\0'};
+    DBusMessageIter variant;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, signature, &variant);
+    dbus_message_iter_append_basic(&variant, type, value);
+    dbus_message_iter_close_container(iter, &variant);
+}
+
+static void appendWifiProperties(DBusMessageIter* iter, bool wirelessEnabled)
+{
+    DBusMessageIter dict;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+    appendBool(&dict, "WirelessEnabled", wirelessEnabled);
+    appendBool(&dict, "WirelessHardwareEnabled", true);
+    appendEntry(&dict, "State", DBUS_TYPE_UINT32, &G_NM_STATE_CONNECTED_GLOBAL);
+    appendEntry(&dict, "Connectivity", DBUS_TYPE_UINT32, &G_NM_CONNECTIVITY_FULL);
+    dbus_message_iter_close_container(iter, &dict);
+}
+
+static std::string devicePath(const std::string& address)
+{
+    std::string ret = std::string(G_ADAPTER_PATH) + "/dev_" + address;
+    std::replace(ret.begin(), ret.end(), ':', '_');
+    return ret;
+}
+
+MockServices::MockServices(const std::string& address, const MockScript& script)
+    : mConnection(nullptr), mStopping(false), mRandom(1), mNextAnnounced(script.pairedDevices), mPowered(true),
+      mDiscovering(false), mWirelessEnabled(true), mScript(script), mPendingStorm(0), mPendingAdapterChanged(0)
+{
+    DBusError error;
+    dbus_error_init(&error);
+    do
+    {
+        mConnection = dbus_connection_open_private(address.c_str(), &error);
+        if ((nullptr == mConnection) || !dbus_bus_register(mConnection, &error)) {
+            break;
+        }
+        for (const char* name : {G_BLUEZ_SERVICE, G_NM_SERVICE}) {
+            int result = dbus_bus_request_name(mConnection, name, DBUS_NAME_FLAG_DO_NOT_QUEUE, &error);
+            if (dbus_error_is_set(&error)) {
+                break;
+            }
+            if (result != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+                dbus_set_error(&error, DBUS_ERROR_FAILED, "%s is already owned", name);
+                break;
+            }
+        }
+    } while (0);
+
+    if (dbus_error_is_set(&error) || (nullptr == mConnection)) {
+        std::string message = std::string("MockServices: ") + (dbus_error_is_set(&error) ? error.message : "cannot connect to the bus");
+        dbus_error_free(&error);
+        if (nullptr != mConnection) {
+            dbus_connection_close(mConnection);
+            dbus_connection_unref(mConnection);
+        }
+        throw std::runtime_error(message);
+    }
+    dbus_connection_set_exit_on_disconnect(mConnection, FALSE);
+
+    size_t total = script.pairedDevices + script.discoverableDevices;
+    mDevices.resize(total);
+    for (size_t i = 0; i < total; i++) {
+        Device& device = mDevices[i];
+        device.address = deviceAddress(i);
+        device.path = devicePath(device.address);
+        device.name = "dev" + std::to_string(i);
+        device.paired = (i < script.pairedDevices);
+        device.announced = device.paired;
+        if (!device.paired) {
+            uint32_t pick = mRandom() % 100;
+            while (pick >= G_DEVICE_KINDS[device.kind].share) {
+                pick -= G_DEVICE_KINDS[device.kind].share;
+                device.kind++;
+            }
+        }
+        const DeviceKind& kind = G_DEVICE_KINDS[device.kind];
+        device.baseRssi = static_cast<int16_t>(kind.strongestRssi - static_cast<int>(mRandom() % (kind.strongestRssi - kind.weakestRssi + 1)));
+        device.rssi = device.baseRssi;
+        device.txPower = static_cast<int16_t>(static_cast<int>(mRandom() % 13) - 8);
+        mDeviceIndex[device.path] = i;
+    }
+
+    mServiceThread = std::thread(&MockServices::serviceHandler, this);
+}
+
+MockServices::~MockServices()
+{
+    mStopping.store(true);
+    mServiceThread.join();
+    for (std::pair<const std::chrono::steady_clock::time_point, DBusMessage*>& item : mDelayed) {
+        dbus_message_unref(item.second);
+    }
+    dbus_connection_close(mConnection);
+    dbus_connection_unref(mConnection);
+}
+
+std::string MockServices::deviceAddress(size_t index)
+{
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "AA:BB:CC:%02X:%02X:%02X", static_cast<unsigned>((index >> 16) & 0xff),
+             static_cast<unsigned>((index >> 8) & 0xff), static_cast<unsigned>(index & 0xff));
+    return buffer;
+}
+
+void MockServices::setReplyLatency(std::chrono::milliseconds latency)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mScript.replyLatency = latency;
+}
+
+void MockServices::setStormRate(uint32_t rate)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mScript.stormRate = rate;
+}
+
+void MockServices::injectError(const std::string& member, const std::string& errorName)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mScript.errors[member] = errorName;
+}
+
+void MockServices::clearErrors()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mScript.errors.clear();
+    mScript.silent.clear();
+}
+
+void MockServices::emitStorm(size_t count)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPendingStorm += count;
+}
+
+void MockServices::emitAdapterChanged()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPendingAdapterChanged++;
+}
+
+MockServices::Counters MockServices::getCounters() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCounters;
+}
+
+/**
+ * Single thread owning the connection: serves calls, releases delayed replies and paces the storm.
+ */
+void MockServices::serviceHandler()
+{
+    std::chrono::steady_clock::time_point lastTick = std::chrono::steady_clock::now();
+    double stormCredit = 0;
+    while (!mStopping.load()) {
+        int waitMs = G_SERVICE_POLL_MS;
+        if (!mDelayed.empty()) {
+            std::chrono::steady_clock::duration due = mDelayed.begin()->first - std::chrono::steady_clock::now();
+            waitMs = std::clamp(static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(due).count()), 0, G_SERVICE_POLL_MS);
+        }
+        if (!dbus_connection_read_write(mConnection, waitMs)) {
+            break;
+        }
+
+        DBusMessage* message = nullptr;
+        while (nullptr != (message = dbus_connection_pop_message(mConnection))) {
+            handleCall(message);
+            dbus_message_unref(message);
+        }
+        sendDue();
+
+        uint32_t rate = 0;
+        size_t count = 0;
+        size_t adapterChanged = 0;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            rate = mScript.stormRate;
+            count = mPendingStorm;
+            adapterChanged = mPendingAdapterChanged;
+            mPendingStorm = 0;
+            mPendingAdapterChanged = 0;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (mDiscovering && (rate > 0)) {
+            stormCredit += std::chrono::duration<double>(now - lastTick).count() * rate;
+            size_t due = static_cast<size_t>(stormCredit);
+            stormCredit -= due;
+            count += due;
+        }
+        else {
+            stormCredit = 0;
+        }
+        lastTick = now;
+
+        for (size_t i = 0; i < count; i++) {
+            emitStormSignal();
+        }
+        for (size_t i = 0; i < adapterChanged; i++) {
+            emitBoolChanged(G_ADAPTER_PATH, G_ADAPTER_INTERFACE, "Powered", !mPowered);
+            emitBoolChanged(G_ADAPTER_PATH, G_ADAPTER_INTERFACE, "Powered", mPowered);
+        }
+    }
+}
+
+void MockServices::handleCall(DBusMessage* message)
+{
+    if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL) {
+        return;
+    }
+    const char* path = dbus_message_get_path(message);
+    const char* interface = dbus_message_get_interface(message);
+    const char* member = dbus_message_get_member(message);
+    std::string pathName = (nullptr != path) ? path : "";
+    std::string interfaceName = (nullptr != interface) ? interface : "";
+    std::string memberName = (nullptr != member) ? member : "";
+    if ((interfaceName == G_MOCK_CONTROL_INTERFACE) && (pathName == G_MOCK_CONTROL_PATH)) {
+        DBusMessage* ret = handleControl(message, memberName);
+        dbus_connection_send(mConnection, ret, nullptr);
+        dbus_message_unref(ret);
+        return;
+    }
+
+    std::string errorName;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCounters.calls++;
+        if (mScript.silent.count(memberName) > 0) {
+            return;
+        }
+        std::map<std::string, std::string>::const_iterator item = mScript.errors.find(memberName);
+        if (item != mScript.errors.end()) {
+            errorName = item->second;
+            mCounters.errors++;
+        }
+    }
+    if (!errorName.empty()) {
+        reply(dbus_message_new_error(message, errorName.c_str(), "Injected by MockServices"));
+        return;
+    }
+
+    DBusMessage* ret = nullptr;
+    Device* device = nullptr;
+    if (interfaceName == G_PROPERTIES_INTERFACE) {
+        ret = handleProperties(message, pathName, memberName);
+    }
+    else if ((interfaceName == G_OBJECT_MANAGER_INTERFACE) && (pathName == "/") && (memberName == "GetManagedObjects")) {
+        ret = getManagedObjects(message);
+    }
+    else if ((interfaceName == G_ADAPTER_INTERFACE) && (pathName == G_ADAPTER_PATH)) {
+        if ((memberName == "StartDiscovery") || (memberName == "StopDiscovery")) {
+            bool discovering = (memberName == "StartDiscovery");
+            if (discovering != mDiscovering) {
+                mDiscovering = discovering;
+                emitBoolChanged(G_ADAPTER_PATH, G_ADAPTER_INTERFACE, "Discovering", mDiscovering);
+            }
+            ret = dbus_message_new_method_return(message);
+        }
+        else if (memberName == "SetDiscoveryFilter") {
+            ret = setDiscoveryFilter(message);
+        }
+    }
+    else if ((interfaceName == G_DEVICE_INTERFACE) && (nullptr != (device = findDevice(pathName)))) {
+        ret = handleDevice(message, *device, memberName);
+    }
+
+    if (nullptr == ret) {
+        ret = dbus_message_new_error(message, DBUS_ERROR_UNKNOWN_METHOD, memberName.c_str());
+    }
+    reply(ret);
+}
+
+DBusMessage* MockServices::handleControl(DBusMessage* message, const std::string& member)
+{
+    dbus_uint32_t value = 0;
+    const char* first = nullptr;
+    const char* second = nullptr;
+    if (member == "EmitStorm") {
+        if (dbus_message_get_args(message, nullptr, DBUS_TYPE_UINT32, &value, DBUS_TYPE_INVALID)) {
+            for (dbus_uint32_t i = 0; i < value; i++) {
+                emitStormSignal();
+            }
+            return dbus_message_new_method_return(message);
+        }
+    }
+    else if (member == "EmitRemoved") {
+        if (dbus_message_get_args(message, nullptr, DBUS_TYPE_UINT32, &value, DBUS_TYPE_INVALID)) {
+            // Earliest announced discoverable devices first, like bluetoothd expiring stale ones
+            for (size_t i = mScript.pairedDevices; (i < mNextAnnounced) && (value > 0); i++) {
+                if (mDevices[i].announced) {
+                    mDevices[i].announced = false;
+                    emitInterfacesRemoved(mDevices[i]);
+                    value--;
+                }
+            }
+            return dbus_message_new_method_return(message);
+        }
+    }
+    else if (member == "EmitAdapterChanged") {
+        emitBoolChanged(G_ADAPTER_PATH, G_ADAPTER_INTERFACE, "Powered", !mPowered);
+        emitBoolChanged(G_ADAPTER_PATH, G_ADAPTER_INTERFACE, "Powered", mPowered);
+        return dbus_message_new_method_return(message);
+    }
+    else if (member == "EmitTimestamp") {
+        // Stamped as late as possible, the signal is written out with the reply on this iteration
+        DBusMessage* signal = dbus_message_new_signal(G_MOCK_CONTROL_PATH, G_MOCK_CONTROL_INTERFACE, "Timestamp");
+        dbus_uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        dbus_message_append_args(signal, DBUS_TYPE_UINT64, &now, DBUS_TYPE_INVALID);
+        dbus_connection_send(mConnection, signal, nullptr);
+        dbus_message_unref(signal);
+        return dbus_message_new_method_return(message);
+    }
+    else if (member == "SetStormRate") {
+        if (dbus_message_get_args(message, nullptr, DBUS_TYPE_UINT32, &value, DBUS_TYPE_INVALID)) {
+            setStormRate(value);
+            return dbus_message_new_method_return(message);
+        }
+    }
+    else if (member == "SetReplyLatency") {
+        if (dbus_message_get_args(message, nullptr, DBUS_TYPE_UINT32, &value, DBUS_TYPE_INVALID)) {
+            setReplyLatency(std::chrono::milliseconds(value));
+            return dbus_message_new_method_return(message);
+        }
+    }
+    else if (member == "InjectError") {
+        if (dbus_message_get_args(message, nullptr, DBUS_TYPE_STRING, &first, DBUS_TYPE_STRING, &second, DBUS_TYPE_INVALID)) {
+            injectError(first, second);
+            return dbus_message_new_method_return(message);
+        }
+    }
+    else if (member == "SetSilent") {
+        if (dbus_message_get_args(message, nullptr, DBUS_TYPE_STRING, &first, DBUS_TYPE_INVALID)) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mScript.silent.insert(first);
+            return dbus_message_new_method_return(message);
+        }
+    }
+    else if (member == "ClearErrors") {
+        clearErrors();
+        return dbus_message_new_method_return(message);
+    }
+    else if (member == "GetCounters") {
+        Counters counters = getCounters();
+        dbus_uint64_t calls = counters.calls;
+        dbus_uint64_t errors = counters.errors;
+        dbus_uint64_t signals = counters.signals;
+        dbus_uint64_t filtered = counters.filtered;
+        DBusMessage* ret = dbus_message_new_method_return(message);
+        dbus_message_append_args(ret, DBUS_TYPE_UINT64, &calls, DBUS_TYPE_UINT64, &errors, DBUS_TYPE_UINT64, &signals,
+                                 DBUS_TYPE_UINT64, &filtered, DBUS_TYPE_INVALID);
+        return ret;
+    }
+    else {
+        return dbus_message_new_error(message, DBUS_ERROR_UNKNOWN_METHOD, member.c_str());
+    }
+    return dbus_message_new_error(message, DBUS_ERROR_INVALID_ARGS, member.c_str());
+}
+
+DBusMessage* MockServices::handleProperties(DBusMessage* message, const std::string& path, const std::string& member)
+{
+    DBusMessageIter args;
+    const char* interface = nullptr;
+    const char* property = nullptr;
+    if (!dbus_message_iter_init(message, &args) || (dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_STRING)) {
+        return dbus_message_new_error(message, DBUS_ERROR_INVALID_ARGS, "Interface name expected");
+    }
+    dbus_message_iter_get_basic(&args, &interface);
+    if (dbus_message_iter_next(&args) && (dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_STRING)) {
+        dbus_message_iter_get_basic(&args, &property);
+        dbus_message_iter_next(&args);
+    }
+    std::string interfaceName = interface;
+    std::string propertyName = (nullptr != property) ? property : "";
+    bool isAdapter = (path == G_ADAPTER_PATH) && (interfaceName == G_ADAPTER_INTERFACE);
+    bool isWifi = (path == G_NM_PATH) && (interfaceName == G_NM_INTERFACE);
+
+    DBusMessage* ret = dbus_message_new_method_return(message);
+    DBusMessageIter iter;
+    dbus_message_iter_init_append(ret, &iter);
+    if (member == "GetAll") {
+        Device* device = nullptr;
+        if (isAdapter) {
+            appendAdapterProperties(&iter, mPowered, mDiscovering);
+            return ret;
+        }
+        if (isWifi) {
+            appendWifiProperties(&iter, mWirelessEnabled);
+            return ret;
+        }
+        if ((interfaceName == G_DEVICE_INTERFACE) && (nullptr != (device = findDevice(path)))) {
+            appendDeviceProperties(&iter, *device);
+            return ret;
+        }
+    }
+    else if (member == "Get") {
+        if (isAdapter && ((propertyName == "Address") || (propertyName == "Alias") || (propertyName == "Name"))) {
+            const char* value = (propertyName == "Address") ? G_ADAPTER_ADDRESS : G_ADAPTER_ALIAS;
+            appendVariant(&iter, DBUS_TYPE_STRING, &value);
+            return ret;
+        }
+        if ((isAdapter && ((propertyName == "Powered") || (propertyName == "Discovering"))) || (isWifi && (propertyName == "WirelessEnabled"))) {
+            dbus_bool_t value = isWifi ? mWirelessEnabled : ((propertyName == "Powered") ? mPowered : mDiscovering);
+            appendVariant(&iter, DBUS_TYPE_BOOLEAN, &value);
+            return ret;
+        }
+    }
+    else if ((member == "Set") && (dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_VARIANT)) {
+        DBusMessageIter variant;
+        dbus_message_iter_recurse(&args, &variant);
+        if (dbus_message_iter_get_arg_type(&variant) == DBUS_TYPE_BOOLEAN) {
+            dbus_bool_t value = FALSE;
+            dbus_message_iter_get_basic(&variant, &value);
+            if (isAdapter && (propertyName == "Powered")) {
+                mPowered = value;
+                emitBoolChanged(G_ADAPTER_PATH, G_ADAPTER_INTERFACE, "Powered", mPowered);
+                return ret;
+            }
+            if (isWifi && (propertyName == "WirelessEnabled")) {
+                mWirelessEnabled = value;
+                emitBoolChanged(G_NM_PATH, G_NM_INTERFACE, "WirelessEnabled", mWirelessEnabled);
+                return ret;
+            }
+        }
+    }
+
+    dbus_message_unref(ret);
+    return dbus_message_new_error(message, DBUS_ERROR_INVALID_ARGS, (interfaceName + "." + propertyName).c_str());
+}
+
+DBusMessage* MockServices::handleDevice(DBusMessage* message, Device& device, const std::string& member)
+{
+    if ((member == "Connect") || (member == "ConnectProfile")) {
+        if (!device.connected) {
+            device.connected = true;
+            emitDeviceChanged(device, "Connected");
+        }
+    }
+    else if (member == "Disconnect") {
+        if (device.connected) {
+            device.connected = false;
+            emitDeviceChanged(device, "Connected");
+        }
+    }
+    else if (member == "Pair") {
+        if (!device.paired) {
+            device.paired = true;
+            emitDeviceChanged(device, "Paired");
+        }
+    }
+    else if (member != "DisconnectProfile") {
+        return nullptr;
+    }
+    return dbus_message_new_method_return(message);
+}
+
+/**
+ * The adapter plus every device announced so far, like bluetoothd after a scan.
+ */
+DBusMessage* MockServices::getManagedObjects(DBusMessage* message)
+{
+    DBusMessage* ret = dbus_message_new_method_return(message);
+    DBusMessageIter iter;
+    DBusMessageIter objects;
+    dbus_message_iter_init_append(ret, &iter);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{oa{sa{sv}}}", &objects);
+
+    std::function<void(const char*, const char*, const Device*)> appendObject = [this, &objects](const char* path, const char* interface, const Device* device) {
+        DBusMessageIter object;
+        DBusMessageIter interfaces;
+        DBusMessageIter entry;
+        dbus_message_iter_open_container(&objects, DBUS_TYPE_DICT_ENTRY, nullptr, &object);
+        dbus_message_iter_append_basic(&object, DBUS_TYPE_OBJECT_PATH, &path);
+        dbus_message_iter_open_container(&object, DBUS_TYPE_ARRAY, "{sa{sv}}", &interfaces);
+        dbus_message_iter_open_container(&interfaces, DBUS_TYPE_DICT_ENTRY, nullptr, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &interface);
+        if (nullptr == device) {
+            appendAdapterProperties(&entry, mPowered, mDiscovering);
+        }
+        else {
+            appendDeviceProperties(&entry, *device);
+        }
+        dbus_message_iter_close_container(&interfaces, &entry);
+        dbus_message_iter_close_container(&object, &interfaces);
+        dbus_message_iter_close_container(&objects, &object);
+    };
+
+    appendObject(G_ADAPTER_PATH, G_ADAPTER_INTERFACE, nullptr);
+    for (const Device& device : mDevices) {
+        if (device.announced) {
+            appendObject(device.path.c_str(), G_DEVICE_INTERFACE, &device);
+        }
+    }
+    dbus_message_iter_close_container(&iter, &objects);
+    return ret;
+}
+
+/**
+ * Validated like bluetoothd: known keys with their exact types, RSSI and Pathloss exclusive.
+ */
+DBusMessage* MockServices::setDiscoveryFilter(DBusMessage* message)
+{
+    static constexpr const char* G_INVALID_ARGUMENTS = "org.bluez.Error.InvalidArguments";
+    DiscoveryFilter filter;
+    DBusMessageIter args;
+    DBusMessageIter dict;
+    if (!dbus_message_iter_init(message, &args) || (dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_ARRAY) ||
+        (dbus_message_iter_get_element_type(&args) != DBUS_TYPE_DICT_ENTRY)) {
+        return dbus_message_new_error(message, G_INVALID_ARGUMENTS, "a{sv} expected");
+    }
+
+    dbus_message_iter_recurse(&args, &dict);
+    while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter entry;
+        DBusMessageIter variant;
+        const char* key = nullptr;
+        dbus_message_iter_recurse(&dict, &entry);
+        dbus_message_iter_get_basic(&entry, &key);
+        dbus_message_iter_next(&entry);
+        dbus_message_iter_recurse(&entry, &variant);
+        std::string name = key;
+        int type = dbus_message_iter_get_arg_type(&variant);
+        if ((name == "Transport") && (type == DBUS_TYPE_STRING)) {
+            const char* value = nullptr;
+            dbus_message_iter_get_basic(&variant, &value);
+            filter.transport = value;
+            if ((filter.transport != "auto") && (filter.transport != "bredr") && (filter.transport != "le")) {
+                return dbus_message_new_error(message, G_INVALID_ARGUMENTS, value);
+            }
+        }
+        else if ((name == "RSSI") && (type == DBUS_TYPE_INT16)) {
+            dbus_int16_t value = 0;
+            dbus_message_iter_get_basic(&variant, &value);
+            filter.rssi = value;
+        }
+        else if ((name == "Pathloss") && (type == DBUS_TYPE_UINT16)) {
+            dbus_uint16_t value = 0;
+            dbus_message_iter_get_basic(&variant, &value);
+            filter.pathloss = value;
+        }
+        else if ((name == "UUIDs") && (type == DBUS_TYPE_ARRAY) && (dbus_message_iter_get_element_type(&variant) == DBUS_TYPE_STRING)) {
+            DBusMessageIter uuids;
+            dbus_message_iter_recurse(&variant, &uuids);
+            while (dbus_message_iter_get_arg_type(&uuids) == DBUS_TYPE_STRING) {
+                const char* value = nullptr;
+                dbus_message_iter_get_basic(&uuids, &value);
+                std::string uuid = value;
+                std::transform(uuid.begin(), uuid.end(), uuid.begin(), [](unsigned char c) { return std::tolower(c); });
+                filter.uuids.insert(uuid);
+                dbus_message_iter_next(&uuids);
+            }
+        }
+        else if ((name == "DuplicateData") && (type == DBUS_TYPE_BOOLEAN)) {
+            dbus_bool_t value = TRUE;
+            dbus_message_iter_get_basic(&variant, &value);
+            filter.duplicateData = value;
+        }
+        else {
+            return dbus_message_new_error(message, G_INVALID_ARGUMENTS, key);
+        }
+        dbus_message_iter_next(&dict);
+    }
+
+    if (filter.rssi && filter.pathloss) {
+        return dbus_message_new_error(message, G_INVALID_ARGUMENTS, "RSSI and Pathloss exclude each other");
+    }
+    mFilter = filter;
+    return dbus_message_new_method_return(message);
+}
+
+/**
+ * Whether a report of device at rssi passes mFilter. Pathloss needs the advertised TX power,
+ * devices without one never match it.
+ */
+bool MockServices::matchesFilter(const Device& device, int16_t rssi) const
+{
+    const DeviceKind& kind = G_DEVICE_KINDS[device.kind];
+    if (((mFilter.transport == "le") && !kind.le) || ((mFilter.transport == "bredr") && kind.le)) {
+        return false;
+    }
+    if (mFilter.rssi && (rssi < *mFilter.rssi)) {
+        return false;
+    }
+    if (mFilter.pathloss && (!kind.txPower || (device.txPower - rssi > *mFilter.pathloss))) {
+        return false;
+    }
+    if (mFilter.uuids.empty()) {
+        return true;
+    }
+    return std::any_of(kind.uuids.begin(), kind.uuids.end(), [this](const char* uuid) {
+        return mFilter.uuids.count(uuid) > 0;
+    });
+}
+
+/**
+ * Send now or hold until the scripted latency passed.
+ */
+void MockServices::reply(DBusMessage* reply)
+{
+    if (nullptr == reply) {
+        return;
+    }
+    std::chrono::milliseconds latency;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        latency = mScript.replyLatency;
+    }
+    if (latency.count() > 0) {
+        mDelayed.emplace(std::chrono::steady_clock::now() + latency, reply);
+        return;
+    }
+    dbus_connection_send(mConnection, reply, nullptr);
+    dbus_message_unref(reply);
+}
+
+void MockServices::sendDue()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    while (!mDelayed.empty() && (mDelayed.begin()->first <= now)) {
+        dbus_connection_send(mConnection, mDelayed.begin()->second, nullptr);
+        dbus_message_unref(mDelayed.begin()->second);
+        mDelayed.erase(mDelayed.begin());
+    }
+}
+
+/**
+ * One inquiry or advertising report: of the next discoverable device, once all were reported of a
+ * random one. A device not announced yet is announced, a known one gets its RSSI updated.
+ * Reports the discovery filter excludes send nothing, and without DuplicateData the controller
+ * drops repeated LE advertisements unless the signal moved a lot.
+ */
+void MockServices::emitStormSignal()
+{
+    if (mDevices.empty()) {
+        return;
+    }
+    Device& device = (mNextAnnounced < mDevices.size()) ? mDevices[mNextAnnounced++] : mDevices[mRandom() % mDevices.size()];
+    int16_t rssi = static_cast<int16_t>(device.baseRssi + static_cast<int>(mRandom() % (2 * G_RSSI_JITTER + 1)) - G_RSSI_JITTER);
+    bool duplicate = device.announced && !mFilter.duplicateData && G_DEVICE_KINDS[device.kind].le &&
+                     (std::abs(rssi - device.rssi) < G_RSSI_DUPLICATE_DELTA);
+    if (duplicate || !matchesFilter(device, rssi)) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCounters.filtered++;
+        return;
+    }
+
+    device.rssi = rssi;
+    if (!device.announced) {
+        device.announced = true;
+        emitInterfacesAdded(device);
+        return;
+    }
+    emitDeviceChanged(device, "RSSI");
+}
+
+void MockServices::emitSignal(DBusMessage* signal)
+{
+    dbus_connection_send(mConnection, signal, nullptr);
+    dbus_message_unref(signal);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCounters.signals++;
+}
+
+void MockServices::emitInterfacesAdded(const Device& device)
+{
+    DBusMessage* signal = dbus_message_new_signal("/", G_OBJECT_MANAGER_INTERFACE, "InterfacesAdded");
+    DBusMessageIter iter;
+    DBusMessageIter interfaces;
+    DBusMessageIter entry;
+    const char* path = device.path.c_str();
+    const char* interface = G_DEVICE_INTERFACE;
+    dbus_message_iter_init_append(signal, &iter);
+    dbus_message_iter_append_basic(&iter, DBUS_TYPE_OBJECT_PATH, &path);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sa{sv}}", &interfaces);
+    dbus_message_iter_open_container(&interfaces, DBUS_TYPE_DICT_ENTRY, nullptr, &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &interface);
+    appendDeviceProperties(&entry, device);
+    dbus_message_iter_close_container(&interfaces, &entry);
+    dbus_message_iter_close_container(&iter, &interfaces);
+    emitSignal(signal);
+}
+
+void MockServices::emitInterfacesRemoved(const Device& device)
+{
+    DBusMessage* signal = dbus_message_new_signal("/", G_OBJECT_MANAGER_INTERFACE, "InterfacesRemoved");
+    DBusMessageIter iter;
+    DBusMessageIter interfaces;
+    const char* path = device.path.c_str();
+    const char* interface = G_DEVICE_INTERFACE;
+    dbus_message_iter_init_append(signal, &iter);
+    dbus_message_iter_append_basic(&iter, DBUS_TYPE_OBJECT_PATH, &path);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "s", &interfaces);
+    dbus_message_iter_append_basic(&interfaces, DBUS_TYPE_STRING, &interface);
+    dbus_message_iter_close_container(&iter, &interfaces);
+    emitSignal(signal);
+}
+
+/**
+ * Properties PropertiesChanged (sa{sv}as) carrying one Device1 property.
+ */
+void MockServices::emitDeviceChanged(const Device& device, const char* property)
+{
+    DBusMessage* signal = dbus_message_new_signal(device.path.c_str(), G_PROPERTIES_INTERFACE, "PropertiesChanged");
+    DBusMessageIter iter;
+    DBusMessageIter changed;
+    DBusMessageIter invalidated;
+    const char* interface = G_DEVICE_INTERFACE;
+    std::string name = property;
+    dbus_message_iter_init_append(signal, &iter);
+    dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &interface);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}", &changed);
+    if (name == "RSSI") {
+        appendEntry(&changed, property, DBUS_TYPE_INT16, &device.rssi);
+    }
+    else {
+        appendBool(&changed, property, (name == "Connected") ? device.connected : device.paired);
+    }
+    dbus_message_iter_close_container(&iter, &changed);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "s", &invalidated);
+    dbus_message_iter_close_container(&iter, &invalidated);
+    emitSignal(signal);
+}
+
+void MockServices::emitBoolChanged(const char* path, const char* interface, const char* property, bool value)
+{
+    DBusMessage* signal = dbus_message_new_signal(path, G_PROPERTIES_INTERFACE, "PropertiesChanged");
+    DBusMessageIter iter;
+    DBusMessageIter changed;
+    DBusMessageIter invalidated;
+    dbus_message_iter_init_append(signal, &iter);
+    dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &interface);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}", &changed);
+    appendBool(&changed, property, value);
+    dbus_message_iter_close_container(&iter, &changed);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "s", &invalidated);
+    dbus_message_iter_close_container(&iter, &invalidated);
+    emitSignal(signal);
+}
+
+MockServices::Device* MockServices::findDevice(const std::string& path)
+{
+    std::unordered_map<std::string, size_t>::iterator item = mDeviceIndex.find(path);
+    if (item == mDeviceIndex.end()) {
+        return nullptr;
+    }
+    return &mDevices[item->second];
+}
+
+void MockServices::appendAdapterProperties(DBusMessageIter* iter, bool powered, bool discovering)
+{
+    DBusMessageIter dict;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+    appendString(&dict, "Address", G_ADAPTER_ADDRESS);
+    appendString(&dict, "Alias", G_ADAPTER_ALIAS);
+    appendString(&dict, "Name", G_ADAPTER_ALIAS);
+    appendBool(&dict, "Powered", powered);
+    appendBool(&dict, "Discovering", discovering);
+    dbus_message_iter_close_container(iter, &dict);
+}
+
+void MockServices::appendDeviceProperties(DBusMessageIter* iter, const Device& device)
+{
+    DBusMessageIter dict;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+    appendString(&dict, "Address", device.address.c_str());
+    appendString(&dict, "Name", device.name.c_str());
+    appendString(&dict, "Alias", device.name.c_str());
+    appendString(&dict, "Adapter", G_ADAPTER_PATH, DBUS_TYPE_OBJECT_PATH);
+    appendBool(&dict, "Paired", device.paired);
+    appendBool(&dict, "Connected", device.connected);
+    appendEntry(&dict, "RSSI", DBUS_TYPE_INT16, &device.rssi);
+    if (G_DEVICE_KINDS[device.kind].txPower) {
+        appendEntry(&dict, "TxPower", DBUS_TYPE_INT16, &device.txPower);
+    }
+
+    DBusMessageIter entry;
+    DBusMessageIter variant;
+    DBusMessageIter uuids;
+    const char* key = "UUIDs";
+    dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY, nullptr, &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "as", &variant);
+    dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "s", &uuids);
+    for (const char* uuid : G_DEVICE_KINDS[device.kind].uuids) {
+        dbus_message_iter_append_basic(&uuids, DBUS_TYPE_STRING, &uuid);
+    }
+    dbus_message_iter_close_container(&variant, &uuids);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(&dict, &entry);
+    dbus_message_iter_close_container(iter, &dict);
+}
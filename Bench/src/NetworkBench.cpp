@@ -0,0 +1,968 @@
+#include "NetworkProvider.h"
+#include "BluetoothManager.h"
+#include "BluetoothProfile.h"
+#include "Logger.h"
+#include "AllocationCounter.h"
+#include "MockControl.h"
+#include "MockServices.h"
+#include <dbus/dbus.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#ifndef NETWORK_MOCK_PATH
+#define NETWORK_MOCK_PATH "network_mock"
+#endif
+
+static constexpr std::chrono::seconds G_INGEST_TIMEOUT(10);
+static constexpr std::chrono::seconds G_DISCOVERY_WINDOW(2);
+static constexpr std::chrono::microseconds G_SIGNAL_PAUSE(2000);
+static constexpr size_t G_LOOKUP_STRIDE = 7919; // Prime, consecutive lookups land all over the table
+static constexpr const char* G_ADDRESS_PREFIX = "DBUS_SYSTEM_BUS_ADDRESS=";
+
+namespace
+{
+    struct BenchConfig
+    {
+        std::string mockPath = NETWORK_MOCK_PATH;
+        std::string daemonPath = "dbus-daemon";
+        size_t pairedDevices = 100;
+        size_t discoverableDevices = 4000;
+        size_t iterations = 2000;
+        size_t startupRuns = 10;
+        uint32_t stormRate = 20000;
+        size_t maxUnpairedDevices = 0; // Unbounded unless asked, the lookups expect every device to stay
+        uint32_t propertiesWindowMs = 100;
+        uint32_t replyLatencyMs = 20; // Round trip the mock adds to every reply of the bulk cases, a real bluetoothd takes this long or more
+        bool privateConnections = false;
+        std::string filter;
+        std::string output;
+    };
+
+    /**
+     * latencies holds one sample per operation in microseconds, empty for pure throughput runs.
+     * cpuSeconds is the CPU time of this process during the run (all threads), negative when not measured.
+     */
+    struct BenchResult
+    {
+        std::string name;
+        uint64_t operations = 0;
+        double seconds = 0;
+        double cpuSeconds = -1;
+        uint64_t allocations = 0;
+        std::vector<double> latencies;
+    };
+
+    /**
+     * network_mock child process, stopped with SIGTERM when destroyed.
+     */
+    class MockProcess
+    {
+        public:
+            MockProcess(const BenchConfig& config) : mPid(-1)
+            {
+                std::vector<std::string> args = {config.mockPath,
+                                                 "--paired", std::to_string(config.pairedDevices),
+                                                 "--discoverable", std::to_string(config.discoverableDevices),
+                                                 "--daemon", config.daemonPath};
+                int fds[2];
+                if (pipe(fds) < 0) {
+                    throw std::runtime_error("cannot create pipe");
+                }
+                mPid = fork();
+                if (mPid == 0) {
+                    std::vector<char*> argv;
+                    for (std::string& arg : args) {
+                        argv.push_back(&arg[0]);
+                    }
+                    argv.push_back(nullptr);
+                    dup2(fds[1], STDOUT_FILENO);
+                    close(fds[0]);
+                    close(fds[1]);
+                    execv(argv[0], argv.data());
+                    _exit(127);
+                }
+                close(fds[1]);
+
+                std::string line;
+                char c = 0;
+                while ((read(fds[0], &c, 1) == 1) && (c != '\n')) {
+                    line.push_back(c);
+                }
+                close(fds[0]);
+                if ((mPid < 0) || (line.compare(0, strlen(G_ADDRESS_PREFIX), G_ADDRESS_PREFIX) != 0)) {
+                    stop();
+                    throw std::runtime_error("cannot start " + config.mockPath);
+                }
+                mAddress = line.substr(strlen(G_ADDRESS_PREFIX));
+            }
+
+            ~MockProcess()
+            {
+                stop();
+            }
+
+            const std::string& getAddress() const
+            {
+                return mAddress;
+            }
+
+        private:
+            void stop()
+            {
+                if (mPid > 0) {
+                    kill(mPid, SIGTERM);
+                    waitpid(mPid, nullptr, 0);
+                    mPid = -1;
+                }
+            }
+
+            pid_t mPid;
+            std::string mAddress;
+    };
+
+    double elapsedMicroseconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double processCpuSeconds()
+    {
+        timespec now = {};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return now.tv_sec + now.tv_nsec / 1e9;
+    }
+
+    /**
+     * Time every call of operation on its own, allocations are those of all threads meanwhile.
+     */
+    BenchResult measure(const std::string& name, size_t iterations, const std::function<void(size_t)>& operation)
+    {
+        BenchResult ret;
+        ret.name = name;
+        ret.operations = iterations;
+        ret.latencies.reserve(iterations);
+        uint64_t allocations = allocationCount();
+        double cpu = processCpuSeconds();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            operation(i);
+            ret.latencies.push_back(elapsedMicroseconds(begin));
+        }
+        ret.seconds = elapsedMicroseconds(start) / 1e6;
+        ret.cpuSeconds = processCpuSeconds() - cpu;
+        ret.allocations = allocationCount() - allocations;
+        return ret;
+    }
+
+    uint64_t dispatchedMessages(const NetworkProvider& network)
+    {
+        uint64_t ret = 0;
+        for (const NetworkProvider::ConnectionStats& stats : network.getConnectionStats()) {
+            ret += stats.dispatched;
+        }
+        return ret;
+    }
+
+    /**
+     * count storm signals sent at once, done when the reactors dispatched as many messages.
+     */
+    BenchResult measureIngestThroughput(const std::string& name, NetworkProvider& network, MockControl& control, uint32_t count)
+    {
+        BenchResult ret;
+        ret.name = name;
+        uint64_t target = dispatchedMessages(network) + count;
+        uint64_t allocations = allocationCount();
+        double cpu = processCpuSeconds();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        {
+            AllocationPause pause;
+            control.emitStorm(count);
+        }
+        while ((dispatchedMessages(network) < target) && (std::chrono::steady_clock::now() - start < G_INGEST_TIMEOUT)) {
+            std::this_thread::yield();
+        }
+        ret.seconds = elapsedMicroseconds(start) / 1e6;
+        ret.cpuSeconds = processCpuSeconds() - cpu;
+        ret.allocations = allocationCount() - allocations;
+        ret.operations = std::min<uint64_t>(count, count + dispatchedMessages(network) - target);
+        return ret;
+    }
+
+    /**
+     * samples Timestamp signals one at a time, each after a random pause of up to G_SIGNAL_PAUSE so
+     * arrivals do not line up with anything periodic in the library. A latency runs from the mock
+     * stamping the signal to a handler subscribed like the library's own ones starting to run.
+     */
+    BenchResult measureSignalLatency(const std::string& name, NetworkProvider& network, MockControl& control, size_t samples)
+    {
+        BenchResult ret;
+        ret.name = name;
+        std::mutex mutex;
+        std::vector<double> latencies;
+        latencies.reserve(samples);
+        uint64_t id = network.subscribeSignal(nullptr, G_MOCK_CONTROL_PATH, G_MOCK_CONTROL_INTERFACE, "Timestamp", [&](DBusMessage* signal) {
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            dbus_uint64_t stamp = 0;
+            if (dbus_message_get_args(signal, nullptr, DBUS_TYPE_UINT64, &stamp, DBUS_TYPE_INVALID)) {
+                std::lock_guard<std::mutex> lock(mutex);
+                latencies.push_back((now - static_cast<int64_t>(stamp)) / 1e3);
+            }
+        });
+
+        std::minstd_rand random(1);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < samples; i++) {
+            std::this_thread::sleep_for(std::chrono::microseconds(random() % G_SIGNAL_PAUSE.count()));
+            control.emitTimestamp();
+            std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+            while (std::chrono::steady_clock::now() - sent < G_INGEST_TIMEOUT) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (latencies.size() > i) {
+                        break;
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+        ret.seconds = elapsedMicroseconds(start) / 1e6;
+        network.unsubscribeSignal(id);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ret.latencies = latencies;
+        ret.operations = latencies.size();
+        return ret;
+    }
+
+    /**
+     * threads readers looking up addresses at once, each iterations times after a common start.
+     * seconds is the wall time of the slowest reader, latencies are those of every reader.
+     */
+    BenchResult measureReaders(BluetoothAdapter& adapter, const std::vector<std::string>& addresses, size_t threads, size_t iterations)
+    {
+        BenchResult ret;
+        ret.name = "get_bluetooth_device_readers_" + std::to_string(threads);
+        ret.operations = threads * iterations;
+        std::vector<std::vector<double>> latencies(threads);
+        std::vector<std::thread> readers;
+        std::atomic<size_t> ready(0);
+        std::atomic<bool> go(false);
+        std::atomic<uintptr_t> sink(0);
+        for (size_t t = 0; t < threads; t++) {
+            latencies[t].reserve(iterations);
+            readers.emplace_back([&, t]() {
+                uintptr_t local = 0;
+                ready.fetch_add(1);
+                while (!go.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                for (size_t i = 0; i < iterations; i++) {
+                    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                    local += reinterpret_cast<uintptr_t>(adapter.getBluetoothDevice(addresses[(i + t * 7) % addresses.size()]).get());
+                    latencies[t].push_back(elapsedMicroseconds(begin));
+                }
+                sink.fetch_add(local, std::memory_order_relaxed);
+            });
+        }
+        while (ready.load() < threads) {
+            std::this_thread::yield();
+        }
+
+        uint64_t allocations = allocationCount();
+        double cpu = processCpuSeconds();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+        ret.seconds = elapsedMicroseconds(start) / 1e6;
+        ret.cpuSeconds = processCpuSeconds() - cpu;
+        ret.allocations = allocationCount() - allocations;
+        for (std::vector<double>& samples : latencies) {
+            ret.latencies.insert(ret.latencies.end(), samples.begin(), samples.end());
+        }
+        return ret;
+    }
+
+    void appendProperty(DBusMessageIter* dict, const char* key, int type, const void* value)
+    {
+        DBusMessageIter entry;
+        DBusMessageIter variant;
+        char signature[2] = {static_cast<char>(type), '\0'};
+        dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, nullptr, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+        dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, signature, &variant);
+        dbus_message_iter_append_basic(&variant, type, value);
+        dbus_message_iter_close_container(&entry, &variant);
+        dbus_message_iter_close_container(dict, &entry);
+    }
+
+    /**
+     * A Device1 a{sv} as bluetoothd reports a paired headset: the six keys the library keeps among ten it skips.
+     */
+    DBusMessage* newDevice1Properties()
+    {
+        static const char* const G_UUIDS[] = {"0000110b-0000-1000-8000-00805f9b34fb", "0000110e-0000-1000-8000-00805f9b34fb",
+                                              "0000111e-0000-1000-8000-00805f9b34fb", "00001200-0000-1000-8000-00805f9b34fb"};
+        const char* address = "AA:BB:CC:00:00:01";
+        const char* addressType = "public";
+        const char* name = "dev1";
+        const char* icon = "audio-headset";
+        const char* adapter = "/org/bluez/hci0";
+        uint32_t deviceClass = 0x240404;
+        dbus_bool_t yes = TRUE;
+        dbus_bool_t no = FALSE;
+        dbus_int16_t rssi = -58;
+        dbus_int16_t txPower = 4;
+
+        DBusMessage* ret = dbus_message_new_signal("/org/bluez/hci0/dev_AA_BB_CC_00_00_01", "org.freedesktop.DBus.Properties", "PropertiesChanged");
+        DBusMessageIter iter;
+        DBusMessageIter dict;
+        dbus_message_iter_init_append(ret, &iter);
+        dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+        appendProperty(&dict, "Address", DBUS_TYPE_STRING, &address);
+        appendProperty(&dict, "AddressType", DBUS_TYPE_STRING, &addressType);
+        appendProperty(&dict, "Name", DBUS_TYPE_STRING, &name);
+        appendProperty(&dict, "Alias", DBUS_TYPE_STRING, &name);
+        appendProperty(&dict, "Class", DBUS_TYPE_UINT32, &deviceClass);
+        appendProperty(&dict, "Icon", DBUS_TYPE_STRING, &icon);
+        appendProperty(&dict, "Paired", DBUS_TYPE_BOOLEAN, &yes);
+        appendProperty(&dict, "Trusted", DBUS_TYPE_BOOLEAN, &yes);
+        appendProperty(&dict, "Blocked", DBUS_TYPE_BOOLEAN, &no);
+        appendProperty(&dict, "Connected", DBUS_TYPE_BOOLEAN, &yes);
+        appendProperty(&dict, "Adapter", DBUS_TYPE_OBJECT_PATH, &adapter);
+        appendProperty(&dict, "RSSI", DBUS_TYPE_INT16, &rssi);
+        appendProperty(&dict, "TxPower", DBUS_TYPE_INT16, &txPower);
+        appendProperty(&dict, "ServicesResolved", DBUS_TYPE_BOOLEAN, &yes);
+        appendProperty(&dict, "LegacyPairing", DBUS_TYPE_BOOLEAN, &no);
+
+        DBusMessageIter entry;
+        DBusMessageIter variant;
+        DBusMessageIter uuids;
+        const char* key = "UUIDs";
+        dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY, nullptr, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+        dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "as", &variant);
+        dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "s", &uuids);
+        for (const char* uuid : G_UUIDS) {
+            dbus_message_iter_append_basic(&uuids, DBUS_TYPE_STRING, &uuid);
+        }
+        dbus_message_iter_close_container(&variant, &uuids);
+        dbus_message_iter_close_container(&entry, &variant);
+        dbus_message_iter_close_container(&dict, &entry);
+        dbus_message_iter_close_container(&iter, &dict);
+        return ret;
+    }
+
+    /**
+     * Reference for decode_device1: the dictionary walk parseDeviceProperties did before forEachProperty,
+     * one strcmp per tracked key and the variant type checked by hand.
+     */
+    void walkDeviceProperties(DBusMessageIter* properties, DeviceDelta& delta)
+    {
+        if (dbus_message_iter_get_arg_type(properties) != DBUS_TYPE_ARRAY) {
+            return;
+        }
+
+        DBusMessageIter dict;
+        dbus_message_iter_recurse(properties, &dict);
+        while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+            DBusMessageIter entry;
+            DBusMessageIter value;
+            const char* key = nullptr;
+            dbus_message_iter_recurse(&dict, &entry);
+            dbus_message_iter_get_basic(&entry, &key);
+            dbus_message_iter_next(&entry);
+            dbus_message_iter_recurse(&entry, &value);
+            int type = dbus_message_iter_get_arg_type(&value);
+
+            if ((0 == strcmp(key, "Name")) && (type == DBUS_TYPE_STRING)) {
+                const char* name = nullptr;
+                dbus_message_iter_get_basic(&value, &name);
+                delta.deviceName = name;
+            }
+            else if ((0 == strcmp(key, "Address")) && (type == DBUS_TYPE_STRING)) {
+                const char* address = nullptr;
+                dbus_message_iter_get_basic(&value, &address);
+                delta.deviceAddress = address;
+            }
+            else if ((0 == strcmp(key, "UUIDs")) && (type == DBUS_TYPE_ARRAY)) {
+                DBusMessageIter uuidIter;
+                std::vector<BluetoothUuid> uuids;
+                dbus_message_iter_recurse(&value, &uuidIter);
+                while (dbus_message_iter_get_arg_type(&uuidIter) == DBUS_TYPE_STRING) {
+                    const char* uuid = nullptr;
+                    dbus_message_iter_get_basic(&uuidIter, &uuid);
+                    std::optional<BluetoothUuid> parsed = BluetoothUuid::parse(uuid);
+                    if (parsed.has_value()) {
+                        uuids.push_back(parsed.value());
+                    }
+                    dbus_message_iter_next(&uuidIter);
+                }
+                delta.uuids = std::move(uuids);
+            }
+            else if ((0 == strcmp(key, "Connected")) && (type == DBUS_TYPE_BOOLEAN)) {
+                dbus_bool_t connected = FALSE;
+                dbus_message_iter_get_basic(&value, &connected);
+                delta.connected = connected;
+            }
+            else if ((0 == strcmp(key, "Paired")) && (type == DBUS_TYPE_BOOLEAN)) {
+                dbus_bool_t paired = FALSE;
+                dbus_message_iter_get_basic(&value, &paired);
+                delta.paired = paired;
+            }
+            else if ((0 == strcmp(key, "RSSI")) && (type == DBUS_TYPE_INT16)) {
+                dbus_int16_t rssi = 0;
+                dbus_message_iter_get_basic(&value, &rssi);
+                delta.rssi = rssi;
+            }
+            dbus_message_iter_next(&dict);
+        }
+    }
+
+    /**
+     * Decode message with parse and report what was kept, both decoders must agree on it.
+     */
+    std::string decodeSummary(DBusMessage* message, void (*parse)(DBusMessageIter*, DeviceDelta&))
+    {
+        DBusMessageIter iter;
+        DeviceDelta delta;
+        dbus_message_iter_init(message, &iter);
+        parse(&iter, delta);
+        return delta.deviceName.value_or("") + " " + delta.deviceAddress.value_or("") + " " +
+               std::to_string(delta.uuids.has_value() ? delta.uuids->size() : 0) + " " + std::to_string(delta.paired.value_or(false)) +
+               std::to_string(delta.connected.value_or(false)) + " " + std::to_string(delta.rssi.value_or(0));
+    }
+
+    uint64_t receivedSignals(const NetworkProvider& network)
+    {
+        uint64_t ret = 0;
+        for (const NetworkProvider::SignalStats& stats : network.getStats().signals) {
+            ret += stats.received;
+        }
+        return ret;
+    }
+
+    /**
+     * Discovery at stormRate reports per second for G_DISCOVERY_WINDOW, started with filter when given.
+     * operations are the signals that reached the library, cpuSeconds what ingesting them cost:
+     * the calling thread only sleeps meanwhile.
+     */
+    BenchResult measureDiscovery(const std::string& name, NetworkProvider& network, MockControl& control, uint32_t stormRate,
+                                 const NetworkProvider::DiscoveryFilter* filter)
+    {
+        BenchResult ret;
+        ret.name = name;
+        if (nullptr != filter) {
+            network.startDiscovery(*filter);
+        }
+        else {
+            network.setScanMode(true);
+        }
+
+        uint64_t signals = receivedSignals(network);
+        uint64_t allocations = allocationCount();
+        double cpu = processCpuSeconds();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        control.setStormRate(stormRate);
+        std::this_thread::sleep_for(G_DISCOVERY_WINDOW);
+        control.setStormRate(0);
+        ret.seconds = elapsedMicroseconds(start) / 1e6;
+        ret.cpuSeconds = processCpuSeconds() - cpu;
+        ret.allocations = allocationCount() - allocations;
+        ret.operations = receivedSignals(network) - signals;
+
+        network.setScanMode(false);
+        return ret;
+    }
+
+    double percentile(const std::vector<double>& sorted, double quantile)
+    {
+        size_t index = std::min(sorted.size() - 1, static_cast<size_t>(quantile * sorted.size()));
+        return sorted[index];
+    }
+
+    std::string toJson(const BenchConfig& config, const std::vector<BenchResult>& results)
+    {
+        char buffer[512];
+        std::string ret = "{\n  \"benchmark\": \"network_bench\",\n";
+        snprintf(buffer, sizeof(buffer),
+                 "  \"config\": {\"paired_devices\": %zu, \"discoverable_devices\": %zu, \"iterations\": %zu, \"storm_rate\": %u, \"max_unpaired_devices\": %zu, \"properties_window_ms\": %u, \"reply_latency_ms\": %u, \"private_connections\": %s},\n",
+                 config.pairedDevices, config.discoverableDevices, config.iterations, config.stormRate, config.maxUnpairedDevices, config.propertiesWindowMs,
+                 config.replyLatencyMs, config.privateConnections ? "true" : "false");
+        ret += buffer;
+        ret += "  \"results\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& result = results[i];
+            double opsPerSecond = (result.seconds > 0) ? (result.operations / result.seconds) : 0;
+            double allocsPerOp = (result.operations > 0) ? (static_cast<double>(result.allocations) / result.operations) : 0;
+            std::string cpu = "\"cpu_seconds\": null";
+            if (result.cpuSeconds >= 0) {
+                snprintf(buffer, sizeof(buffer), "\"cpu_seconds\": %.6f", result.cpuSeconds);
+                cpu = buffer;
+            }
+            std::string latency = "\"p50_us\": null, \"p99_us\": null, \"p999_us\": null";
+            if (!result.latencies.empty()) {
+                std::vector<double> sorted = result.latencies;
+                std::sort(sorted.begin(), sorted.end());
+                snprintf(buffer, sizeof(buffer), "\"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f",
+                         percentile(sorted, 0.5), percentile(sorted, 0.99), percentile(sorted, 0.999));
+                latency = buffer;
+            }
+            snprintf(buffer, sizeof(buffer), "%s\n    {\"name\": \"%s\", \"operations\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, %s, %s, \"allocs_per_op\": %.2f}",
+                     (i > 0) ? "," : "", result.name.c_str(), static_cast<unsigned long long>(result.operations), result.seconds,
+                     opsPerSecond, latency.c_str(), cpu.c_str(), allocsPerOp);
+            ret += buffer;
+        }
+        ret += "\n  ]\n}\n";
+        return ret;
+    }
+
+    /**
+     * NetworkProvider is a process-wide singleton, each startup sample and each lookup table size
+     * runs in a fresh child process. Returns what the child printed on stdout.
+     */
+    std::string runChild(const std::vector<std::string>& args)
+    {
+        std::string ret;
+        int fds[2];
+        if (pipe(fds) < 0) {
+            return ret;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::vector<std::string> childArgs = {"network_bench"};
+            childArgs.insert(childArgs.end(), args.begin(), args.end());
+            std::vector<char*> argv;
+            for (std::string& arg : childArgs) {
+                argv.push_back(&arg[0]);
+            }
+            argv.push_back(nullptr);
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+        close(fds[1]);
+        char buffer[4096];
+        ssize_t count = 0;
+        while ((count = read(fds[0], buffer, sizeof(buffer))) > 0) {
+            ret.append(buffer, count);
+        }
+        close(fds[0]);
+        waitpid(pid, nullptr, 0);
+        return ret;
+    }
+
+    /**
+     * The child prints "<microseconds> <allocations>" on stdout.
+     */
+    int startupChild(const std::string& address, bool privateConnections)
+    {
+        Logger::setLevel(LogLevel::Warn);
+        NetworkProvider::Options options;
+        options.busAddress = address;
+        options.privateConnections = privateConnections;
+        uint64_t allocations = allocationCount();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        NetworkProvider::initialize(options);
+        double elapsed = elapsedMicroseconds(start);
+        printf("%.3f %llu\n", elapsed, static_cast<unsigned long long>(allocationCount() - allocations));
+        fflush(stdout);
+        // The reactor threads never return, skip static destruction
+        _exit(0);
+    }
+
+    BenchResult measureStartup(const std::string& name, const BenchConfig& config, const std::string& address)
+    {
+        BenchResult ret;
+        ret.name = name;
+        for (size_t i = 0; i < config.startupRuns; i++) {
+            std::string output = runChild({"--startup-child", address, config.privateConnections ? "1" : "0"});
+            double elapsed = 0;
+            unsigned long long allocations = 0;
+            if (sscanf(output.c_str(), "%lf %llu", &elapsed, &allocations) == 2) {
+                ret.latencies.push_back(elapsed);
+                ret.seconds += elapsed / 1e6;
+                ret.allocations += allocations;
+                ret.operations++;
+            }
+        }
+        return ret;
+    }
+
+    /**
+     * iterations lookups spread over all devices paired at startup. The child prints
+     * "<seconds> <allocations> <count>" and then count latencies in microseconds, one per line.
+     */
+    int lookupChild(const std::string& address, size_t devices, size_t iterations)
+    {
+        Logger::setLevel(LogLevel::Warn);
+        NetworkProvider::Options options;
+        options.busAddress = address;
+        NetworkProvider::initialize(options);
+        BluetoothAdapter& adapter = BluetoothAdapter::getInstance();
+        std::vector<std::string> addresses;
+        for (size_t i = 0; i < devices; i++) {
+            addresses.push_back(MockServices::deviceAddress(i));
+        }
+
+        volatile uintptr_t sink = 0;
+        BenchResult result = measure("", iterations, [&](size_t i) {
+            sink = sink + reinterpret_cast<uintptr_t>(adapter.getBluetoothDevice(addresses[(i * G_LOOKUP_STRIDE) % addresses.size()]).get());
+        });
+        printf("%.9f %llu %zu\n", result.seconds, static_cast<unsigned long long>(result.allocations), result.latencies.size());
+        for (double latency : result.latencies) {
+            printf("%.3f\n", latency);
+        }
+        fflush(stdout);
+        _exit(0);
+    }
+
+    BenchResult measureLookups(const std::string& name, const BenchConfig& config, const std::string& address, size_t devices)
+    {
+        BenchResult ret;
+        ret.name = name;
+        std::istringstream output(runChild({"--lookup-child", address, std::to_string(devices), std::to_string(config.iterations)}));
+        size_t count = 0;
+        if (!(output >> ret.seconds >> ret.allocations >> count)) {
+            return ret;
+        }
+        double latency = 0;
+        while ((ret.latencies.size() < count) && (output >> latency)) {
+            ret.latencies.push_back(latency);
+        }
+        ret.operations = ret.latencies.size();
+        return ret;
+    }
+
+    void usage(const char* name)
+    {
+        std::cerr << "Usage: " << name << " [--paired N] [--discoverable N] [--iterations N] [--startup-runs N] [--storm RATE]\n"
+                  << "       [--max-unpaired N] [--properties-window MS] [--latency MS] [--private-connections] [--filter NAME] [--output FILE] [--mock PATH] [--daemon PATH]\n"
+                  << "Runs the library against network_mock and prints JSON results.\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if ((argc == 4) && (0 == strcmp(argv[1], "--startup-child"))) {
+        return startupChild(argv[2], 0 == strcmp(argv[3], "1"));
+    }
+    if ((argc == 5) && (0 == strcmp(argv[1], "--lookup-child"))) {
+        return lookupChild(argv[2], strtoul(argv[3], nullptr, 10), strtoul(argv[4], nullptr, 10));
+    }
+
+    BenchConfig config;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--private-connections") {
+            config.privateConnections = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (option == "--paired") {
+            config.pairedDevices = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--discoverable") {
+            config.discoverableDevices = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--iterations") {
+            config.iterations = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--startup-runs") {
+            config.startupRuns = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--max-unpaired") {
+            config.maxUnpairedDevices = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--properties-window") {
+            config.propertiesWindowMs = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--latency") {
+            config.replyLatencyMs = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--storm") {
+            config.stormRate = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--filter") {
+            config.filter = value;
+        }
+        else if (option == "--output") {
+            config.output = value;
+        }
+        else if (option == "--mock") {
+            config.mockPath = value;
+        }
+        else if (option == "--daemon") {
+            config.daemonPath = value;
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((config.pairedDevices == 0) || (config.iterations == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    std::function<bool(const char*)> selected = [&config](const char* name) {
+        return config.filter.empty() || (std::string(name).find(config.filter) != std::string::npos);
+    };
+
+    try {
+        // Startup loads every paired device from one GetManagedObjects reply and lookups should not
+        // depend on how many there are, one mock per table size
+        static const size_t G_TABLE_SIZES[] = {10, 100, 1000, 10000};
+        for (size_t devices : G_TABLE_SIZES) {
+            if (!selected("startup") && !selected("get_bluetooth_device")) {
+                break;
+            }
+            BenchConfig sized = config;
+            sized.pairedDevices = devices;
+            sized.discoverableDevices = 0;
+            MockProcess sizedMock(sized);
+            if (selected("startup")) {
+                results.push_back(measureStartup("startup_" + std::to_string(devices), config, sizedMock.getAddress()));
+            }
+            if (selected("get_bluetooth_device")) {
+                results.push_back(measureLookups("get_bluetooth_device_" + std::to_string(devices), config, sizedMock.getAddress(), devices));
+            }
+        }
+
+        MockProcess mock(config);
+        MockControl control(mock.getAddress());
+
+        Logger::setLevel(LogLevel::Warn);
+        NetworkProvider::Options options;
+        options.busAddress = mock.getAddress();
+        options.privateConnections = config.privateConnections;
+        options.maxUnpairedDevices = config.maxUnpairedDevices;
+        options.devicePropertiesWindow = std::chrono::milliseconds(config.propertiesWindowMs);
+        options.unpairedDeviceTtl = std::chrono::seconds(0);
+        NetworkProvider& network = NetworkProvider::initialize(options);
+        BluetoothAdapter& adapter = BluetoothAdapter::getInstance();
+
+        std::vector<std::string> paired;
+        for (size_t i = 0; i < config.pairedDevices; i++) {
+            paired.push_back(MockServices::deviceAddress(i));
+        }
+        static const char* const G_PROFILE_NAMES[] = {"hfp", "a2dp", "AVRCP", "pbap", "Map", "unknown-profile"};
+        std::vector<std::string> profiles(std::begin(G_PROFILE_NAMES), std::end(G_PROFILE_NAMES));
+        std::vector<BluetoothUuid> uuids;
+        for (const std::string& profile : profiles) {
+            const ProfileEntry* entry = findProfileByName(profile);
+            uuids.push_back((nullptr != entry) ? entry->uuid : BluetoothUuid());
+        }
+        volatile uintptr_t sink = 0;
+
+        // Lookups from many threads at once scale only if readers share no lock or counter
+        if (selected("get_bluetooth_device_readers")) {
+            for (size_t threads = 1; threads <= 32; threads *= 2) {
+                results.push_back(measureReaders(adapter, paired, threads, config.iterations * 10));
+            }
+        }
+        if (selected("profile_name_lookup")) {
+            results.push_back(measure("profile_name_lookup", config.iterations, [&](size_t i) {
+                sink = sink + reinterpret_cast<uintptr_t>(findProfileByName(profiles[i % profiles.size()]));
+            }));
+        }
+        if (selected("profile_uuid_lookup")) {
+            results.push_back(measure("profile_uuid_lookup", config.iterations, [&](size_t i) {
+                sink = sink + reinterpret_cast<uintptr_t>(findProfileName(uuids[i % uuids.size()]));
+            }));
+        }
+        // Device1 dictionary of every InterfacesAdded and GetManagedObjects entry, no bus involved
+        if (selected("decode_device1")) {
+            DBusMessage* message = newDevice1Properties();
+            if (decodeSummary(message, &BluetoothAdapter::parseDeviceProperties) != decodeSummary(message, &walkDeviceProperties)) {
+                dbus_message_unref(message);
+                throw std::runtime_error("decode_device1: decoders disagree");
+            }
+            using Parser = void (*)(DBusMessageIter*, DeviceDelta&);
+            const std::pair<const char*, Parser> decoders[] = {{"decode_device1", &BluetoothAdapter::parseDeviceProperties},
+                                                               {"decode_device1_iterator_walk", &walkDeviceProperties}};
+            for (const std::pair<const char*, Parser>& decoder : decoders) {
+                results.push_back(measure(decoder.first, config.iterations * 10, [&](size_t) {
+                    DBusMessageIter iter;
+                    DeviceDelta delta;
+                    dbus_message_iter_init(message, &iter);
+                    decoder.second(&iter, delta);
+                    sink = sink + delta.rssi.value_or(0);
+                }));
+            }
+            dbus_message_unref(message);
+        }
+        if (selected("get_wifi_status")) {
+            results.push_back(measure("get_wifi_status", config.iterations, [&](size_t) {
+                sink = sink + network.getWifiProperties().wirelessEnabled;
+            }));
+        }
+        if (selected("get_bluetooth_name")) {
+            results.push_back(measure("get_bluetooth_name", config.iterations, [&](size_t) {
+                sink = sink + network.getBluetoothName().size();
+            }));
+        }
+        if (selected("get_bluetooth_name_async")) {
+            results.push_back(measure("get_bluetooth_name_async", config.iterations, [&](size_t) {
+                sink = sink + network.getBluetoothNameAsync().get().size();
+            }));
+        }
+        if (selected("refresh_wifi_properties")) {
+            results.push_back(measure("refresh_wifi_properties", config.iterations, [&](size_t) {
+                sink = sink + network.refreshWifiProperties();
+            }));
+        }
+        if (selected("toggle_wifi")) {
+            results.push_back(measure("toggle_wifi", config.iterations, [&](size_t) {
+                network.toggleNetWork(NetworkProvider::NetworkType::Wifi);
+            }));
+        }
+        if (selected("connect_profile")) {
+            results.push_back(measure("connect_profile", config.iterations, [&](size_t i) {
+                network.connectProfile(paired[i % paired.size()], "hfp");
+            }));
+        }
+        if (selected("connect_profile_async")) {
+            results.push_back(measure("connect_profile_async", config.iterations, [&](size_t i) {
+                sink = sink + network.connectProfileAsync(paired[i % paired.size()], "a2dp").get();
+            }));
+        }
+        // Eight requests per batch while every reply takes replyLatencyMs, against issuing them one after the other
+        if (selected("connect_profiles_bulk")) {
+            std::vector<NetworkProvider::ProfileRequest> requests;
+            for (size_t i = 0; i < 8; i++) {
+                requests.push_back({paired[i % paired.size()], profiles[i % 5]});
+            }
+            size_t batches = config.iterations / 100 + 1;
+            control.setReplyLatency(std::chrono::milliseconds(config.replyLatencyMs));
+            results.push_back(measure("connect_profiles_sequential", batches, [&](size_t) {
+                for (const NetworkProvider::ProfileRequest& request : requests) {
+                    network.connectProfile(request.address, request.profile);
+                }
+            }));
+            static const size_t G_BULK_CAPS[] = {1, 2, 4, 0};
+            for (size_t cap : G_BULK_CAPS) {
+                std::string name = "connect_profiles_bulk_" + ((cap > 0) ? std::to_string(cap) : std::string("unbounded"));
+                results.push_back(measure(name, batches, [&](size_t) {
+                    sink = sink + network.connectProfiles(requests, cap).size();
+                }));
+            }
+            control.setReplyLatency(std::chrono::milliseconds(0));
+        }
+
+        // From bluetoothd sending a signal to its handler running, on an otherwise idle bus
+        if (selected("signal_to_handler")) {
+            results.push_back(measureSignalLatency("signal_to_handler", network, control, config.iterations / 4 + 1));
+        }
+
+        // Devices are announced in index order and nothing was discovering before, only the cases below emit storms
+        size_t total = config.pairedDevices + config.discoverableDevices;
+        size_t announced = config.pairedDevices;
+
+        // One InterfacesAdded at a time, from the request to the device being visible in the table
+        if (selected("ingest_interfaces_added")) {
+            size_t count = std::min(config.iterations, (total - announced) / 2);
+            std::vector<std::string> addresses;
+            for (size_t i = 0; i < count; i++) {
+                addresses.push_back(MockServices::deviceAddress(announced + i));
+            }
+            if (count > 0) {
+                results.push_back(measure("ingest_interfaces_added", count, [&](size_t i) {
+                    {
+                        AllocationPause pause;
+                        control.emitStorm(1);
+                    }
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    while ((nullptr == adapter.getBluetoothDevice(addresses[i])) && (std::chrono::steady_clock::now() - start < G_INGEST_TIMEOUT)) {
+                        std::this_thread::yield();
+                    }
+                }));
+            }
+            announced += count;
+        }
+
+        // Whatever devices are left are announced in one burst, then only RSSI updates remain
+        if (selected("ingest_throughput")) {
+            uint32_t remaining = static_cast<uint32_t>(total - announced);
+            if (remaining > 0) {
+                results.push_back(measureIngestThroughput("ingest_throughput_interfaces_added", network, control, remaining));
+            }
+            results.push_back(measureIngestThroughput("ingest_throughput_properties_changed", network, control, static_cast<uint32_t>(config.iterations * 10)));
+        }
+
+        // Replies queued behind a discovery storm, the case private connections are for
+        if (selected("connect_profile_under_storm")) {
+            network.setScanMode(true);
+            control.setStormRate(config.stormRate);
+            results.push_back(measure("connect_profile_under_storm", config.iterations, [&](size_t i) {
+                network.connectProfile(paired[i % paired.size()], "hfp");
+            }));
+            control.setStormRate(0);
+            network.setScanMode(false);
+        }
+
+        // Signals per second and CPU spent ingesting them with and without bluetoothd filtering at the source
+        if (selected("discovery_filter")) {
+            results.push_back(measureDiscovery("discovery_filter_none", network, control, config.stormRate, nullptr));
+
+            NetworkProvider::DiscoveryFilter nearby;
+            nearby.transport = NetworkProvider::DiscoveryFilter::Transport::Le;
+            nearby.rssi = -70;
+            nearby.duplicateData = false;
+            results.push_back(measureDiscovery("discovery_filter_le_nearby", network, control, config.stormRate, &nearby));
+
+            NetworkProvider::DiscoveryFilter services;
+            services.uuids = {"HID-Logitech", "BS"};
+            services.duplicateData = false;
+            results.push_back(measureDiscovery("discovery_filter_uuids", network, control, config.stormRate, &services));
+        }
+    }
+    catch (const std::runtime_error& error) {
+        std::cerr << "network_bench: " << error.what() << std::endl;
+        return 1;
+    }
+
+    std::string json = toJson(config, results);
+    if (config.output.empty()) {
+        fwrite(json.data(), 1, json.size(), stdout);
+        fflush(stdout);
+    }
+    else {
+        FILE* file = fopen(config.output.c_str(), "w");
+        if (nullptr == file) {
+            std::cerr << "network_bench: cannot write " << config.output << std::endl;
+            _exit(1);
+        }
+        fwrite(json.data(), 1, json.size(), file);
+        fclose(file);
+    }
+    // Same as the startup child: the library's threads never stop
+    _exit(0);
+}
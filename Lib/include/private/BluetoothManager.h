@@ -2,12 +2,15 @@
 #define BLUETOOTH_ADAPTER
 
 #include <unordered_map>
+#include <array>
+#include <atomic>
 #include <memory>
 #include <list>
 #include <unordered_map>
 #include <shared_mutex>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <functional>
 #include <dbus/dbus.h>
@@ -21,10 +24,92 @@
 #include <tuple>
 #include <type_traits>
 #include <optional>
+#include <cstdint>
+#include <future>
 #include "GlobalVariable.h"
+#include "BluetoothUuid.h"
+#include "BoundedQueue.h"
+#include "Snapshot.h"
+#include "NetworkProvider.h"
 
 class NetworkProvider;
 class BluetoothAdapter;
+class DBusMessageTemplate;
+
+/**
+ * Move-only so a discovery record travels from the reactor thread to the action thread without copies.
+ */
+struct DeviceInfo
+{
+    DeviceInfo() = default;
+    DeviceInfo(DeviceInfo&&) = default;
+    DeviceInfo& operator=(DeviceInfo&&) = default;
+    DeviceInfo(const DeviceInfo&) = delete;
+    DeviceInfo& operator=(const DeviceInfo&) = delete;
+
+    std::string devicePath;
+    std::string deviceName;
+    std::string deviceAddress;
+    std::vector<BluetoothUuid> uuids;
+    bool paired = false;
+    bool connected = false;
+    int16_t rssi = G_RSSI_UNKNOWN;
+};
+
+/**
+ * Device1 properties carried by one message, unset fields were not part of it.
+ */
+struct DeviceDelta
+{
+    std::optional<std::string> deviceName;
+    std::optional<std::string> deviceAddress;
+    std::optional<std::vector<BluetoothUuid>> uuids;
+    std::optional<bool> paired;
+    std::optional<bool> connected;
+    std::optional<int16_t> rssi;
+
+    /**
+     * Take every field newer carries, as if both deltas were applied in order.
+     */
+    void merge(DeviceDelta&& newer);
+};
+
+/**
+ * Cached org.bluez.Adapter1 properties. A snapshot is never modified once published,
+ * updates build a new one and swap it in.
+ */
+struct AdapterProperties
+{
+    std::string alias;
+    std::string address;
+    bool powered = false;
+    bool discovering = false;
+};
+
+class BluetoothDevice;
+
+/**
+ * Known devices by object path and by packed MAC address. Published as a whole through Snapshot and
+ * never modified once readers can see it. Both indexes are split in G_DEVICE_TABLE_SHARDS maps shared
+ * between snapshots, an update copies only the shards it touches.
+ */
+struct DeviceTable
+{
+    using PathMap = std::unordered_map<std::string, std::shared_ptr<BluetoothDevice>>;
+    using AddressMap = std::unordered_map<uint64_t, std::shared_ptr<BluetoothDevice>>;
+
+    DeviceTable();
+
+    std::shared_ptr<BluetoothDevice> findPath(const std::string& devicePath) const;
+    std::shared_ptr<BluetoothDevice> findAddress(uint64_t address) const;
+
+    static size_t pathShard(const std::string& devicePath);
+    static size_t addressShard(uint64_t address);
+
+    std::array<std::shared_ptr<const PathMap>, G_DEVICE_TABLE_SHARDS> byPath;
+    std::array<std::shared_ptr<const AddressMap>, G_DEVICE_TABLE_SHARDS> byAddress;
+    size_t size = 0;
+};
 
 class BluetoothDevice
 {
@@ -37,28 +122,60 @@ class BluetoothDevice
         std::string getDevicePath() const;
 
         Status getStatus() const;
-        std::vector<std::string> getUUIDs() const;
+        std::vector<BluetoothUuid> getUUIDs() const;
+        int16_t getRSSI() const;
 
         void createBond();
         void destroyBond();
-        void connectProfile(const std::string& profile);
-        void disconnectProfile(const std::string& profile);
-        void disconnect();
+        void connectProfile(const std::string& profile, const CallOptions& options = CallOptions());
+        void disconnectProfile(const std::string& profile, const CallOptions& options = CallOptions());
+        void disconnect(const CallOptions& options = CallOptions());
+
+        std::future<bool> connectProfileAsync(const std::string& profile, const CallOptions& options = CallOptions());
+        void connectProfileAsync(const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options = CallOptions());
+        std::future<bool> disconnectProfileAsync(const std::string& profile, const CallOptions& options = CallOptions());
+        void disconnectProfileAsync(const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options = CallOptions());
+        std::future<bool> disconnectAsync(const CallOptions& options = CallOptions());
+        void disconnectAsync(NetworkProvider::CompletionCallback callback, const CallOptions& options = CallOptions());
         
         void setStatus(const Status& state);
-        void setUUIDs(const std::vector<std::string>& uuids);
+        void setUUIDs(const std::vector<BluetoothUuid>& uuids);
+        void applyDelta(const DeviceDelta& delta);
         void dump();
 
+        /**
+         * Paired or connected devices are never evicted from the device table.
+         */
+        bool isPinned() const;
+
+        /**
+         * Steady clock time in nanoseconds of the last signal about this device, what LRU eviction goes by.
+         */
+        int64_t getLastSeen() const;
+        void touch();
+
+        /**
+         * Estimated heap held by this record: the object, its shared_ptr control block and owned buffers.
+         */
+        size_t getMemoryUsage() const;
+
     protected:
-        BluetoothDevice(BluetoothAdapter& adapter, const std::string& deviceName, const std::string& deviceAddress, const std::string& devicePath ,const std::vector<std::string>& uuids);
+        BluetoothDevice(BluetoothAdapter& adapter, DeviceInfo&& info);
+
+        bool callProfileMethod(const char* method, const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options);
+        bool callMethod(const char* method, const char* argument, NetworkProvider::CompletionCallback callback, const CallOptions& options);
 
         BluetoothAdapter& mAdapter;
         mutable std::shared_mutex mMutex;
-        std::vector<std::string> mUUIDs;
+        std::vector<BluetoothUuid> mUUIDs;
         std::string mDeviceName;
         std::string mDeviceAddress;
         std::string mDevicePath;
         Status mState;
+        bool mPaired;
+        int16_t mRSSI;
+        std::atomic<int64_t> mLastSeen;
+        bool mListed; // In the adapter's device table and counted by it, under mMutex
 };
 
 class BluetoothAdapter
@@ -69,47 +186,112 @@ class BluetoothAdapter
     friend class BluetoothDevice;
     public:
 
-        static std::unordered_map<std::string, std::string> gProfileMap;
         static BluetoothAdapter& initialize(NetworkProvider& network);
         static BluetoothAdapter& getInstance();
 
-        template<typename T>
-        static std::string getProfile(const T& uuid);
+        static std::string getProfile(const BluetoothUuid& uuid);
+
+        /**
+         * Needs no adapter, network_bench times it on a prebuilt message.
+         */
+        static void parseDeviceProperties(DBusMessageIter* properties, DeviceDelta& delta);
 
-        void startDiscovery();
-        void stopDiscovery();
-        void toggleBluetoothPower();
+        void startDiscovery(const CallOptions& options = CallOptions());
+        void startDiscovery(const NetworkProvider::DiscoveryFilter& filter, const CallOptions& options = CallOptions());
+        void stopDiscovery(const CallOptions& options = CallOptions());
+        void toggleBluetoothPower(const CallOptions& options = CallOptions());
         void dumpDevicesUnpaired();
         void dumpDevicesPaired();
         bool getBluetoothPower() const;
-        void disconnectBluetooth(const std::string& address);
-        void disconnectProfile(const std::string& address, const std::string& profile);
-        void connectProfile(const std::string& address, const std::string& profile);
+        bool isDiscovering() const;
+        bool refresh(const CallOptions& options = CallOptions());
+        void disconnectBluetooth(const std::string& address, const CallOptions& options = CallOptions());
+        void disconnectProfile(const std::string& address, const std::string& profile, const CallOptions& options = CallOptions());
+        void connectProfile(const std::string& address, const std::string& profile, const CallOptions& options = CallOptions());
         std::string getBluetoothName() const;
         std::string getBluetoothAddress() const;
+        std::future<bool> connectProfileAsync(const std::string& address, const std::string& profile, const CallOptions& options = CallOptions());
+        void connectProfileAsync(const std::string& address, const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options = CallOptions());
+        std::future<bool> disconnectProfileAsync(const std::string& address, const std::string& profile, const CallOptions& options = CallOptions());
+        void disconnectProfileAsync(const std::string& address, const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options = CallOptions());
+        std::future<bool> disconnectBluetoothAsync(const std::string& address, const CallOptions& options = CallOptions());
+        void disconnectBluetoothAsync(const std::string& address, NetworkProvider::CompletionCallback callback, const CallOptions& options = CallOptions());
+        std::future<std::vector<NetworkProvider::ProfileResult>> connectProfilesAsync(const std::vector<NetworkProvider::ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options = CallOptions());
+        std::future<std::vector<NetworkProvider::ProfileResult>> disconnectProfilesAsync(const std::vector<NetworkProvider::ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options = CallOptions());
+        std::future<std::string> getBluetoothNameAsync(const CallOptions& options = CallOptions()) const;
+        void getBluetoothNameAsync(NetworkProvider::StringCallback callback, const CallOptions& options = CallOptions()) const;
+        std::future<std::string> getBluetoothAddressAsync(const CallOptions& options = CallOptions()) const;
+        void getBluetoothAddressAsync(NetworkProvider::StringCallback callback, const CallOptions& options = CallOptions()) const;
         std::vector<std::shared_ptr<BluetoothDevice>> getBondedDevices() const;
+        uint64_t getDroppedDeviceInfos() const;
+        void getDeviceStats(NetworkProvider::Stats& stats) const;
         std::shared_ptr<BluetoothDevice> getBluetoothDevice(const std::string& address);
 
     private:
+        struct BulkOperation;
+
+        struct PendingDelta
+        {
+            std::shared_ptr<BluetoothDevice> device;
+            DeviceDelta delta;
+        };
+
         BluetoothAdapter(NetworkProvider& network);
         ~BluetoothAdapter();
 
-        void discoveringHandler();
+        static void parseInvalidatedProperties(const std::vector<std::string_view>& invalidated, DeviceDelta& delta);
+        static DeviceInfo makeDeviceInfo(std::string_view devicePath, DeviceDelta&& delta);
+        static DeviceDelta makeDeviceDelta(DeviceInfo&& info);
+        static Status getStatus(const DeviceInfo& info);
+        static void parseAdapterProperties(DBusMessageIter* properties, AdapterProperties& adapter);
+        static void parseInvalidatedProperties(const std::vector<std::string_view>& invalidated, AdapterProperties& adapter);
+
+        bool getAdapterProperty(const DBusMessageTemplate& request, NetworkProvider::StringCallback callback, const CallOptions& options) const;
+        std::future<std::vector<NetworkProvider::ProfileResult>> runBulk(bool isConnect, const std::vector<NetworkProvider::ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options);
+        void pumpBulk(const std::shared_ptr<BulkOperation>& bulk);
+        void finishBulkItem(const std::shared_ptr<BulkOperation>& bulk, size_t index, bool success);
+
+        void startDiscovery(const NetworkProvider::DiscoveryFilter* filter, const CallOptions& options);
+        bool setDiscoveryFilter(const NetworkProvider::DiscoveryFilter* filter, const CallOptions& options);
+        static DBusMessage* newDiscoveryFilterCall(const NetworkProvider::DiscoveryFilter* filter);
+
         void bluetoothActionHandler();
+        void handleInterfacesAdded(DBusMessage* message);
+        void handleInterfacesRemoved(DBusMessage* message);
+        void handleDevicePropertiesChanged(DBusMessage* message);
+        void flushDeviceDeltas();
+        void handleAdapterSignal(DBusMessage* message);
+        std::shared_ptr<const AdapterProperties> loadAdapterProperties() const;
+        void queueDeviceInfo(DeviceInfo&& info);
         bool existsPaired(const std::string& devicePath);
+        std::shared_ptr<BluetoothDevice> findDevice(const char* devicePath) const;
+        void insertDevices(std::vector<DeviceInfo>&& infos);
+        void removeDevices(const std::vector<std::shared_ptr<BluetoothDevice>>& devices);
+        void evictDevices(bool sweepExpired);
+        void updatePinned(bool pinned);
+        bool isOverCap() const;
+        static std::optional<uint64_t> parseAddress(const std::string& address);
         
-        std::unordered_map<std::string, std::shared_ptr<BluetoothDevice>> mDevicesTable;
-        std::list<std::tuple<std::string, std::string, std::string, std::vector<std::string>>> mDeviceInfosQueues;
+        Snapshot<DeviceTable> mDevices;
+        BoundedQueue<DeviceInfo> mDeviceInfosQueue;
+        std::vector<uint64_t> mSubscriptions;
         NetworkProvider& mNetwork;
-        std::string mBluetoothName;
-        std::string mBluetoothAddress;
+        std::shared_ptr<const AdapterProperties> mAdapterProperties;
+        std::mutex mAdapterPropertiesMutex; // Serializes writers, readers only std::atomic_load
         mutable std::shared_mutex mMutex;
+        std::mutex mDevicesMutex; // Serializes writers of mDevices
+        std::atomic<size_t> mUnpinnedDevices; // Unpinned devices in mDevices, what maxUnpairedDevices bounds
+        std::atomic<uint64_t> mDevicesEvicted;
+        std::atomic<uint64_t> mDevicesExpired;
+        std::atomic<uint64_t> mDevicesRemoved;
+        std::unordered_map<const BluetoothDevice*, PendingDelta> mPendingDeltas; // Signal reactor thread only
+        bool mFlushScheduled; // Signal reactor thread only
+        std::atomic<uint64_t> mDevicePropertiesCoalesced;
         std::mutex mDiscoveringMutex;
-        std::condition_variable mDiscoveringCV;
         std::mutex mBluetoothActionMutex;
         std::condition_variable mBluetoothActionCV;
         bool mDiscovering;
-        std::thread* mDiscoveringThread;
+        bool mDiscoveryFiltered; // bluetoothd keeps a filter for this client, under mMutex
         std::thread* mBluetoothActionThread;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,204 @@
+#ifndef BLUETOOTH_PROFILE
+#define BLUETOOTH_PROFILE
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include "BluetoothUuid.h"
+#include "Hash.h"
+
+    constexpr BluetoothUuid operator""_uuid(const char* text, size_t length)
+    {
+        // Malformed literals fail to compile: value() throws during constant evaluation
+        return BluetoothUuid::parse(std::string_view(text, length)).value();
+    }
+
+    struct ProfileEntry
+    {
+        BluetoothUuid uuid;
+        const char* name;
+    };
+
+    /**
+     * Known profiles. A UUID listed more than once keeps its first name for display,
+     * later entries are aliases.
+     */
+    static constexpr ProfileEntry G_PROFILES[] = {
+        {"00001200-0000-1000-8000-00805f9b34fb"_uuid, "PnP"}, // Plug and Play
+        {"0000111f-0000-1000-8000-00805f9b34fb"_uuid, "HFP"}, // Handfree profile
+        {"0000112f-0000-1000-8000-00805f9b34fb"_uuid, "PBAP"}, // Phone Book Access Profile
+        {"0000110a-0000-1000-8000-00805f9b34fb"_uuid, "Audio-Source"},
+        {"0000110b-0000-1000-8000-00805f9b34fb"_uuid, "Audio-Sink"},
+        {"0000110e-0000-1000-8000-00805f9b34fb"_uuid, "A2DP-Source"}, // A/V Remote Control
+        {"0000110c-0000-1000-8000-00805f9b34fb"_uuid, "A2DP-Sink"}, // A/V Remote Control Target
+        {"0000110d-0000-1000-8000-00805f9b34fb"_uuid, "A2DP"}, // Advanced Audio Distribution Profile
+        {"00001116-0000-1000-8000-00805f9b34fb"_uuid, "HSP"}, // Headset Profile
+        {"00001108-0000-1000-8000-00805f9b34fb"_uuid, "HSP-Audio-Headphones"},
+        {"00001132-0000-1000-8000-00805f9b34fb"_uuid, "MAP"}, // Message Access Profile
+        {"00001801-0000-1000-8000-00805f9b34fb"_uuid, "GATT"}, // Generic Attribute Profile
+        {"00000000-deca-fade-deca-deafdecacafe"_uuid, "Custom-Profile"},
+        {"02030302-1d19-415f-86f2-22a2106a0a77"_uuid, "Custom-UUID-1"},
+        {"2d8d2466-e14d-451c-88bc-7301abea291a"_uuid, "Custom-UUID-2"},
+        {"00000000-deca-fade-deca-deafdecacafe"_uuid, "iAP"}, // Apple's Internet Accessory Protocol
+        {"2d8d2466-e14d-451c-88bc-7301abea291a"_uuid, "Carplay"},
+        {"02030302-1d19-415f-86f2-22a2106a0a77"_uuid, "iAP-v2"},
+        {"1ff31936-572e-4b36-a2bf-b2409b1aa6f4"_uuid, "MAP-Apple"},
+        {"00001000-0000-1000-8000-00805f9b34fb"_uuid, "Discovery-Server-Service-Class-ID"},
+        {"00001800-0000-1000-8000-00805f9b34fb"_uuid, "GAP"}, // Generic Access Profile
+        {"0000180a-0000-1000-8000-00805f9b34fb"_uuid, "DIS"}, // Device Information Service
+        {"9fa480e0-4967-4542-9390-d343dc5d04ae"_uuid, "TDS"}, // Transport Discovery Service
+        {"d0611e78-bbb4-4591-a5f8-487910ae4366"_uuid, "AMS"}, // Apple Media Service
+        {"00001105-0000-1000-8000-00805f9b34fb"_uuid, "OPP"}, // OBEX Object Push Profile
+        {"00001112-0000-1000-8000-00805f9b34fb"_uuid, "HSP-AG"}, // Headset Profile (HSP) - Audio Gateway (AG)
+        {"00001115-0000-1000-8000-00805f9b34fb"_uuid, "PAN"}, // Personal Area Networking
+        {"0000FE03-0000-1000-8000-00805F9B34FB"_uuid, "VendorId - Baidu"},
+        {"0000FDDF-0000-1000-8000-00805F9B34FB"_uuid, "VendorId - Amazon"},
+        {"00001203-0000-1000-8000-00805F9B34FB"_uuid, "GAVDP"}, // Generic Audio/Video Distribution Profile
+        {"0000110F-0000-1000-8000-00805F9B34FB"_uuid, "AVRCP"}, // Audio/Video Remote Control Profile
+        {"00001101-0000-1000-8000-00805f9b34fb"_uuid, "Serial-Port"},
+        {"00001124-0000-1000-8000-00805f9b34fb"_uuid, "HID"}, // Human Interface Device
+        {"0000180f-0000-1000-8000-00805f9b34fb"_uuid, "BS"}, // Battery Service
+        {"0000fd72-0000-1000-8000-00805f9b34fb"_uuid, "LIS"}, // Logitech International SA
+        {"00010000-0000-1000-8000-011f2000046d"_uuid, "Logitech-Vendor-Id"},
+        {"0000111e-0000-1000-8000-00805f9b34fb"_uuid, "HFP-HV-SK579BT"},
+        {"00001812-0000-1000-8000-00805f9b34fb"_uuid, "HID-Logitech"},
+    };
+
+    static constexpr size_t G_PROFILE_COUNT = sizeof(G_PROFILES) / sizeof(G_PROFILES[0]);
+    static constexpr size_t G_PROFILE_SLOTS = 256;
+    static constexpr uint8_t G_PROFILE_EMPTY_SLOT = 0xFF;
+    static_assert(G_PROFILE_COUNT < G_PROFILE_EMPTY_SLOT, "Profile index stores entries in uint8_t");
+
+    struct ProfileUuidIndex
+    {
+        uint64_t seed;
+        std::array<uint8_t, G_PROFILE_SLOTS> slots;
+    };
+
+    /**
+     * Search a seed for which every distinct UUID of G_PROFILES lands in its own slot,
+     * the lookup is then one hash, one load and one compare.
+     */
+    constexpr ProfileUuidIndex buildProfileUuidIndex()
+    {
+        for (uint64_t seed = 1; seed < 100000; seed++) {
+            ProfileUuidIndex index = {seed, {}};
+            for (uint8_t& slot : index.slots) {
+                slot = G_PROFILE_EMPTY_SLOT;
+            }
+
+            bool perfect = true;
+            for (size_t i = 0; (i < G_PROFILE_COUNT) && perfect; i++) {
+                uint8_t& slot = index.slots[G_PROFILES[i].uuid.hash(seed) & (G_PROFILE_SLOTS - 1)];
+                if (slot == G_PROFILE_EMPTY_SLOT) {
+                    slot = static_cast<uint8_t>(i);
+                }
+                else if (G_PROFILES[slot].uuid != G_PROFILES[i].uuid) {
+                    perfect = false;
+                }
+            }
+            if (perfect) {
+                return index;
+            }
+        }
+        throw std::logic_error("No perfect hash seed for G_PROFILES");
+    }
+
+    static constexpr ProfileUuidIndex G_PROFILE_UUID_INDEX = buildProfileUuidIndex();
+
+    /**
+     * Display name of a known profile, nullptr when the UUID is not in G_PROFILES.
+     */
+    constexpr const char* findProfileName(const BluetoothUuid& uuid)
+    {
+        uint8_t slot = G_PROFILE_UUID_INDEX.slots[uuid.hash(G_PROFILE_UUID_INDEX.seed) & (G_PROFILE_SLOTS - 1)];
+        if ((slot == G_PROFILE_EMPTY_SLOT) || (G_PROFILES[slot].uuid != uuid)) {
+            return nullptr;
+        }
+        return G_PROFILES[slot].name;
+    }
+
+    static_assert(findProfileName("0000110f-0000-1000-8000-00805f9b34fb"_uuid) != nullptr, "Profile lookup must ignore case");
+
+    constexpr char foldProfileChar(char c)
+    {
+        return ((c >= 'a') && (c <= 'z')) ? static_cast<char>(c - 'a' + 'A') : c;
+    }
+
+    constexpr bool equalsProfileName(std::string_view left, std::string_view right)
+    {
+        if (left.size() != right.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < left.size(); i++) {
+            if (foldProfileChar(left[i]) != foldProfileChar(right[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Seeded FNV-1a over the upper-cased name, so "hfp" and "HFP" share a slot.
+     */
+    constexpr uint64_t hashProfileName(std::string_view name, uint64_t seed)
+    {
+        uint64_t value = fnv1a(name, G_FNV1A_OFFSET_BASIS ^ seed, foldProfileChar);
+        return value ^ (value >> 29);
+    }
+
+    /**
+     * Reverse index, every name (aliases included) resolves to the UUID of its own entry.
+     * Names must be unique ignoring case, the build fails otherwise.
+     */
+    constexpr ProfileUuidIndex buildProfileNameIndex()
+    {
+        for (size_t i = 0; i < G_PROFILE_COUNT; i++) {
+            for (size_t j = i + 1; j < G_PROFILE_COUNT; j++) {
+                if (equalsProfileName(G_PROFILES[i].name, G_PROFILES[j].name)) {
+                    throw std::logic_error("Duplicate profile name in G_PROFILES");
+                }
+            }
+        }
+
+        for (uint64_t seed = 1; seed < 100000; seed++) {
+            ProfileUuidIndex index = {seed, {}};
+            for (uint8_t& slot : index.slots) {
+                slot = G_PROFILE_EMPTY_SLOT;
+            }
+
+            bool perfect = true;
+            for (size_t i = 0; (i < G_PROFILE_COUNT) && perfect; i++) {
+                uint8_t& slot = index.slots[hashProfileName(G_PROFILES[i].name, seed) & (G_PROFILE_SLOTS - 1)];
+                if (slot == G_PROFILE_EMPTY_SLOT) {
+                    slot = static_cast<uint8_t>(i);
+                }
+                else {
+                    perfect = false;
+                }
+            }
+            if (perfect) {
+                return index;
+            }
+        }
+        throw std::logic_error("No perfect hash seed for G_PROFILES names");
+    }
+
+    static constexpr ProfileUuidIndex G_PROFILE_NAME_INDEX = buildProfileNameIndex();
+
+    /**
+     * Profile entry for a case-insensitive name such as "hfp" or "iAP", nullptr when unknown.
+     */
+    constexpr const ProfileEntry* findProfileByName(std::string_view name)
+    {
+        uint8_t slot = G_PROFILE_NAME_INDEX.slots[hashProfileName(name, G_PROFILE_NAME_INDEX.seed) & (G_PROFILE_SLOTS - 1)];
+        if ((slot == G_PROFILE_EMPTY_SLOT) || !equalsProfileName(G_PROFILES[slot].name, name)) {
+            return nullptr;
+        }
+        return &G_PROFILES[slot];
+    }
+
+    static_assert(findProfileByName("iap")->uuid == findProfileByName("Custom-Profile")->uuid, "Aliases must share their UUID");
+
+#endif // BLUETOOTH_PROFILE
@@ -0,0 +1,128 @@
+#ifndef BLUETOOTH_UUID
+#define BLUETOOTH_UUID
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/**
+ * 128-bit UUID stored as two big-endian halves, parsed once from the DBus string form.
+ */
+class BluetoothUuid
+{
+    public:
+        static constexpr size_t G_STRING_LENGTH = 36;
+
+        constexpr BluetoothUuid() : mHigh(0), mLow(0) {}
+        constexpr BluetoothUuid(uint64_t high, uint64_t low) : mHigh(high), mLow(low) {}
+
+        /**
+         * Accept "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx" in any case, std::nullopt when malformed.
+         */
+        static constexpr std::optional<BluetoothUuid> parse(std::string_view text)
+        {
+            if (text.size() != G_STRING_LENGTH) {
+                return std::nullopt;
+            }
+
+            uint64_t halves[2] = {0, 0};
+            size_t digits = 0;
+            for (size_t i = 0; i < G_STRING_LENGTH; i++) {
+                char c = text[i];
+                if ((i == 8) || (i == 13) || (i == 18) || (i == 23)) {
+                    if (c != '-') {
+                        return std::nullopt;
+                    }
+                    continue;
+                }
+
+                int nibble = hexValue(c);
+                if (nibble < 0) {
+                    return std::nullopt;
+                }
+                halves[digits / 16] = (halves[digits / 16] << 4) | static_cast<uint64_t>(nibble);
+                digits++;
+            }
+            return BluetoothUuid(halves[0], halves[1]);
+        }
+
+        /**
+         * Write the lowercase canonical form and a terminating '\0' into buffer.
+         */
+        constexpr void toChars(char (&buffer)[G_STRING_LENGTH + 1]) const
+        {
+            constexpr const char* hexDigits = "0123456789abcdef";
+            size_t digits = 0;
+            for (size_t i = 0; i < G_STRING_LENGTH; i++) {
+                if ((i == 8) || (i == 13) || (i == 18) || (i == 23)) {
+                    buffer[i] = '-';
+                    continue;
+                }
+                uint64_t half = (digits < 16) ? mHigh : mLow;
+                buffer[i] = hexDigits[(half >> (60 - 4 * (digits % 16))) & 0xF];
+                digits++;
+            }
+            buffer[G_STRING_LENGTH] = '\0';
+        }
+
+        std::string toString() const
+        {
+            char buffer[G_STRING_LENGTH + 1];
+            toChars(buffer);
+            return std::string(buffer, G_STRING_LENGTH);
+        }
+
+        constexpr uint64_t getHigh() const { return mHigh; }
+        constexpr uint64_t getLow() const { return mLow; }
+
+        constexpr bool operator==(const BluetoothUuid& other) const { return (mHigh == other.mHigh) && (mLow == other.mLow); }
+        constexpr bool operator!=(const BluetoothUuid& other) const { return !(*this == other); }
+
+        /**
+         * Seeded 64-bit mix of both halves, also used to build the compile-time profile tables.
+         */
+        constexpr uint64_t hash(uint64_t seed = 0) const
+        {
+            uint64_t value = mHigh ^ ((mLow << 29) | (mLow >> 35)) ^ seed;
+            value ^= value >> 33;
+            value *= 0xff51afd7ed558ccdULL;
+            value ^= value >> 33;
+            value *= 0xc4ceb9fe1a85ec53ULL;
+            value ^= value >> 33;
+            return value ^ mLow;
+        }
+
+    private:
+        static constexpr int hexValue(char c)
+        {
+            if ((c >= '0') && (c <= '9')) {
+                return c - '0';
+            }
+            if ((c >= 'a') && (c <= 'f')) {
+                return c - 'a' + 10;
+            }
+            if ((c >= 'A') && (c <= 'F')) {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        uint64_t mHigh;
+        uint64_t mLow;
+};
+
+namespace std {
+    template<>
+    struct hash<BluetoothUuid>
+    {
+        size_t operator()(const BluetoothUuid& uuid) const
+        {
+            return static_cast<size_t>(uuid.hash());
+        }
+    };
+}
+
+#endif // BLUETOOTH_UUID
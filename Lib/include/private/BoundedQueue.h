@@ -0,0 +1,153 @@
+#ifndef BOUNDED_QUEUE
+#define BOUNDED_QUEUE
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/**
+ * Bounded lock-free multi-producer/multi-consumer ring (Vyukov's sequence-per-cell design).
+ * Cells are allocated once, pushing and popping only move T in and out of them.
+ * T must be default constructible and move assignable.
+ */
+template<typename T>
+class BoundedQueue
+{
+    public:
+        /**
+         * capacity is rounded up to the next power of two.
+         */
+        explicit BoundedQueue(size_t capacity) : mMask(roundUp(capacity) - 1), mEnqueuePos(0), mDequeuePos(0), mDropped(0)
+        {
+            mCells.reset(new Cell[mMask + 1]);
+            for (size_t i = 0; i <= mMask; i++) {
+                mCells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        /**
+         * Move value into the ring, false (value untouched) when full.
+         */
+        bool tryPush(T&& value)
+        {
+            size_t position = mEnqueuePos.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = mCells[position & mMask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (difference == 0) {
+                    if (mEnqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        cell.value = std::move(value);
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0) {
+                    return false;
+                }
+                else {
+                    position = mEnqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /**
+         * Move the oldest entry into value, false when empty.
+         */
+        bool tryPop(T& value)
+        {
+            size_t position = mDequeuePos.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = mCells[position & mMask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+                if (difference == 0) {
+                    if (mDequeuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        value = std::move(cell.value);
+                        cell.sequence.store(position + mMask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0) {
+                    return false;
+                }
+                else {
+                    position = mDequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /**
+         * Backpressure for producers that must not block: discard the oldest entries
+         * until value fits. Every discarded entry is counted in getDropped().
+         */
+        void pushDropOldest(T&& value)
+        {
+            while (!tryPush(std::move(value))) {
+                T discarded;
+                if (tryPop(discarded)) {
+                    mDropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /**
+         * Snapshot only, another thread may push or pop right after.
+         */
+        bool empty() const
+        {
+            return mEnqueuePos.load(std::memory_order_acquire) == mDequeuePos.load(std::memory_order_acquire);
+        }
+
+        /**
+         * Snapshot only like empty(), pushes still in progress may be counted.
+         */
+        size_t size() const
+        {
+            size_t dequeue = mDequeuePos.load(std::memory_order_acquire);
+            size_t enqueue = mEnqueuePos.load(std::memory_order_acquire);
+            return std::min(enqueue - std::min(enqueue, dequeue), capacity());
+        }
+
+        size_t capacity() const
+        {
+            return mMask + 1;
+        }
+
+        uint64_t getDropped() const
+        {
+            return mDropped.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static constexpr size_t G_CACHE_LINE = 64;
+
+        struct alignas(G_CACHE_LINE) Cell
+        {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        static size_t roundUp(size_t capacity)
+        {
+            size_t ret = 2;
+            while (ret < capacity) {
+                ret <<= 1;
+            }
+            return ret;
+        }
+
+        std::unique_ptr<Cell[]> mCells;
+        const size_t mMask;
+        alignas(G_CACHE_LINE) std::atomic<size_t> mEnqueuePos;
+        alignas(G_CACHE_LINE) std::atomic<size_t> mDequeuePos;
+        alignas(G_CACHE_LINE) std::atomic<uint64_t> mDropped;
+};
+
+#endif // BOUNDED_QUEUE
@@ -0,0 +1,482 @@
+#ifndef DBUS_CODEC
+#define DBUS_CODEC
+
+#include "Hash.h"
+#include <dbus/dbus.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Typed reading and writing of DBus messages. DBusType<T> maps a C++ type to its DBus signature at compile time.
+ * decodeMessage() checks a whole message against the signature of its output types with one comparison
+ * and then reads the arguments without further type checks, newMethodCall() marshals typed arguments.
+ * Decoded std::string_view point into the message buffer, valid as long as the message is referenced.
+ */
+
+/**
+ * Fixed-size signature string, concatenated at compile time.
+ */
+template<size_t N>
+struct DBusSignature
+{
+    char value[N + 1] = {};
+
+    constexpr const char* c_str() const
+    {
+        return value;
+    }
+};
+
+template<size_t N>
+constexpr DBusSignature<N - 1> makeSignature(const char (&text)[N])
+{
+    DBusSignature<N - 1> ret;
+    for (size_t i = 0; i < N - 1; i++) {
+        ret.value[i] = text[i];
+    }
+    return ret;
+}
+
+template<size_t A, size_t B>
+constexpr DBusSignature<A + B> operator+(const DBusSignature<A>& left, const DBusSignature<B>& right)
+{
+    DBusSignature<A + B> ret;
+    for (size_t i = 0; i < A; i++) {
+        ret.value[i] = left.value[i];
+    }
+    for (size_t i = 0; i < B; i++) {
+        ret.value[A + i] = right.value[i];
+    }
+    return ret;
+}
+
+/**
+ * Object path, kept apart from std::string_view because its signature differs.
+ */
+struct ObjectPath
+{
+    std::string_view value;
+};
+
+/**
+ * An a{sv} dictionary left in place, walked with forEachProperty().
+ */
+struct PropertyDict
+{
+    DBusMessageIter iter;
+};
+
+/**
+ * A "v" argument holding a T.
+ */
+template<typename T>
+struct DBusVariant
+{
+    T value;
+};
+
+template<typename T>
+struct DBusType;
+
+template<typename T>
+bool readVariant(DBusMessageIter* variant, T& out);
+template<typename T>
+bool readVariant(DBusMessageIter* variant, std::vector<T>& out);
+
+/**
+ * Basic types: read() copies through the libdbus representation, so bool never aliases a dbus_bool_t.
+ */
+template<typename T, typename Wire, int Code, char Letter>
+struct DBusBasicType
+{
+    static constexpr int code = Code;
+
+    static constexpr DBusSignature<1> signature()
+    {
+        DBusSignature<1> ret;
+        ret.value[0] = Letter;
+        return ret;
+    }
+
+    static bool read(DBusMessageIter* iter, T& out)
+    {
+        Wire value = Wire();
+        dbus_message_iter_get_basic(iter, &value);
+        out = static_cast<T>(value);
+        return true;
+    }
+
+    static bool write(DBusMessageIter* iter, const T& value)
+    {
+        Wire wire = static_cast<Wire>(value);
+        return dbus_message_iter_append_basic(iter, Code, &wire);
+    }
+};
+
+template<> struct DBusType<bool> : DBusBasicType<bool, dbus_bool_t, DBUS_TYPE_BOOLEAN, 'b'> {};
+template<> struct DBusType<uint8_t> : DBusBasicType<uint8_t, unsigned char, DBUS_TYPE_BYTE, 'y'> {};
+template<> struct DBusType<int16_t> : DBusBasicType<int16_t, dbus_int16_t, DBUS_TYPE_INT16, 'n'> {};
+template<> struct DBusType<uint16_t> : DBusBasicType<uint16_t, dbus_uint16_t, DBUS_TYPE_UINT16, 'q'> {};
+template<> struct DBusType<int32_t> : DBusBasicType<int32_t, dbus_int32_t, DBUS_TYPE_INT32, 'i'> {};
+template<> struct DBusType<uint32_t> : DBusBasicType<uint32_t, dbus_uint32_t, DBUS_TYPE_UINT32, 'u'> {};
+template<> struct DBusType<int64_t> : DBusBasicType<int64_t, dbus_int64_t, DBUS_TYPE_INT64, 'x'> {};
+template<> struct DBusType<uint64_t> : DBusBasicType<uint64_t, dbus_uint64_t, DBUS_TYPE_UINT64, 't'> {};
+template<> struct DBusType<double> : DBusBasicType<double, double, DBUS_TYPE_DOUBLE, 'd'> {};
+
+template<>
+struct DBusType<std::string_view>
+{
+    static constexpr int code = DBUS_TYPE_STRING;
+
+    static constexpr DBusSignature<1> signature()
+    {
+        return makeSignature("s");
+    }
+
+    static bool read(DBusMessageIter* iter, std::string_view& out)
+    {
+        const char* value = nullptr;
+        dbus_message_iter_get_basic(iter, &value);
+        out = (nullptr != value) ? std::string_view(value) : std::string_view();
+        return true;
+    }
+};
+
+/**
+ * Owning string, for values that outlive the message. Writes need the terminating NUL std::string_view lacks.
+ */
+template<>
+struct DBusType<std::string>
+{
+    static constexpr int code = DBUS_TYPE_STRING;
+
+    static constexpr DBusSignature<1> signature()
+    {
+        return makeSignature("s");
+    }
+
+    static bool read(DBusMessageIter* iter, std::string& out)
+    {
+        std::string_view value;
+        DBusType<std::string_view>::read(iter, value);
+        out.assign(value.data(), value.size());
+        return true;
+    }
+
+    static bool write(DBusMessageIter* iter, const std::string& value)
+    {
+        const char* text = value.c_str();
+        return dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &text);
+    }
+};
+
+template<>
+struct DBusType<const char*>
+{
+    static constexpr int code = DBUS_TYPE_STRING;
+
+    static constexpr DBusSignature<1> signature()
+    {
+        return makeSignature("s");
+    }
+
+    static bool write(DBusMessageIter* iter, const char* value)
+    {
+        return dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &value);
+    }
+};
+
+template<>
+struct DBusType<ObjectPath>
+{
+    static constexpr int code = DBUS_TYPE_OBJECT_PATH;
+
+    static constexpr DBusSignature<1> signature()
+    {
+        return makeSignature("o");
+    }
+
+    static bool read(DBusMessageIter* iter, ObjectPath& out)
+    {
+        return DBusType<std::string_view>::read(iter, out.value);
+    }
+
+    static bool write(DBusMessageIter* iter, const ObjectPath& value)
+    {
+        // Paths are built from NUL-terminated strings, see newMethodCall() callers
+        const char* path = value.value.data();
+        return dbus_message_iter_append_basic(iter, DBUS_TYPE_OBJECT_PATH, &path);
+    }
+};
+
+template<>
+struct DBusType<PropertyDict>
+{
+    static constexpr int code = DBUS_TYPE_ARRAY;
+
+    static constexpr DBusSignature<5> signature()
+    {
+        return makeSignature("a{sv}");
+    }
+
+    static bool read(DBusMessageIter* iter, PropertyDict& out)
+    {
+        out.iter = *iter;
+        return true;
+    }
+};
+
+template<typename T>
+struct DBusType<std::vector<T>>
+{
+    static constexpr int code = DBUS_TYPE_ARRAY;
+
+    static constexpr auto signature()
+    {
+        return makeSignature("a") + DBusType<T>::signature();
+    }
+
+    static bool read(DBusMessageIter* iter, std::vector<T>& out)
+    {
+        DBusMessageIter element;
+        dbus_message_iter_recurse(iter, &element);
+        out.clear();
+        while (dbus_message_iter_get_arg_type(&element) != DBUS_TYPE_INVALID) {
+            T value;
+            DBusType<T>::read(&element, value);
+            out.push_back(value);
+            dbus_message_iter_next(&element);
+        }
+        return true;
+    }
+
+    static bool write(DBusMessageIter* iter, const std::vector<T>& values)
+    {
+        static constexpr auto G_ELEMENT = DBusType<T>::signature();
+        DBusMessageIter array;
+        if (!dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, G_ELEMENT.c_str(), &array)) {
+            return false;
+        }
+        for (const T& value : values) {
+            if (!DBusType<T>::write(&array, value)) {
+                dbus_message_iter_abandon_container(iter, &array);
+                return false;
+            }
+        }
+        return dbus_message_iter_close_container(iter, &array);
+    }
+};
+
+template<typename T>
+struct DBusType<DBusVariant<T>>
+{
+    static constexpr int code = DBUS_TYPE_VARIANT;
+
+    static constexpr DBusSignature<1> signature()
+    {
+        return makeSignature("v");
+    }
+
+    static bool read(DBusMessageIter* iter, DBusVariant<T>& out)
+    {
+        return readVariant(iter, out.value);
+    }
+
+    static bool write(DBusMessageIter* iter, const DBusVariant<T>& value)
+    {
+        static constexpr auto G_CONTENT = DBusType<T>::signature();
+        DBusMessageIter variant;
+        if (!dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, G_CONTENT.c_str(), &variant)) {
+            return false;
+        }
+        if (!DBusType<T>::write(&variant, value.value)) {
+            dbus_message_iter_abandon_container(iter, &variant);
+            return false;
+        }
+        return dbus_message_iter_close_container(iter, &variant);
+    }
+};
+
+template<typename... Ts>
+constexpr auto messageSignature()
+{
+    return (DBusSignature<0>() + ... + DBusType<Ts>::signature());
+}
+
+/**
+ * Read the arguments of message into out, false without touching out when the
+ * message signature is not exactly that of Ts.
+ */
+template<typename... Ts>
+bool decodeMessage(DBusMessage* message, Ts&... out)
+{
+    static constexpr auto signature = messageSignature<Ts...>();
+    if (!dbus_message_has_signature(message, signature.c_str())) {
+        return false;
+    }
+
+    DBusMessageIter iter;
+    dbus_message_iter_init(message, &iter);
+    bool ret = true;
+    ((ret = ret && DBusType<Ts>::read(&iter, out), dbus_message_iter_next(&iter)), ...);
+    return ret;
+}
+
+/**
+ * Read a variant holding a T (a basic type or an array of one), false when it holds anything else.
+ */
+template<typename T>
+bool readVariant(DBusMessageIter* variant, T& out)
+{
+    DBusMessageIter value;
+    dbus_message_iter_recurse(variant, &value);
+    if (dbus_message_iter_get_arg_type(&value) != DBusType<T>::code) {
+        return false;
+    }
+    return DBusType<T>::read(&value, out);
+}
+
+template<typename T>
+bool readVariant(DBusMessageIter* variant, std::vector<T>& out)
+{
+    DBusMessageIter value;
+    dbus_message_iter_recurse(variant, &value);
+    if ((dbus_message_iter_get_arg_type(&value) != DBUS_TYPE_ARRAY) || (dbus_message_iter_get_element_type(&value) != DBusType<T>::code)) {
+        return false;
+    }
+    return DBusType<std::vector<T>>::read(&value, out);
+}
+
+/**
+ * FNV-1a of a property name, meant for switch case labels: duplicate keys fail to compile.
+ */
+constexpr uint64_t propertyKey(std::string_view name)
+{
+    return fnv1a(name);
+}
+
+/**
+ * Call visitor(name, variant) for each entry of the a{sv} dictionary properties points at.
+ * Keys are not copied, visitors switch on propertyKey(name) and read the value with readVariant(),
+ * whose type check also rejects a key that merely collides with a known one.
+ */
+template<typename Visitor>
+void forEachProperty(DBusMessageIter* properties, Visitor&& visitor)
+{
+    if ((dbus_message_iter_get_arg_type(properties) != DBUS_TYPE_ARRAY) || (dbus_message_iter_get_element_type(properties) != DBUS_TYPE_DICT_ENTRY)) {
+        return;
+    }
+
+    DBusMessageIter dict;
+    dbus_message_iter_recurse(properties, &dict);
+    while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter entry;
+        const char* name = nullptr;
+        dbus_message_iter_recurse(&dict, &entry);
+        dbus_message_iter_get_basic(&entry, &name);
+        dbus_message_iter_next(&entry);
+        if (dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_VARIANT) {
+            visitor(std::string_view(name), &entry);
+        }
+        dbus_message_iter_next(&dict);
+    }
+}
+
+template<typename Visitor>
+void forEachProperty(PropertyDict& properties, Visitor&& visitor)
+{
+    forEachProperty(&properties.iter, std::forward<Visitor>(visitor));
+}
+/**
+ * Append a name -> variant entry to the a{sv} container dict, for dictionaries whose keys are picked at runtime.
+ */
+template<typename T>
+bool appendProperty(DBusMessageIter* dict, const char* name, const T& value)
+{
+    DBusMessageIter entry;
+    if (!dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, nullptr, &entry)) {
+        return false;
+    }
+    if (!DBusType<const char*>::write(&entry, name) || !DBusType<DBusVariant<T>>::write(&entry, DBusVariant<T>{value})) {
+        dbus_message_iter_abandon_container(dict, &entry);
+        return false;
+    }
+    return dbus_message_iter_close_container(dict, &entry);
+}
+
+/**
+ * Type an argument is marshalled as: character arrays and pointers are strings.
+ */
+template<typename T>
+using DBusArgType = std::conditional_t<std::is_array_v<T> || std::is_same_v<std::decay_t<T>, char*>, const char*, std::decay_t<T>>;
+
+/**
+ * Append args to message in order, false when libdbus runs out of memory.
+ */
+template<typename... Args>
+bool appendMessage(DBusMessage* message, const Args&... args)
+{
+    DBusMessageIter iter;
+    dbus_message_iter_init_append(message, &iter);
+    bool ret = true;
+    ((ret = ret && DBusType<DBusArgType<Args>>::write(&iter, args)), ...);
+    return ret;
+}
+
+/**
+ * Method call carrying args, whose signature (messageSignature<DBusArgType<Args>...>()) is fixed
+ * at compile time. nullptr when out of memory.
+ */
+template<typename... Args>
+DBusMessage* newMethodCall(const char* service, const char* path, const char* interface, const char* member, const Args&... args)
+{
+    DBusMessage* ret = dbus_message_new_method_call(service, path, interface, member);
+    if ((nullptr != ret) && !appendMessage(ret, args...)) {
+        dbus_message_unref(ret);
+        ret = nullptr;
+    }
+    return ret;
+}
+
+/**
+ * A request whose arguments never change, marshalled once. instantiate() hands out copies:
+ * dbus_message_copy duplicates the serialized header and body without re-marshalling, and each copy
+ * gets its own serial when sent.
+ */
+class DBusMessageTemplate
+{
+    public:
+        template<typename... Args>
+        DBusMessageTemplate(const char* service, const char* path, const char* interface, const char* member, const Args&... args)
+            : mMessage(newMethodCall(service, path, interface, member, args...))
+        {
+        }
+
+        ~DBusMessageTemplate()
+        {
+            if (nullptr != mMessage) {
+                dbus_message_unref(mMessage);
+            }
+        }
+
+        DBusMessageTemplate(const DBusMessageTemplate&) = delete;
+        DBusMessageTemplate& operator=(const DBusMessageTemplate&) = delete;
+
+        /**
+         * New reference the caller unrefs, nullptr when out of memory.
+         */
+        DBusMessage* instantiate() const
+        {
+            return (nullptr != mMessage) ? dbus_message_copy(mMessage) : nullptr;
+        }
+
+    private:
+        DBusMessage* mMessage;
+};
+
+#endif // DBUS_CODEC
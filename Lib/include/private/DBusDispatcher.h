@@ -0,0 +1,97 @@
+#ifndef DBUS_DISPATCHER
+#define DBUS_DISPATCHER
+
+#include <dbus/dbus.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Routes the signals of one connection to subscribers.
+ * A single connection filter looks subscribers up by (interface, member) in a hash index,
+ * then checks sender and path, so the per-message cost does not grow with unrelated subscriptions.
+ * The table is copy-on-write: dispatch only loads a snapshot, subscribe/unsubscribe swap a new one.
+ * Handlers run on the thread driving the connection's DBusReactor.
+ */
+class DBusDispatcher
+{
+    public:
+        using Handler = std::function<void(DBusMessage* message)>;
+
+        /**
+         * Blocking method call with the contract of dbus_connection_send_with_reply_and_block(),
+         * used to resolve well-known names. The owner bounds and accounts for it.
+         */
+        using Caller = std::function<DBusMessage*(DBusMessage* message, DBusError* error)>;
+
+        /**
+         * nullptr fields are wildcards. sender may be a well-known name, it is resolved to
+         * its unique owner and followed through NameOwnerChanged.
+         */
+        struct MatchRule
+        {
+            const char* sender = nullptr;
+            const char* path = nullptr;
+            const char* interface = nullptr;
+            const char* member = nullptr;
+        };
+
+        DBusDispatcher(DBusConnection* connection, Caller caller);
+        ~DBusDispatcher();
+
+        DBusDispatcher(const DBusDispatcher&) = delete;
+        DBusDispatcher& operator=(const DBusDispatcher&) = delete;
+
+        /**
+         * Add the bus match rule and route matching signals to handler, returns the id for unsubscribe().
+         */
+        uint64_t subscribe(const MatchRule& rule, Handler handler);
+        void unsubscribe(uint64_t id);
+        size_t getSubscriptionCount() const;
+
+    private:
+        struct Subscription
+        {
+            uint64_t id;
+            std::string sender;
+            std::string owner; // Unique name currently owning sender, empty while nobody does
+            std::string path;
+            std::string interface;
+            std::string member;
+            std::string matchRule;
+            Handler handler;
+        };
+
+        struct Table
+        {
+            std::vector<Subscription> subscriptions;
+            std::unordered_map<uint64_t, std::vector<size_t>> index; // hashKey(interface, member) -> subscriptions
+            std::vector<size_t> wildcards; // Subscriptions without interface or member
+        };
+
+        static DBusHandlerResult messageFilter(DBusConnection* connection, DBusMessage* message, void* data);
+        static uint64_t hashKey(const char* interface, const char* member);
+        static bool matches(const Subscription& subscription, DBusMessage* message);
+        static std::string buildMatchRule(const MatchRule& rule);
+        static void rebuildIndex(Table& table);
+
+        void dispatch(DBusMessage* message);
+        void handleNameOwnerChanged(DBusMessage* message);
+        std::string resolveOwner(const std::string& name);
+        void watchName(const std::string& name);
+        void unwatchName(const std::string& name);
+
+        DBusConnection* mConnection;
+        Caller mCaller;
+        std::shared_ptr<const Table> mTable;
+        std::mutex mMutex; // Serializes writers, dispatch only std::atomic_load mTable
+        std::unordered_map<std::string, size_t> mWatchedNames;
+        uint64_t mNextId;
+};
+
+#endif // DBUS_DISPATCHER
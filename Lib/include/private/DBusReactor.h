@@ -0,0 +1,113 @@
+#ifndef DBUS_REACTOR
+#define DBUS_REACTOR
+
+#include <dbus/dbus.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Event loop for a single DBusConnection.
+ * The connection's watches and timeouts are registered on an epoll instance,
+ * an eventfd wakes the loop up whenever libdbus queues messages from another
+ * thread (e.g. while a blocking call is reading the socket).
+ * Messages are delivered through dbus_connection_dispatch, so filters and
+ * pending-call notifications run on the thread calling iterate(), as do timers set with schedule().
+ */
+class DBusReactor
+{
+    public:
+        explicit DBusReactor(DBusConnection* connection);
+        ~DBusReactor();
+
+        DBusReactor(const DBusReactor&) = delete;
+        DBusReactor& operator=(const DBusReactor&) = delete;
+
+        /**
+         * Wait until the connection has work (or timeoutMs elapsed, -1 waits forever),
+         * handle ready watches and expired timeouts, then dispatch every queued message.
+         */
+        void iterate(int timeoutMs = -1);
+        void wakeup();
+
+        /**
+         * Ask the thread looping on iterate() to leave, from any thread. Timers still pending never run.
+         */
+        void stop();
+        bool isStopped() const;
+        DBusConnection* getConnection() const;
+
+        /**
+         * Whether the caller is the thread running iterate(). Dropping the last reference of an
+         * in-flight DBusPendingCall frees its DBusTimeout, only that thread may do so.
+         */
+        bool isReactorThread() const;
+
+        /**
+         * Run callback once from iterate() when delay has passed, from any thread.
+         * Timers are few and short-lived, they are kept in a plain vector.
+         */
+        void schedule(std::chrono::steady_clock::duration delay, std::function<void()> callback);
+
+        /**
+         * queueDepth is the number of messages found queued by the latest iterate(),
+         * outgoingBytes what libdbus still holds for sending.
+         */
+        struct Metrics
+        {
+            uint64_t dispatched;
+            uint32_t queueDepth;
+            uint32_t maxQueueDepth;
+            long outgoingBytes;
+        };
+
+        Metrics getMetrics() const;
+
+    private:
+        struct TimeoutEntry
+        {
+            DBusTimeout* timeout;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        struct TimerEntry
+        {
+            std::chrono::steady_clock::time_point deadline;
+            std::function<void()> callback;
+        };
+
+        static dbus_bool_t addWatch(DBusWatch* watch, void* data);
+        static void removeWatch(DBusWatch* watch, void* data);
+        static void toggleWatch(DBusWatch* watch, void* data);
+        static dbus_bool_t addTimeout(DBusTimeout* timeout, void* data);
+        static void removeTimeout(DBusTimeout* timeout, void* data);
+        static void toggleTimeout(DBusTimeout* timeout, void* data);
+        static void dispatchStatusChanged(DBusConnection* connection, DBusDispatchStatus status, void* data);
+        static void wakeupMain(void* data);
+
+        bool updateEpoll(int fd);
+        int nextTimeout(int timeoutMs);
+        void handleWatches(int fd, uint32_t events);
+        void handleTimeouts();
+        void handleTimers();
+
+        DBusConnection* mConnection;
+        int mEpollFd;
+        int mEventFd;
+        std::mutex mMutex;
+        std::unordered_map<int, std::vector<DBusWatch*>> mWatches;
+        std::vector<TimeoutEntry> mTimeouts;
+        std::vector<TimerEntry> mTimers;
+        std::atomic<std::thread::id> mThread;
+        std::atomic<bool> mStopped;
+        std::atomic<uint64_t> mDispatched;
+        std::atomic<uint32_t> mQueueDepth;
+        std::atomic<uint32_t> mMaxQueueDepth;
+};
+
+#endif // DBUS_REACTOR
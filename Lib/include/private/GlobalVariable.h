@@ -1,5 +1,7 @@
 #ifndef GLOBAL_VARIABLE
 #define GLOBAL_VARIABLE
+#include <cstddef>
+#include <cstdint>
     enum class Status
     {
         Unpaired,
@@ -15,9 +17,17 @@
     static constexpr const char* G_METHOD_START_DISCOVERY = "StartDiscovery";
     static constexpr const char* G_METHOD_GET_ADDRESS = "Address";
     static constexpr const char* G_METHOD_STOP_DISCOVERY = "StopDiscovery";
+    static constexpr const char* G_METHOD_SET_DISCOVERY_FILTER = "SetDiscoveryFilter";
     static constexpr const char* G_ALIAS = "Alias";
+    static constexpr const char* G_PROP_DISCOVERING = "Discovering";
+    static constexpr const char* G_METHOD_CONNECT_PROFILE = "ConnectProfile";
+    static constexpr const char* G_METHOD_DISCONNECT_PROFILE = "DisconnectProfile";
+    static constexpr const char* G_METHOD_DISCONNECT = "Disconnect";
 
     static constexpr const char* G_INTERFACE_DBUS_PROP = "org.freedesktop.DBus.Properties";
+    static constexpr const char* G_INTERFACE_OBJECT_MANAGER = "org.freedesktop.DBus.ObjectManager";
+    static constexpr const char* G_SIGNAL_INTERFACES_ADDED = "InterfacesAdded";
+    static constexpr const char* G_SIGNAL_INTERFACES_REMOVED = "InterfacesRemoved";
     static constexpr const char* G_METHOD_GET = "Get";
     static constexpr const char* G_METHOD_GET_ALL = "GetAll";
     static constexpr const char* G_METHOD_SET = "Set";
@@ -27,10 +37,15 @@
     static constexpr const char* G_NM_DBUS_INTERFACE = "org.freedesktop.NetworkManager";
     static constexpr const char* G_SIGNAL_PROPERTIES_CHANGED = "PropertiesChanged";
     static constexpr const char* G_METHOD_WIRELESS_ENABLED = "WirelessEnabled";
+    static constexpr const char* G_PROP_WIRELESS_HARDWARE_ENABLED = "WirelessHardwareEnabled";
+    static constexpr const char* G_PROP_STATE = "State";
+    static constexpr const char* G_PROP_CONNECTIVITY = "Connectivity";
+    static constexpr int16_t G_RSSI_UNKNOWN = INT16_MIN;
+    static constexpr size_t G_DEVICE_INFO_QUEUE_CAPACITY = 256;
+    static constexpr size_t G_DEVICE_TABLE_SHARDS = 64;
 
-    inline std::ostream& operator<<(std::ostream& strm, const Status& value)
+    inline const char* statusName(const Status& value)
     {
-        std::ostream *ptr = &strm;
         static const char *valueTbl[] = {
             "Unpaired",
             "Disconnected",
@@ -38,12 +53,14 @@
         };
 
         if (static_cast<uint8_t>(value) < 3) {
-            strm << valueTbl[static_cast<uint8_t>(value)];
-        }
-        else {
-            strm << "unknown";
+            return valueTbl[static_cast<uint8_t>(value)];
         }
-        return *ptr;
+        return "unknown";
+    }
+
+    inline std::ostream& operator<<(std::ostream& strm, const Status& value)
+    {
+        return strm << statusName(value);
     }
 
 #endif
\ No newline at end of file
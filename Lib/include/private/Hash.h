@@ -0,0 +1,35 @@
+#ifndef HASH
+#define HASH
+
+#include <cstdint>
+#include <string_view>
+
+static constexpr uint64_t G_FNV1A_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+static constexpr uint64_t G_FNV1A_PRIME = 0x100000001b3ULL;
+
+/**
+ * 64-bit FNV-1a of data. Passing a previous result as seed continues the hash over a concatenation.
+ */
+constexpr uint64_t fnv1a(std::string_view data, uint64_t seed = G_FNV1A_OFFSET_BASIS)
+{
+    uint64_t ret = seed;
+    for (char c : data) {
+        ret = (ret ^ static_cast<uint8_t>(c)) * G_FNV1A_PRIME;
+    }
+    return ret;
+}
+
+/**
+ * fnv1a() over fold(c) instead of each byte c, e.g. to hash case-insensitively.
+ */
+template<typename Fold>
+constexpr uint64_t fnv1a(std::string_view data, uint64_t seed, Fold fold)
+{
+    uint64_t ret = seed;
+    for (char c : data) {
+        ret = (ret ^ static_cast<uint8_t>(fold(c))) * G_FNV1A_PRIME;
+    }
+    return ret;
+}
+
+#endif // HASH
@@ -0,0 +1,192 @@
+#ifndef NETWORK_LOGGER
+#define NETWORK_LOGGER
+
+#include "BoundedQueue.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel : uint8_t
+{
+    Trace,
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+/**
+ * Lowest level compiled in, set by the NETWORK_LOG_LEVEL cache variable.
+ * Statements below it are discarded at compile time, arguments included.
+ */
+#ifndef NETWORK_LOG_LEVEL
+#define NETWORK_LOG_LEVEL 2
+#endif
+
+static constexpr LogLevel G_LOG_COMPILED_LEVEL = static_cast<LogLevel>(NETWORK_LOG_LEVEL);
+static constexpr size_t G_LOG_TEXT_SIZE = 488;
+static constexpr size_t G_LOG_RING_CAPACITY = 256;
+
+/**
+ * One formatted line, copied whole through the per-thread ring.
+ * timestamp is system_clock nanoseconds, thread a small id handed out per logging thread.
+ */
+struct LogRecord
+{
+    int64_t timestamp = 0;
+    uint32_t thread = 0;
+    uint16_t length = 0;
+    LogLevel level = LogLevel::Info;
+    char text[G_LOG_TEXT_SIZE];
+};
+
+/**
+ * " key=value" pair of a structured record, see logField().
+ */
+template<typename T>
+struct LogField
+{
+    const char* key;
+    const T& value;
+};
+
+template<typename T>
+LogField<T> logField(const char* key, const T& value)
+{
+    return LogField<T>{key, value};
+}
+
+/**
+ * Formats one record into a stack buffer and hands it to the Logger when destroyed.
+ * Text past G_LOG_TEXT_SIZE is cut off.
+ */
+class LogLine
+{
+    public:
+        explicit LogLine(LogLevel level);
+        ~LogLine();
+
+        LogLine(const LogLine&) = delete;
+        LogLine& operator=(const LogLine&) = delete;
+
+        LogLine& operator<<(std::string_view value);
+        LogLine& operator<<(const char* value);
+        LogLine& operator<<(const std::string& value);
+        LogLine& operator<<(char value);
+        LogLine& operator<<(bool value);
+        LogLine& operator<<(double value);
+        LogLine& operator<<(long long value);
+        LogLine& operator<<(unsigned long long value);
+
+        template<typename T, std::enable_if_t<std::is_integral_v<T> && std::is_signed_v<T>, int> = 0>
+        LogLine& operator<<(T value)
+        {
+            return *this << static_cast<long long>(value);
+        }
+
+        template<typename T, std::enable_if_t<std::is_integral_v<T> && std::is_unsigned_v<T>, int> = 0>
+        LogLine& operator<<(T value)
+        {
+            return *this << static_cast<unsigned long long>(value);
+        }
+
+        /**
+         * Types with a toString() member, e.g. BluetoothUuid.
+         */
+        template<typename T>
+        auto operator<<(const T& value) -> decltype(value.toString(), *this)
+        {
+            return *this << value.toString();
+        }
+
+        template<typename T>
+        LogLine& operator<<(const LogField<T>& field)
+        {
+            *this << ' ' << field.key << '=';
+            return *this << field.value;
+        }
+
+    private:
+        LogRecord mRecord;
+};
+
+/**
+ * Leveled logger kept off the DBus threads: a LogLine is formatted on the calling thread and pushed into
+ * that thread's lock-free ring, one background thread drains every ring, orders the batch by time and
+ * writes it with a single fwrite per stream (Info and below to stdout, Warn and above to stderr).
+ * A full ring drops the new record, the count is reported with the next batch.
+ */
+class Logger
+{
+    public:
+        static Logger& getInstance();
+
+        static bool isEnabled(LogLevel level)
+        {
+            return (level >= G_LOG_COMPILED_LEVEL) && (level >= mLevel.load(std::memory_order_relaxed));
+        }
+
+        /**
+         * Raise the level at runtime, levels below G_LOG_COMPILED_LEVEL stay compiled out.
+         */
+        static void setLevel(LogLevel level);
+
+        void submit(LogRecord&& record);
+
+        /**
+         * Write out everything submitted so far from the calling thread.
+         */
+        void flush();
+
+        uint64_t getDropped() const;
+
+    private:
+        struct Ring
+        {
+            Ring(uint32_t id) : id(id), records(G_LOG_RING_CAPACITY) {}
+
+            const uint32_t id;
+            BoundedQueue<LogRecord> records;
+        };
+
+        Logger();
+        ~Logger() = delete;
+
+        Ring& localRing();
+        void flushHandler();
+        void drain();
+
+        inline static std::atomic<LogLevel> mLevel{G_LOG_COMPILED_LEVEL};
+
+        std::mutex mRingsMutex;
+        std::vector<std::shared_ptr<Ring>> mRings;
+        uint32_t mNextThread = 1;
+        std::mutex mDrainMutex; // One drain at a time, keeps batches in order
+        std::vector<LogRecord> mBatch;
+        std::string mOut;
+        std::string mErr;
+        std::mutex mWakeMutex;
+        std::condition_variable mWake;
+        std::atomic<uint64_t> mDropped;
+        uint64_t mReportedDropped = 0;
+        std::thread mFlushThread;
+};
+
+/**
+ * NETWORK_LOG(Debug) << "Device found" << logField("address", address);
+ * Nothing right of the macro is evaluated when the level is disabled, below G_LOG_COMPILED_LEVEL no code is generated for it.
+ */
+#define NETWORK_LOG(level)                                             \
+    if constexpr (LogLevel::level < G_LOG_COMPILED_LEVEL) {}           \
+    else if (!Logger::isEnabled(LogLevel::level)) {}                   \
+    else LogLine(LogLevel::level)
+
+#endif // NETWORK_LOGGER
@@ -0,0 +1,59 @@
+#ifndef NETWORK_CALL
+#define NETWORK_CALL
+
+#include "NetworkProvider.h"
+#include "DBusCodec.h"
+#include "Logger.h"
+
+template<typename R, typename... Args>
+NetworkProvider::CallResult<R> NetworkProvider::call(const CallOptions& options, const char* service, const char* path, const char* interface, const char* member, const Args&... args)
+{
+    DBusMessage* messageSend = newMethodCall(service, path, interface, member, args...);
+    if (nullptr == messageSend) {
+        NETWORK_LOG(Error) << "call but out of memory" << logField("member", member);
+        return CallResult<R>();
+    }
+    CallResult<R> ret = call<R>(messageSend, options);
+    dbus_message_unref(messageSend);
+    return ret;
+}
+
+template<typename R, typename... Args>
+NetworkProvider::CallResult<R> NetworkProvider::call(const char* service, const char* path, const char* interface, const char* member, const Args&... args)
+{
+    return call<R>(CallOptions(), service, path, interface, member, args...);
+}
+
+/**
+ * Send a prebuilt request, typically a DBusMessageTemplate instance, and decode the reply as R.
+ */
+template<typename R>
+NetworkProvider::CallResult<R> NetworkProvider::call(DBusMessage* messageSend, const CallOptions& options)
+{
+    CallResult<R> ret = CallResult<R>();
+    DBusError error;
+    dbus_error_init(&error);
+    DBusMessage* messageReply = sendWithReplyAndBlock(messageSend, &error, options);
+    if (dbus_error_is_set(&error)) {
+        NETWORK_LOG(Warn) << "Error in reply" << logField("member", dbus_message_get_member(messageSend)) << logField("error", error.message);
+        dbus_error_free(&error);
+        return ret;
+    }
+
+    if constexpr (std::is_void_v<R>) {
+        ret = true;
+    }
+    else {
+        R value = R();
+        if (decodeMessage(messageReply, value)) {
+            ret = std::move(value);
+        }
+        else {
+            NETWORK_LOG(Warn) << "Unexpected reply signature" << logField("member", dbus_message_get_member(messageSend)) << logField("signature", dbus_message_get_signature(messageReply));
+        }
+    }
+    dbus_message_unref(messageReply);
+    return ret;
+}
+
+#endif // NETWORK_CALL
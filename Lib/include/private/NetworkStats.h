@@ -0,0 +1,135 @@
+#ifndef NETWORK_STATS
+#define NETWORK_STATS
+
+#include <dbus/dbus.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "NetworkProvider.h"
+
+static constexpr size_t G_HISTOGRAM_SUB_BUCKET_BITS = 4;
+static constexpr size_t G_HISTOGRAM_SUB_BUCKETS = size_t(1) << G_HISTOGRAM_SUB_BUCKET_BITS;
+static constexpr size_t G_HISTOGRAM_MAX_EXPONENT = 35; // Values are clamped below 2^36 us, about 19 hours
+static constexpr size_t G_HISTOGRAM_BUCKETS = (G_HISTOGRAM_MAX_EXPONENT - G_HISTOGRAM_SUB_BUCKET_BITS + 2) * G_HISTOGRAM_SUB_BUCKETS;
+
+/**
+ * Log-linear histogram of microsecond values, the layout HdrHistogram uses with one significant
+ * binary digit group: every power of two is split in G_HISTOGRAM_SUB_BUCKETS linear buckets, so a
+ * reported value is never more than 1/16 above the recorded one. Recording is a handful of relaxed
+ * atomic adds, readers may see a sample counted in one field and not yet in another.
+ */
+class LatencyHistogram
+{
+    public:
+        LatencyHistogram();
+
+        LatencyHistogram(const LatencyHistogram&) = delete;
+        LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+        void record(uint64_t microseconds);
+        uint64_t getCount() const;
+        uint64_t getSum() const;
+        uint64_t getMax() const;
+
+        /**
+         * Highest value equivalent to the sample at quantile (0..1), 0 when empty.
+         */
+        uint64_t valueAtQuantile(double quantile) const;
+
+    private:
+        static size_t bucketIndex(uint64_t value);
+        static uint64_t bucketUpperBound(size_t index);
+
+        std::array<std::atomic<uint64_t>, G_HISTOGRAM_BUCKETS> mBuckets;
+        std::atomic<uint64_t> mCount;
+        std::atomic<uint64_t> mSum;
+        std::atomic<uint64_t> mMax;
+};
+
+/**
+ * Outcomes of one interface.member, from send to completion with retries included.
+ * Only calls that got a reply (errors included) are part of the histogram.
+ */
+struct MethodCounters
+{
+    explicit MethodCounters(std::string name) : name(std::move(name)) {}
+
+    /**
+     * reply nullptr is a call cancelled or never sent.
+     */
+    void record(std::chrono::steady_clock::time_point start, DBusMessage* reply);
+
+    const std::string name;
+    LatencyHistogram latency;
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> timeouts{0};
+    std::atomic<uint64_t> failed{0};
+};
+
+struct SignalCounters
+{
+    explicit SignalCounters(std::string name) : name(std::move(name)) {}
+
+    const std::string name;
+    std::atomic<uint64_t> received{0};
+};
+
+/**
+ * Library-wide metrics behind NetworkProvider::getStats().
+ * Counters are found by FNV-1a of (interface, member) in a copy-on-write table: the hot path only
+ * loads a snapshot, the first sighting of a name copies the table with one more entry.
+ * Entries are never removed, pointers handed out stay valid for the lifetime of NetworkStats.
+ */
+class NetworkStats
+{
+    public:
+        NetworkStats();
+
+        NetworkStats(const NetworkStats&) = delete;
+        NetworkStats& operator=(const NetworkStats&) = delete;
+
+        /**
+         * Counters of the method called by message, created on first use.
+         */
+        MethodCounters* getMethod(DBusMessage* message);
+        void recordSignal(DBusMessage* message);
+
+        /**
+         * One DeviceInfo pushed to the discovery queue, depth counted right after the push.
+         */
+        void recordDeviceInfoQueued(size_t depth);
+
+        /**
+         * Fill methods, signals, deviceInfosQueued and maxDeviceInfosQueueDepth of stats.
+         */
+        void snapshot(NetworkProvider::Stats& stats) const;
+
+        static std::string toJson(const NetworkProvider::Stats& stats);
+
+    private:
+        template<typename Entry>
+        struct Table
+        {
+            std::unordered_map<uint64_t, std::vector<std::shared_ptr<Entry>>> entries;
+        };
+
+        template<typename Entry>
+        static Entry* lookup(const Table<Entry>& table, uint64_t key, const char* interface, const char* member);
+        template<typename Entry>
+        static Entry* find(std::shared_ptr<const Table<Entry>>& table, std::mutex& mutex, DBusMessage* message);
+        static uint64_t hashKey(const char* interface, const char* member);
+
+        std::shared_ptr<const Table<MethodCounters>> mMethods;
+        std::shared_ptr<const Table<SignalCounters>> mSignals;
+        mutable std::mutex mMutex; // Serializes writers of both tables, readers only std::atomic_load
+        std::atomic<uint64_t> mDeviceInfosQueued;
+        std::atomic<uint32_t> mMaxDeviceInfosQueueDepth;
+};
+
+#endif // NETWORK_STATS
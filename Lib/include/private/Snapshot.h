@@ -0,0 +1,145 @@
+#ifndef SNAPSHOT
+#define SNAPSHOT
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * Immutable T published by a writer and read without locks.
+ * std::atomic_load of a shared_ptr takes one of libstdc++'s pooled mutexes and bumps a shared
+ * reference count, so read() takes no reference at all: for the length of the visit the reader
+ * announces the value it uses in a slot of its own, and publish() only frees a replaced value once
+ * no slot names it. Nothing is held between reads, an idle thread never keeps a value alive.
+ * Writers must be serialized by the caller.
+ */
+template<typename T>
+class Snapshot
+{
+    public:
+        explicit Snapshot(std::shared_ptr<const T> value) : mValue(std::move(value)), mCurrent(mValue.get())
+        {
+        }
+
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        /**
+         * Call visitor(const T&) on the current value and return its result.
+         * visitor must not read any Snapshot<T> itself, and must copy out what it keeps.
+         */
+        template<typename Visitor>
+        auto read(Visitor&& visitor) const
+        {
+            Guard guard(mCurrent);
+            return visitor(*guard.value);
+        }
+
+        /**
+         * Shared copy for readers that keep the snapshot across other reads.
+         */
+        std::shared_ptr<const T> get() const
+        {
+            return std::atomic_load(&mValue);
+        }
+
+        void publish(std::shared_ptr<const T> value)
+        {
+            mCurrent.store(value.get(), std::memory_order_seq_cst);
+            mRetired.push_back(std::atomic_exchange(&mValue, std::shared_ptr<const T>(std::move(value))));
+
+            // Pairs with the seq_cst store of Guard: a reader not seen here already sees the new value
+            mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(), [](const std::shared_ptr<const T>& retired) {
+                return !Slot::isAnnounced(retired.get());
+            }), mRetired.end());
+        }
+
+    private:
+        /**
+         * Announcement of one thread, shared by every Snapshot<T>. Slots outlive their threads
+         * and are reused, so there are never more than the peak number of reading threads.
+         */
+        struct Slot
+        {
+            std::atomic<const T*> value{nullptr};
+            std::atomic<bool> used{true};
+            Slot* next = nullptr;
+
+            static Slot* acquire()
+            {
+                for (Slot* slot = sSlots.load(std::memory_order_acquire); nullptr != slot; slot = slot->next) {
+                    bool used = false;
+                    if (!slot->used.load(std::memory_order_relaxed) && slot->used.compare_exchange_strong(used, true)) {
+                        return slot;
+                    }
+                }
+                Slot* slot = new Slot();
+                slot->next = sSlots.load(std::memory_order_relaxed);
+                while (!sSlots.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed)) {
+                }
+                return slot;
+            }
+
+            static bool isAnnounced(const T* value)
+            {
+                for (Slot* slot = sSlots.load(std::memory_order_acquire); nullptr != slot; slot = slot->next) {
+                    if (slot->value.load(std::memory_order_seq_cst) == value) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            static inline std::atomic<Slot*> sSlots{nullptr};
+        };
+
+        /**
+         * Hands the thread's slot back when the thread exits.
+         */
+        struct Owner
+        {
+            Slot* slot = Slot::acquire();
+
+            ~Owner()
+            {
+                slot->used.store(false, std::memory_order_release);
+            }
+        };
+
+        /**
+         * Announces the current value for its lifetime. Re-reads until the announced value is
+         * still current, past that point publish() sees the announcement before freeing it.
+         */
+        struct Guard
+        {
+            explicit Guard(const std::atomic<const T*>& current) : slot(tOwner.slot), value(current.load(std::memory_order_acquire))
+            {
+                while (true) {
+                    slot->value.store(value, std::memory_order_seq_cst);
+                    const T* reloaded = current.load(std::memory_order_seq_cst);
+                    if (reloaded == value) {
+                        break;
+                    }
+                    value = reloaded;
+                }
+            }
+
+            ~Guard()
+            {
+                slot->value.store(nullptr, std::memory_order_release);
+            }
+
+            Slot* slot;
+            const T* value;
+        };
+
+        static inline thread_local Owner tOwner;
+
+        std::shared_ptr<const T> mValue;
+        std::atomic<const T*> mCurrent;
+        std::vector<std::shared_ptr<const T>> mRetired; // Replaced values a reader may still be visiting
+};
+
+#endif // SNAPSHOT
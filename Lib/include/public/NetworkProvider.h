@@ -6,6 +6,78 @@
 #include <string>
 #include <thread>
 #include <functional>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <chrono>
+#include <utility>
+
+class DBusReactor;
+class DBusDispatcher;
+class NetworkStats;
+
+/**
+ * Shared between a caller and the calls it may abort. cancel() cancels the DBusPendingCall of every
+ * call still waiting, their completion runs right away with a failure on the cancelling thread.
+ */
+class CancelToken
+{
+    public:
+        CancelToken() = default;
+        CancelToken(const CancelToken&) = delete;
+        CancelToken& operator=(const CancelToken&) = delete;
+
+        void cancel();
+        bool isCancelled() const;
+
+        /**
+         * Run callback on cancel(), returns 0 without keeping it when already cancelled.
+         * A call attaches its cancel path while in flight and detaches it once completed.
+         */
+        uint64_t attach(std::function<void()> callback);
+        void detach(uint64_t id);
+
+    private:
+        mutable std::mutex mMutex;
+        bool mCancelled = false;
+        uint64_t mNextId = 1;
+        std::vector<std::pair<uint64_t, std::function<void()>>> mCallbacks;
+};
+
+/**
+ * Per-operation limits. The default waits as long as libdbus does (25 seconds) and never retries.
+ */
+struct CallOptions
+{
+    /**
+     * Bounds the whole operation, retries included. Once passed the call completes with DBUS_ERROR_TIMEOUT.
+     */
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    /**
+     * Timeout of a single attempt in milliseconds, -1 for the libdbus default. Always clamped to deadline.
+     */
+    int attemptTimeout = -1;
+
+    /**
+     * Attempts resent after a NoReply or Timeout error while deadline allows.
+     */
+    int retries = 0;
+
+    std::shared_ptr<CancelToken> cancelToken;
+
+    static CallOptions withTimeout(std::chrono::milliseconds timeout)
+    {
+        CallOptions ret;
+        ret.deadline = std::chrono::steady_clock::now() + timeout;
+        return ret;
+    }
+};
 
 class NetworkProvider
 {
@@ -18,37 +90,287 @@ class NetworkProvider
             Bluetooth
         };
 
+        struct Options
+        {
+            /**
+             * Use dbus_bus_get_private connections: one for signal ingest and one for
+             * method calls, each drained by its own thread, instead of the shared system bus connection.
+             */
+            bool privateConnections = false;
+
+            /**
+             * Connect to the bus listening at this DBus address (e.g. a private dbus-daemon running
+             * stand-in services) instead of the system bus. Empty uses the system bus.
+             */
+            std::string busAddress;
+
+            /**
+             * Bound on the unpaired devices kept from discovery. Past maxUnpairedDevices the least
+             * recently seen ones are evicted, one not heard of for unpairedDeviceTtl is dropped.
+             * Paired and connected devices are never evicted. 0 disables the respective limit.
+             */
+            size_t maxUnpairedDevices = 1024;
+            std::chrono::seconds unpairedDeviceTtl = std::chrono::seconds(600);
+
+            /**
+             * Device PropertiesChanged (RSSI, name, UUIDs) arriving within this window are merged
+             * per device and applied once at its end, so device getters may lag by up to the window.
+             * Connected and Paired changes are applied right away. 0 applies every signal on arrival.
+             */
+            std::chrono::milliseconds devicePropertiesWindow = std::chrono::milliseconds(100);
+
+            /**
+             * Bound on the blocking calls the library makes on its own: GetManagedObjects at startup and
+             * GetNameOwner per subscribed service. Split evenly across internalCallRetries + 1 attempts.
+             */
+            std::chrono::milliseconds internalCallTimeout = std::chrono::milliseconds(10000);
+            int internalCallRetries = 1;
+        };
+
+        /**
+         * Adapter1.SetDiscoveryFilter arguments, bluetoothd then drops the inquiry and advertising
+         * reports that do not match before they become signals. Unset fields are not sent.
+         * rssi (dBm) and pathloss (dB, needs the advertised TX power) exclude each other.
+         * uuids takes 128-bit UUID strings or the profile names connectProfile() accepts, a device
+         * matches when it advertises any of them. duplicateData false lets the controller drop
+         * repeated advertisements of the same device.
+         */
+        struct DiscoveryFilter
+        {
+            enum class Transport
+            {
+                Auto,
+                BrEdr,
+                Le
+            };
+
+            Transport transport = Transport::Auto;
+            std::optional<int16_t> rssi;
+            std::optional<uint16_t> pathloss;
+            std::vector<std::string> uuids;
+            std::optional<bool> duplicateData;
+        };
+
+        /**
+         * Per-connection queue metrics. queueDepth is the number of messages found waiting
+         * at the last wakeup of the connection's thread.
+         */
+        struct ConnectionStats
+        {
+            std::string name;
+            uint64_t dispatched = 0;
+            uint32_t queueDepth = 0;
+            uint32_t maxQueueDepth = 0;
+            long outgoingBytes = 0;
+        };
+
+        /**
+         * Latency of one "interface.member" call as seen by the library, retries included.
+         * Percentiles are read from a log-linear histogram and overstate by at most 1/16.
+         * calls counts every completion, errors the error replies (timeouts among them)
+         * and failed the calls cancelled or never sent, which carry no latency.
+         */
+        struct MethodStats
+        {
+            std::string method;
+            uint64_t calls = 0;
+            uint64_t errors = 0;
+            uint64_t timeouts = 0;
+            uint64_t failed = 0;
+            double meanUs = 0;
+            uint64_t p50Us = 0;
+            uint64_t p90Us = 0;
+            uint64_t p99Us = 0;
+            uint64_t p999Us = 0;
+            uint64_t maxUs = 0;
+        };
+
+        struct SignalStats
+        {
+            std::string signal;
+            uint64_t received = 0;
+        };
+
+        /**
+         * Snapshot of getStats(). The deviceInfos fields describe the queue between signal
+         * ingest and the thread inserting discovered devices. deviceMemoryBytes estimates the
+         * heap held by the device table, records and their index entries included.
+         * Devices leave the table as evicted (over maxUnpairedDevices), expired (past
+         * unpairedDeviceTtl) or removed (InterfacesRemoved from bluetoothd).
+         * devicePropertiesCoalesced counts the PropertiesChanged merged into one already
+         * waiting for the end of Options::devicePropertiesWindow.
+         */
+        struct Stats
+        {
+            std::vector<MethodStats> methods;
+            std::vector<SignalStats> signals;
+            std::vector<ConnectionStats> connections;
+            uint64_t deviceInfosQueued = 0;
+            uint64_t deviceInfosDropped = 0;
+            uint32_t deviceInfosQueueDepth = 0;
+            uint32_t maxDeviceInfosQueueDepth = 0;
+            uint32_t deviceInfosQueueCapacity = 0;
+            uint64_t deviceCount = 0;
+            uint64_t pinnedDeviceCount = 0;
+            uint64_t deviceMemoryBytes = 0;
+            uint64_t bytesPerDevice = 0;
+            uint64_t devicesEvicted = 0;
+            uint64_t devicesExpired = 0;
+            uint64_t devicesRemoved = 0;
+            uint64_t devicePropertiesCoalesced = 0;
+        };
+
+        /**
+         * NetworkManager state, fits in one lock-free atomic word.
+         * state is an NMState and connectivity an NMConnectivityState value.
+         */
+        struct WifiProperties
+        {
+            uint32_t state = 0;
+            uint16_t connectivity = 0;
+            bool wirelessEnabled = false;
+            bool wirelessHardwareEnabled = false;
+        };
+
+        /**
+         * One item of a bulk operation. For disconnectProfiles() an empty profile disconnects the whole device.
+         */
+        struct ProfileRequest
+        {
+            std::string address;
+            std::string profile;
+        };
+
+        /**
+         * Outcome of a ProfileRequest, results keep the order of the requests.
+         */
+        struct ProfileResult
+        {
+            std::string address;
+            std::string profile;
+            bool success = false;
+        };
+
+        /**
+         * Completion callbacks of the *Async functions run on the DBus reactor thread (on the cancelling
+         * thread after CancelToken::cancel()), keep them short and never block on another call from inside them.
+         */
+        using CompletionCallback = std::function<void(bool success)>;
+        using StringCallback = std::function<void(const std::string& value)>;
+        using ReplyHandler = std::function<void(DBusMessage* reply)>;
+        using SignalHandler = std::function<void(DBusMessage* signal)>;
+
         static NetworkProvider& initialize();
+        static NetworkProvider& initialize(const Options& options);
         static NetworkProvider& getInstance();
-        void toggleNetWork(const NetworkType& type);
-        void setScanMode(bool isScan);
-        void connectProfile(const std::string& address, const std::string& profile);
-        void disconnectProfile(const std::string& address, const std::string& profile);
-        void disconnectBluetoothDevice(const std::string& address);
+        void toggleNetWork(const NetworkType& type, const CallOptions& options = CallOptions());
+        void setScanMode(bool isScan, const CallOptions& options = CallOptions());
+
+        /**
+         * setScanMode(true) with filter set first. The filter stays with this client until the next
+         * start, setScanMode(true) then clears it again.
+         */
+        void startDiscovery(const DiscoveryFilter& filter, const CallOptions& options = CallOptions());
+        void connectProfile(const std::string& address, const std::string& profile, const CallOptions& options = CallOptions());
+        void disconnectProfile(const std::string& address, const std::string& profile, const CallOptions& options = CallOptions());
+        void disconnectBluetoothDevice(const std::string& address, const CallOptions& options = CallOptions());
         std::string getBluetoothName() const;
         std::string getBluetoothAddress() const;
+        bool isBluetoothDiscovering() const;
+
+        /**
+         * Bluetooth getters read a cache kept current by adapter signals,
+         * refreshBluetoothProperties() reloads it from the bus in one round trip.
+         */
+        bool refreshBluetoothProperties(const CallOptions& options = CallOptions());
+
+        /**
+         * Read from a cache kept current by NetworkManager's PropertiesChanged signal,
+         * refreshWifiProperties() reloads it from the bus in one round trip.
+         */
+        WifiProperties getWifiProperties() const;
+        bool refreshWifiProperties(const CallOptions& options = CallOptions());
+
+        std::vector<ConnectionStats> getConnectionStats() const;
+        Stats getStats() const;
+
+        /**
+         * Route the signals matching sender, path, interface and member (nullptr for any) to handler,
+         * which runs on the signal reactor thread like the library's own handlers and must not block.
+         * Returns the id for unsubscribeSignal(), 0 before initialization.
+         */
+        uint64_t subscribeSignal(const char* sender, const char* path, const char* interface, const char* member, SignalHandler handler);
+        void unsubscribeSignal(uint64_t id);
+
+        std::future<bool> connectProfileAsync(const std::string& address, const std::string& profile, const CallOptions& options = CallOptions());
+        void connectProfileAsync(const std::string& address, const std::string& profile, CompletionCallback callback, const CallOptions& options = CallOptions());
+        std::future<bool> disconnectProfileAsync(const std::string& address, const std::string& profile, const CallOptions& options = CallOptions());
+        void disconnectProfileAsync(const std::string& address, const std::string& profile, CompletionCallback callback, const CallOptions& options = CallOptions());
+        std::future<bool> disconnectBluetoothDeviceAsync(const std::string& address, const CallOptions& options = CallOptions());
+        void disconnectBluetoothDeviceAsync(const std::string& address, CompletionCallback callback, const CallOptions& options = CallOptions());
+
+        /**
+         * Issue every request as its own pending call, at most maxConcurrent (0 for no cap) in flight.
+         * Completes once each item has a result, options.deadline bounds the whole batch and
+         * options.cancelToken aborts what is still running.
+         */
+        std::vector<ProfileResult> connectProfiles(const std::vector<ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options = CallOptions());
+        std::vector<ProfileResult> disconnectProfiles(const std::vector<ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options = CallOptions());
+        std::future<std::vector<ProfileResult>> connectProfilesAsync(const std::vector<ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options = CallOptions());
+        std::future<std::vector<ProfileResult>> disconnectProfilesAsync(const std::vector<ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options = CallOptions());
+
+        std::future<std::string> getBluetoothNameAsync(const CallOptions& options = CallOptions()) const;
+        void getBluetoothNameAsync(StringCallback callback, const CallOptions& options = CallOptions()) const;
+        std::future<std::string> getBluetoothAddressAsync(const CallOptions& options = CallOptions()) const;
+        void getBluetoothAddressAsync(StringCallback callback, const CallOptions& options = CallOptions()) const;
         
         void dumpBluetoothDevices();
         
     private:
-        NetworkProvider();
+        NetworkProvider(const Options& options);
         ~NetworkProvider();
-        bool doInit();
-        void signalHandler();
+        bool doInit(const Options& options);
+        void reactorHandler(DBusReactor* reactor);
+
+        template<typename R>
+        using CallResult = std::conditional_t<std::is_void_v<R>, bool, std::optional<R>>;
 
-        DBusMessage* createMethod(const char* serviceName, const char* objectPath, const char* interface, const char* method);
-        DBusMessage* invokeMethod(DBusMessage* messageSend, const char* interface, const char* property, bool value = false);
+        /**
+         * Typed blocking method call, defined in NetworkCall.h. The request signature follows from Args at
+         * compile time, the reply must match R exactly (void for an empty reply) and R must own its data.
+         */
+        template<typename R, typename... Args>
+        CallResult<R> call(const CallOptions& options, const char* service, const char* path, const char* interface, const char* member, const Args&... args);
+        template<typename R, typename... Args>
+        CallResult<R> call(const char* service, const char* path, const char* interface, const char* member, const Args&... args);
+        template<typename R>
+        CallResult<R> call(DBusMessage* messageSend, const CallOptions& options);
+        bool sendWithReply(DBusMessage* messageSend, ReplyHandler handler, const CallOptions& options = CallOptions());
+        DBusMessage* sendWithReplyAndBlock(DBusMessage* messageSend, DBusError* error, const CallOptions& options = CallOptions());
+        CallOptions internalCallOptions() const;
 
         bool getWiFiStatus();
+        void handleWifiSignal(DBusMessage* message);
+        static void parseWifiProperties(DBusMessageIter* properties, WifiProperties& wifi);
         bool getBTStatus();
 
-        DBusConnection* mConnection = nullptr;
+        DBusConnection* mConnection = nullptr; // Method calls
+        DBusConnection* mSignalConnection = nullptr; // Signal ingest, mConnection unless Options::privateConnections
+        DBusReactor* mReactor = nullptr;
+        DBusReactor* mSignalReactor = nullptr;
+        DBusDispatcher* mDispatcher = nullptr;
+        NetworkStats* mStats = nullptr;
+        Options mOptions;
         std::thread* mWorkerThread = nullptr;
+        std::thread* mCallThread = nullptr;
+        std::atomic<WifiProperties> mWifiProperties{WifiProperties()};
+        std::mutex mWifiPropertiesMutex; // Serializes writers, readers only load mWifiProperties
 };
 
 extern "C" 
 {
     NetworkProvider* np_initialize();
+    NetworkProvider* np_initialize_at(const char* busAddress);
     NetworkProvider* np_get_instance();
     void np_toggle_network(NetworkProvider* np, NetworkProvider::NetworkType type);
     void np_set_scan_mode(NetworkProvider* np, bool isScan);
@@ -58,6 +380,12 @@ extern "C"
     const char* np_get_bluetooth_name(NetworkProvider* np);
     const char* np_get_bluetooth_address(NetworkProvider* np);
     void np_dump_bluetooth_devices(NetworkProvider* np);
+
+    /**
+     * getStats() as a JSON object written to buffer like snprintf: at most size - 1 characters
+     * plus the terminator, the return value is the full length so a larger buffer can be retried.
+     */
+    size_t np_get_stats(NetworkProvider* np, char* buffer, size_t size);
     void np_destroy(NetworkProvider* np);
 }
 #endif // NETWORK_PROVIDER
\ No newline at end of file
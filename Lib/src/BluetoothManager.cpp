@@ -1,54 +1,20 @@
 #include "BluetoothManager.h"
+#include "BluetoothProfile.h"
 #include "NetworkProvider.h"
+#include "DBusReactor.h"
+#include "DBusDispatcher.h"
+#include "NetworkCall.h"
+#include "Logger.h"
+#include "NetworkStats.h"
 #include <locale>
-#include <regex>
 #include <unistd.h>
 #include <variant> 
 
 static BluetoothAdapter* gInstance = nullptr;
 
-std::unordered_map<std::string, std::string> BluetoothAdapter::gProfileMap = {
-                                                                                {"00001200-0000-1000-8000-00805f9b34fb", "PnP"}, // Plug and Play
-                                                                                {"0000111f-0000-1000-8000-00805f9b34fb", "HFP" }, // Handfree profile
-                                                                                {"0000112f-0000-1000-8000-00805f9b34fb", "PBAP"}, // Phone Book Access Profile
-                                                                                {"0000110a-0000-1000-8000-00805f9b34fb", "Audio-Source"},
-                                                                                {"0000110b-0000-1000-8000-00805f9b34fb", "Audio-Sink"},
-                                                                                {"0000110e-0000-1000-8000-00805f9b34fb", "A2DP-Source"}, // A/V Remote Control
-                                                                                {"0000110c-0000-1000-8000-00805f9b34fb", "A2DP-Sink"}, // A/V Remote Control Target
-                                                                                {"0000110d-0000-1000-8000-00805f9b34fb", "A2DP"}, // Advanced Audio Distribution Profile
-                                                                                {"00001116-0000-1000-8000-00805f9b34fb", "HSP"}, // Headset Profile
-                                                                                {"00001108-0000-1000-8000-00805f9b34fb", "HSP-Audio-Headphones"},
-                                                                                {"00001132-0000-1000-8000-00805f9b34fb", "MAP"}, // Message Access Profile
-                                                                                {"00001801-0000-1000-8000-00805f9b34fb", "GATT"}, // Generic Attribute Profile
-                                                                                {"00000000-deca-fade-deca-deafdecacafe", "Custom-Profile"},
-                                                                                {"02030302-1d19-415f-86f2-22a2106a0a77", "Custom-UUID-1"},
-                                                                                {"2d8d2466-e14d-451c-88bc-7301abea291a", "Custom-UUID-2"},
-                                                                                {"00000000-deca-fade-deca-deafdecacafe", "iAP"}, // Apple's Internet Accessory Protocol
-                                                                                {"2d8d2466-e14d-451c-88bc-7301abea291a", "Carplay"},
-                                                                                {"02030302-1d19-415f-86f2-22a2106a0a77", "iAP-v2"},
-                                                                                {"02030302-1d19-415f-86f2-22a2106a0a77", "iAP-v2"},
-                                                                                {"1ff31936-572e-4b36-a2bf-b2409b1aa6f4", "MAP-Apple"},
-                                                                                {"00001000-0000-1000-8000-00805f9b34fb", "Discovery-Server-Service-Class-ID"},
-                                                                                {"00001800-0000-1000-8000-00805f9b34fb", "GAP"}, // Generic Access Profile
-                                                                                {"0000180a-0000-1000-8000-00805f9b34fb", "DIS"}, // Device Information Service
-                                                                                {"9fa480e0-4967-4542-9390-d343dc5d04ae", "TDS"}, // Transport Discovery Service
-                                                                                {"d0611e78-bbb4-4591-a5f8-487910ae4366", "AMS"}, // Apple Media Service
-                                                                                {"00001105-0000-1000-8000-00805f9b34fb", "OPP"}, // OBEX Object Push Profile
-                                                                                {"00001112-0000-1000-8000-00805f9b34fb","HSP-AG"}, // Headset Profile (HSP) - Audio Gateway (AG)
-                                                                                {"00001115-0000-1000-8000-00805f9b34fb", "PAN"}, // Personal Area Networking
-                                                                                {"0000FE03-0000-1000-8000-00805F9B34FB", "VendorId - Baidu"},
-                                                                                {"0000FDDF-0000-1000-8000-00805F9B34FB", "VendorId - Amazon"},
-                                                                                {"00001203-0000-1000-8000-00805F9B34FB", "GAVDP"}, // eneric Audio/Video Distribution Profile
-                                                                                {"0000110F-0000-1000-8000-00805F9B34FB", "AVRCP"}, // Audio/Video Remote Control Profile
-                                                                                {"00001101-0000-1000-8000-00805f9b34fb", "Serial-Port"},
-                                                                                {"00001124-0000-1000-8000-00805f9b34fb", "HID"}, // Human Interface Device
-                                                                                {"0000180f-0000-1000-8000-00805f9b34fb", "BS"}, // Battery Service
-                                                                                {"0000fd72-0000-1000-8000-00805f9b34fb", "LIS"}, // Logitech International SA
-                                                                                {"00010000-0000-1000-8000-011f2000046d", "Logitech-Vendor-Id"},
-                                                                                {"0000111e-0000-1000-8000-00805f9b34fb", "HFP-HV-SK579BT"},
-                                                                                {"00001812-0000-1000-8000-00805f9b34fb","HID-Logitech"},
-                                                                            };
-
+// Bounds of the TTL sweep period, a quarter of the TTL in between
+static constexpr std::chrono::seconds G_DEVICE_SWEEP_MIN_INTERVAL(1);
+static constexpr std::chrono::seconds G_DEVICE_SWEEP_MAX_INTERVAL(60);
 
 BluetoothAdapter& BluetoothAdapter::initialize(NetworkProvider& network)
 {
@@ -66,214 +32,305 @@ BluetoothAdapter& BluetoothAdapter::getInstance()
     return *gInstance;
 }
 
-template<typename T>
-std::string BluetoothAdapter::getProfile(const T& uuid)
+std::string BluetoothAdapter::getProfile(const BluetoothUuid& uuid)
 {
-    std::string ret;
-    if constexpr (std::is_same_v<T, std::string>) {
-        ret = uuid;
-    }
-    else if constexpr (std::is_same_v<T, const char*>) {
-        ret = std::string(uuid);
-    }
-    else {
-        // Do nothing
-        return "";
-    }
-
-    std::unordered_map<std::string, std::string>::iterator foundItem = gProfileMap.begin();
-    while (foundItem != gProfileMap.end())
-    {
-        if (std::string(uuid) == foundItem->first)  {
-            ret = foundItem->second;
-            break;
-        }
-        foundItem++;
+    const char* name = findProfileName(uuid);
+    if (nullptr == name) {
+        return uuid.toString();
     }
-
-    return ret;
+    return name;
 }
 
-BluetoothAdapter::BluetoothAdapter(NetworkProvider& network) : mNetwork(network), mDiscovering(false), mDiscoveringThread(nullptr), mBluetoothActionThread(nullptr)
+BluetoothAdapter::BluetoothAdapter(NetworkProvider& network) : mDevices(std::make_shared<const DeviceTable>()), mDeviceInfosQueue(G_DEVICE_INFO_QUEUE_CAPACITY), mNetwork(network), mAdapterProperties(std::make_shared<const AdapterProperties>()), mUnpinnedDevices(0), mDevicesEvicted(0), mDevicesExpired(0), mDevicesRemoved(0), mFlushScheduled(false), mDevicePropertiesCoalesced(0), mDiscovering(false), mDiscoveryFiltered(false), mBluetoothActionThread(nullptr)
 {
-    std::function<std::optional<std::vector<std::string>>(DBusConnection*)> getPairedDevicesPath = [](DBusConnection* connection) -> std::optional<std::vector<std::string>> {
-        std::vector<std::string> devicePaths;
+    // One GetManagedObjects reply already carries every Device1 property dictionary
+    std::function<std::optional<std::vector<DeviceInfo>>()> getManagedDevices = [this]() -> std::optional<std::vector<DeviceInfo>> {
+        std::vector<DeviceInfo> devices;
         DBusError error;
+        dbus_error_init(&error);
         DBusMessage* message = dbus_message_new_method_call(
             "org.bluez",                  // Service name
             "/",                          // Object path
-            "org.freedesktop.DBus.ObjectManager", // Interface
+            G_INTERFACE_OBJECT_MANAGER,   // Interface
             "GetManagedObjects"           // Method
         );
 
         if (nullptr == message) {
-            std::cerr << "Failed to create D-Bus message.\n";
+            NETWORK_LOG(Error) << "Failed to create D-Bus message";
             return {};
         }
 
-        DBusMessage* reply = dbus_connection_send_with_reply_and_block(connection, message, -1, &error);
+        // Runs before the adapter exists, a bluetoothd that never answers must not hold up initialization
+        DBusMessage* reply = mNetwork.sendWithReplyAndBlock(message, &error, mNetwork.internalCallOptions());
+        dbus_message_unref(message);
         if (nullptr == reply) {
-            std::cerr << "Failed to send D-Bus message.\n";
+            NETWORK_LOG(Error) << "Failed to send D-Bus message" << logField("error", dbus_error_is_set(&error) ? error.message : "no reply");
+            dbus_error_free(&error);
             return {};
         }
-        
+
+        static const std::string devicePrefix = std::string(G_BT_OBJECT_PATH) + "/";
         DBusMessageIter iter;
-        if (dbus_message_iter_init(reply, &iter)) {
-            DBusMessageIter dict_entry;
-            dbus_message_iter_recurse(&iter, &dict_entry);
-
-            while (dbus_message_iter_get_arg_type(&dict_entry) != DBUS_TYPE_INVALID) {
-                const char* objectPath;
-                dbus_message_iter_recurse(&dict_entry, &iter);
-                dbus_message_iter_get_basic(&iter, &objectPath);
-                static std::regex pattern("^/org/bluez/hci0/dev_[^/]*$");
-                if (std::regex_search(std::string(objectPath), pattern)) {
-                    devicePaths.emplace_back(objectPath);
+        if (dbus_message_iter_init(reply, &iter) && (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY)) {
+            DBusMessageIter objects;
+            dbus_message_iter_recurse(&iter, &objects);
+
+            while (dbus_message_iter_get_arg_type(&objects) == DBUS_TYPE_DICT_ENTRY) {
+                DBusMessageIter object;
+                DBusMessageIter interfaces;
+                const char* objectPath = nullptr;
+                dbus_message_iter_recurse(&objects, &object);
+                dbus_message_iter_get_basic(&object, &objectPath);
+                dbus_message_iter_next(&object);
+
+                if ((0 == strncmp(objectPath, devicePrefix.c_str(), devicePrefix.size())) && (dbus_message_iter_get_arg_type(&object) == DBUS_TYPE_ARRAY)) {
+                    dbus_message_iter_recurse(&object, &interfaces);
+                    while (dbus_message_iter_get_arg_type(&interfaces) == DBUS_TYPE_DICT_ENTRY) {
+                        DBusMessageIter interface;
+                        const char* interfaceName = nullptr;
+                        dbus_message_iter_recurse(&interfaces, &interface);
+                        dbus_message_iter_get_basic(&interface, &interfaceName);
+                        if (0 == strcmp(interfaceName, G_BT_INTERFACE_DEVICE1)) {
+                            dbus_message_iter_next(&interface);
+                            DeviceDelta properties;
+                            parseDeviceProperties(&interface, properties);
+                            devices.emplace_back(makeDeviceInfo(objectPath, std::move(properties)));
+                            break;
+                        }
+                        dbus_message_iter_next(&interfaces);
+                    }
                 }
-                dbus_message_iter_next(&dict_entry);
+                dbus_message_iter_next(&objects);
             }
         }
-        dbus_message_unref(message);
         dbus_message_unref(reply);
-        return devicePaths;
+        return devices;
     };
 
-    std::function<std::shared_ptr<BluetoothDevice>(DBusConnection*,const std::string&)> getDevice = [this](DBusConnection* connection, const std::string& devicePath) -> std::shared_ptr<BluetoothDevice> {
-        DBusError error;
-        dbus_error_init(&error);
-
-        DBusMessage* message = dbus_message_new_method_call(
-            "org.bluez",                  // Service name
-            devicePath.c_str(),          // Object path
-            "org.freedesktop.DBus.Properties", // Interface
-            "GetAll"                      // Method
-        );
-
-        if (nullptr == message) {
-            std::cerr << "Failed to create D-Bus message.\n";
-            return nullptr;
-        }
-
-        const char* interface_name = "org.bluez.Device1";
-        dbus_message_append_args(message, DBUS_TYPE_STRING, &interface_name, DBUS_TYPE_INVALID);
-
-        DBusMessage* reply = dbus_connection_send_with_reply_and_block(connection, message, -1, &error);
-        if (dbus_error_is_set(&error)) {
-            std::cerr << "Error getting device info: " << error.message << std::endl;
-            dbus_error_free(&error);
-            return nullptr;
+    std::once_flag init;
+    std::call_once(init, [this, getManagedDevices](){
+        // Subscribe before the snapshot so nothing added in between is missed, the reactor queues it meanwhile
+        DBusDispatcher* dispatcher = mNetwork.mDispatcher;
+        mSubscriptions.push_back(dispatcher->subscribe({G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_INTERFACE_DBUS_PROP, G_SIGNAL_PROPERTIES_CHANGED}, [this](DBusMessage* message) {
+            handleAdapterSignal(message);
+        }));
+        mSubscriptions.push_back(dispatcher->subscribe({G_BT_SERVICE_NAME, nullptr, G_INTERFACE_OBJECT_MANAGER, G_SIGNAL_INTERFACES_ADDED}, [this](DBusMessage* message) {
+            handleInterfacesAdded(message);
+        }));
+        mSubscriptions.push_back(dispatcher->subscribe({G_BT_SERVICE_NAME, nullptr, G_INTERFACE_OBJECT_MANAGER, G_SIGNAL_INTERFACES_REMOVED}, [this](DBusMessage* message) {
+            handleInterfacesRemoved(message);
+        }));
+        mSubscriptions.push_back(dispatcher->subscribe({G_BT_SERVICE_NAME, nullptr, G_INTERFACE_DBUS_PROP, G_SIGNAL_PROPERTIES_CHANGED}, [this](DBusMessage* message) {
+            handleDevicePropertiesChanged(message);
+        }));
+
+        refresh();
+        std::optional<std::vector<DeviceInfo>> devicesOpt = getManagedDevices();
+        if (devicesOpt.has_value()) {
+            insertDevices(std::move(devicesOpt.value()));
         }
-        std::string devName = "";
-        std::string devAddress = "";
-        std::vector<std::string> uuids;
-        bool isConnected = false;
-        bool isPaired = false;
+        dumpDevicesPaired();
+        mBluetoothActionThread = new std::thread(std::bind(&BluetoothAdapter::bluetoothActionHandler, this));
+    });
+}
 
-        DBusMessageIter iter;
-        if (dbus_message_iter_init(reply, &iter)) {
-            DBusMessageIter dict;
-            dbus_message_iter_recurse(&iter, &dict);
-
-            while (dbus_message_iter_get_arg_type(&dict) != DBUS_TYPE_INVALID) {
-                const char* key;
-                dbus_message_iter_recurse(&dict, &iter);
-                dbus_message_iter_get_basic(&iter, &key);
-                dbus_message_iter_next(&iter);
-                if (strcmp(key, "Name") == 0) {
-                    const char* name;
-                    dbus_message_iter_recurse(&iter, &iter);
-                    dbus_message_iter_get_basic(&iter, &name);
-                    devName = name ? std::string(name) : "Unknown";
-                } else if (strcmp(key, "Address") == 0) {
-                    const char* address;
-                    dbus_message_iter_recurse(&iter, &iter);
-                    dbus_message_iter_get_basic(&iter, &address);
-                    devAddress = address ? std::string(address) : "Unknown";
-                } else if (strcmp(key, "UUIDs") == 0) {
-                    DBusMessageIter array;
-                    dbus_message_iter_recurse(&iter, &array);
-                    if (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_ARRAY) {
-                        DBusMessageIter uuid_iter;
-                        dbus_message_iter_recurse(&array, &uuid_iter);
-                        while (dbus_message_iter_get_arg_type(&uuid_iter) == DBUS_TYPE_STRING) {
-                            const char* uuid;
-                            dbus_message_iter_get_basic(&uuid_iter, &uuid);
-                            uuids.emplace_back(std::string(uuid));
-                            dbus_message_iter_next(&uuid_iter);
-                        }
+/**
+ * Collect the properties of an org.bluez.Device1 a{sv} dictionary into delta.
+ * properties must point at the array, keys the library does not track are skipped.
+ */
+void BluetoothAdapter::parseDeviceProperties(DBusMessageIter* properties, DeviceDelta& delta)
+{
+    forEachProperty(properties, [&delta](std::string_view key, DBusMessageIter* value) {
+        switch (propertyKey(key)) {
+            case propertyKey("Name"): {
+                std::string_view name;
+                if (readVariant(value, name)) {
+                    delta.deviceName = std::string(name);
+                }
+                break;
+            }
+            case propertyKey("Address"): {
+                std::string_view address;
+                if (readVariant(value, address)) {
+                    delta.deviceAddress = std::string(address);
+                }
+                break;
+            }
+            case propertyKey("UUIDs"): {
+                std::vector<std::string_view> values;
+                if (!readVariant(value, values)) {
+                    break;
+                }
+                std::vector<BluetoothUuid> uuids;
+                uuids.reserve(values.size());
+                for (std::string_view uuid : values) {
+                    std::optional<BluetoothUuid> parsed = BluetoothUuid::parse(uuid);
+                    if (parsed.has_value()) {
+                        uuids.push_back(parsed.value());
+                    }
+                    else {
+                        NETWORK_LOG(Warn) << "Ignoring malformed UUID" << logField("uuid", uuid);
                     }
-                } else if (strcmp(key, "Connected") == 0) {
-                    bool connected = false;
-                    dbus_message_iter_recurse(&iter, &iter);
-                    dbus_message_iter_get_basic(&iter, &connected);
-                    isConnected = connected;
                 }
-                else if (strcmp(key, "Paired") == 0) {
-                    bool connected = false;
-                    dbus_message_iter_recurse(&iter, &iter);
-                    dbus_message_iter_get_basic(&iter, &connected);
+                delta.uuids = std::move(uuids);
+                break;
+            }
+            case propertyKey("Connected"): {
+                bool connected = false;
+                if (readVariant(value, connected)) {
+                    delta.connected = connected;
                 }
-                else {
-                    // Do nothing
+                break;
+            }
+            case propertyKey("Paired"): {
+                bool paired = false;
+                if (readVariant(value, paired)) {
+                    delta.paired = paired;
                 }
-                dbus_message_iter_next(&dict);
+                break;
+            }
+            case propertyKey("RSSI"): {
+                int16_t rssi = 0;
+                if (readVariant(value, rssi)) {
+                    delta.rssi = rssi;
+                }
+                break;
+            }
+            default: {
+                break;
             }
         }
-        
-        std::shared_ptr<BluetoothDevice> device(new BluetoothDevice(*this,devName, devAddress, std::string(devicePath), uuids));
-        device->setStatus((isConnected == true ? Status::Connected : Status::Disconnected));
-        dbus_message_unref(message);
-        dbus_message_unref(reply);
-        return device;
-    };
+    });
+}
 
-    std::once_flag init;
-    std::call_once(init, [this, getPairedDevicesPath, getDevice](){
-        std::optional<std::vector<std::string>> devicesPathOpt = getPairedDevicesPath(mNetwork.mConnection);
-        if (devicesPathOpt.has_value()) {
-            std::vector<std::string> devicesPath = devicesPathOpt.value();
-            for (int i = 0; i < devicesPath.size(); i++) {
-                mDevicesTable.emplace(devicesPath[i],getDevice(mNetwork.mConnection,devicesPath[i]));
+/**
+ * Reset the properties listed in the invalidated array of a PropertiesChanged signal.
+ */
+void BluetoothAdapter::parseInvalidatedProperties(const std::vector<std::string_view>& invalidated, DeviceDelta& delta)
+{
+    for (std::string_view key : invalidated) {
+        switch (propertyKey(key)) {
+            case propertyKey("Name"): {
+                delta.deviceName = "";
+                break;
+            }
+            case propertyKey("UUIDs"): {
+                delta.uuids = std::vector<BluetoothUuid>();
+                break;
+            }
+            case propertyKey("RSSI"): {
+                delta.rssi = G_RSSI_UNKNOWN;
+                break;
+            }
+            default: {
+                break;
             }
         }
-        dumpDevicesPaired();
-        mDiscoveringThread = new std::thread(std::bind(&BluetoothAdapter::discoveringHandler, this));
-        mBluetoothActionThread = new std::thread(std::bind(&BluetoothAdapter::bluetoothActionHandler, this));
-    });
+    }
+}
+
+void DeviceDelta::merge(DeviceDelta&& newer)
+{
+    if (newer.deviceName.has_value()) {
+        deviceName = std::move(newer.deviceName);
+    }
+    if (newer.deviceAddress.has_value()) {
+        deviceAddress = std::move(newer.deviceAddress);
+    }
+    if (newer.uuids.has_value()) {
+        uuids = std::move(newer.uuids);
+    }
+    if (newer.paired.has_value()) {
+        paired = newer.paired;
+    }
+    if (newer.connected.has_value()) {
+        connected = newer.connected;
+    }
+    if (newer.rssi.has_value()) {
+        rssi = newer.rssi;
+    }
+}
+
+DeviceInfo BluetoothAdapter::makeDeviceInfo(std::string_view devicePath, DeviceDelta&& delta)
+{
+    DeviceInfo info;
+    info.devicePath = std::string(devicePath);
+    info.deviceName = std::move(delta.deviceName).value_or("");
+    info.deviceAddress = std::move(delta.deviceAddress).value_or("");
+    info.uuids = std::move(delta.uuids).value_or(std::vector<BluetoothUuid>());
+    info.paired = delta.paired.value_or(false);
+    info.connected = delta.connected.value_or(false);
+    info.rssi = delta.rssi.value_or(G_RSSI_UNKNOWN);
+    return info;
+}
+
+/**
+ * Delta refreshing a known record from an InterfacesAdded dictionary. makeDeviceInfo() filled
+ * absent name, UUIDs and RSSI with defaults, those are left out rather than clearing the record.
+ */
+DeviceDelta BluetoothAdapter::makeDeviceDelta(DeviceInfo&& info)
+{
+    DeviceDelta delta;
+    if (!info.deviceName.empty()) {
+        delta.deviceName = std::move(info.deviceName);
+    }
+    if (!info.uuids.empty()) {
+        delta.uuids = std::move(info.uuids);
+    }
+    if (info.rssi != G_RSSI_UNKNOWN) {
+        delta.rssi = info.rssi;
+    }
+    delta.paired = info.paired;
+    delta.connected = info.connected;
+    return delta;
+}
+
+Status BluetoothAdapter::getStatus(const DeviceInfo& info)
+{
+    if (info.connected) {
+        return Status::Connected;
+    }
+    return info.paired ? Status::Disconnected : Status::Unpaired;
 }
 
 BluetoothAdapter::~BluetoothAdapter()
 {
-    if (nullptr != mDiscoveringThread) {
-        mDiscoveringThread->join();
-        delete mDiscoveringThread;
-        mDiscoveringThread = nullptr;
+    for (uint64_t subscription : mSubscriptions) {
+        mNetwork.mDispatcher->unsubscribe(subscription);
     }
     if (nullptr != mBluetoothActionThread) {
         mBluetoothActionThread->join();
         delete mBluetoothActionThread;
         mBluetoothActionThread = nullptr;
     }
+}
 
-    {
-        std::lock_guard<std::shared_mutex> lock(mMutex);
-        mDeviceInfosQueues.clear();
-    }
+void BluetoothAdapter::startDiscovery(const CallOptions& options)
+{
+    startDiscovery(nullptr, options);
+}
+
+void BluetoothAdapter::startDiscovery(const NetworkProvider::DiscoveryFilter& filter, const CallOptions& options)
+{
+    startDiscovery(&filter, options);
 }
 
-void BluetoothAdapter::startDiscovery()
+/**
+ * filter nullptr starts without one, clearing a filter left from an earlier start.
+ */
+void BluetoothAdapter::startDiscovery(const NetworkProvider::DiscoveryFilter* filter, const CallOptions& options)
 {
     DBusMessage *message = nullptr;
     DBusMessage *reply = nullptr;
     DBusError err;
 
     if (nullptr == mNetwork.mConnection) {
-        std::cout << "startDiscovery but not establish connection\n";
+        NETWORK_LOG(Warn) << "startDiscovery but not establish connection";
         return;
     }
 
     if (mDiscovering) {
-        std::cout << "startDiscovery but already scan\n";
+        NETWORK_LOG(Info) << "startDiscovery but already scan";
         return;
     }
     
@@ -282,43 +339,150 @@ void BluetoothAdapter::startDiscovery()
         {
             std::lock_guard<std::mutex> lock(mDiscoveringMutex);
             mDiscovering = true;
-            mDiscoveringCV.notify_all();
         }
-        dbus_error_init(&err);
-        message = mNetwork.createMethod(G_BT_SERVICE_NAME,G_BT_OBJECT_PATH, G_BT_ADAPTER_INTERFACE, G_METHOD_START_DISCOVERY);
 
-        if (nullptr == message) {
-            std::cerr << "Message is NULL\n";
-            return;
-        }
+        bool started = false;
+        do
+        {
+            // Applied by bluetoothd when discovery starts, a failed filter must not widen the scan
+            if (((nullptr != filter) || mDiscoveryFiltered) && !setDiscoveryFilter(filter, options)) {
+                break;
+            }
+            dbus_error_init(&err);
+            static const DBusMessageTemplate G_REQUEST(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_BT_ADAPTER_INTERFACE, G_METHOD_START_DISCOVERY);
+            message = G_REQUEST.instantiate();
 
-        reply = dbus_connection_send_with_reply_and_block(mNetwork.mConnection, message, -1, &err);
-        dbus_message_unref(message);
+            if (nullptr == message) {
+                NETWORK_LOG(Error) << "Message is NULL";
+                break;
+            }
 
-        if (dbus_error_is_set(&err)) {
-            std::cerr << "Error starting discovery: " << err.message << std::endl;
-            dbus_error_free(&err);
+            reply = mNetwork.sendWithReplyAndBlock(message, &err, options);
+            dbus_message_unref(message);
+
+            if (dbus_error_is_set(&err)) {
+                NETWORK_LOG(Error) << "Error starting discovery" << logField("error", err.message);
+                dbus_error_free(&err);
+                break;
+            }
+            dbus_message_unref(reply);
+            started = true;
+        } while (0);
+
+        // A timed out or rejected start must not leave later calls thinking a scan runs
+        if (!started) {
+            std::lock_guard<std::mutex> lock(mDiscoveringMutex);
+            mDiscovering = false;
             return;
         }
-        dbus_message_unref(reply);
     }
 
-    std::cout << "Started Bluetooth discovery..." << std::endl;
+    NETWORK_LOG(Info) << "Started Bluetooth discovery";
+}
+
+/**
+ * Caller holds mMutex exclusively. filter nullptr clears the filter with an empty dictionary.
+ */
+bool BluetoothAdapter::setDiscoveryFilter(const NetworkProvider::DiscoveryFilter* filter, const CallOptions& options)
+{
+    DBusError err;
+    DBusMessage* message = newDiscoveryFilterCall(filter);
+    if (nullptr == message) {
+        NETWORK_LOG(Error) << "Invalid discovery filter";
+        return false;
+    }
+
+    dbus_error_init(&err);
+    DBusMessage* reply = mNetwork.sendWithReplyAndBlock(message, &err, options);
+    dbus_message_unref(message);
+    if (dbus_error_is_set(&err)) {
+        NETWORK_LOG(Error) << "Error setting discovery filter" << logField("error", err.message);
+        dbus_error_free(&err);
+        return false;
+    }
+    dbus_message_unref(reply);
+    mDiscoveryFiltered = (nullptr != filter);
+    return true;
+}
+
+/**
+ * SetDiscoveryFilter(a{sv}) carrying the fields filter sets, nullptr when out of memory
+ * or a UUID is neither a profile name nor a UUID.
+ */
+DBusMessage* BluetoothAdapter::newDiscoveryFilterCall(const NetworkProvider::DiscoveryFilter* filter)
+{
+    static const char* const G_TRANSPORTS[] = {"auto", "bredr", "le"};
+    DBusMessage* ret = newMethodCall(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_BT_ADAPTER_INTERFACE, G_METHOD_SET_DISCOVERY_FILTER);
+    if (nullptr == ret) {
+        return nullptr;
+    }
+
+    bool ok = true;
+    do
+    {
+        DBusMessageIter iter;
+        DBusMessageIter dict;
+        dbus_message_iter_init_append(ret, &iter);
+        if (!dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}", &dict)) {
+            ok = false;
+            break;
+        }
+        if (nullptr != filter) {
+            std::vector<std::string> uuids;
+            for (const std::string& uuid : filter->uuids) {
+                const ProfileEntry* entry = findProfileByName(uuid);
+                std::optional<BluetoothUuid> parsed = (nullptr != entry) ? std::optional<BluetoothUuid>(entry->uuid) : BluetoothUuid::parse(uuid);
+                if (parsed.has_value()) {
+                    uuids.push_back(parsed->toString());
+                }
+                else {
+                    NETWORK_LOG(Warn) << "Unknown discovery filter UUID" << logField("uuid", uuid);
+                    ok = false;
+                }
+            }
+            if (filter->transport != NetworkProvider::DiscoveryFilter::Transport::Auto) {
+                ok = ok && appendProperty(&dict, "Transport", G_TRANSPORTS[static_cast<int>(filter->transport)]);
+            }
+            if (filter->rssi.has_value()) {
+                ok = ok && appendProperty(&dict, "RSSI", *filter->rssi);
+            }
+            if (filter->pathloss.has_value()) {
+                ok = ok && appendProperty(&dict, "Pathloss", *filter->pathloss);
+            }
+            if (!uuids.empty()) {
+                ok = ok && appendProperty(&dict, "UUIDs", uuids);
+            }
+            if (filter->duplicateData.has_value()) {
+                ok = ok && appendProperty(&dict, "DuplicateData", *filter->duplicateData);
+            }
+        }
+        if (!ok) {
+            dbus_message_iter_abandon_container(&iter, &dict);
+            break;
+        }
+        ok = dbus_message_iter_close_container(&iter, &dict);
+    } while (0);
+
+    if (!ok) {
+        dbus_message_unref(ret);
+        ret = nullptr;
+    }
+    return ret;
 }
 
-void BluetoothAdapter::stopDiscovery()
+void BluetoothAdapter::stopDiscovery(const CallOptions& options)
 {
     DBusMessage *message = nullptr;
     DBusMessage *reply = nullptr;
     DBusError err;
 
     if (nullptr == mNetwork.mConnection) {
-        std::cout << "stopDiscovery but not establish connection\n";
+        NETWORK_LOG(Warn) << "stopDiscovery but not establish connection";
         return;
     }
 
     if (!mDiscovering) {
-        std::cout << "stopDiscovery but already stopped\n";
+        NETWORK_LOG(Info) << "stopDiscovery but already stopped";
         return;
     }
 
@@ -327,182 +491,259 @@ void BluetoothAdapter::stopDiscovery()
         {
             std::lock_guard<std::mutex> lock(mDiscoveringMutex);
             mDiscovering = false;
-            mDiscoveringCV.notify_all();
         }
 
         dbus_error_init(&err);
-        message = mNetwork.createMethod(G_BT_SERVICE_NAME,G_BT_OBJECT_PATH, G_BT_ADAPTER_INTERFACE, G_METHOD_STOP_DISCOVERY);
+        static const DBusMessageTemplate G_REQUEST(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_BT_ADAPTER_INTERFACE, G_METHOD_STOP_DISCOVERY);
+        message = G_REQUEST.instantiate();
         if (nullptr == message) {
-            std::cerr << "Message is NULL\n";
+            NETWORK_LOG(Error) << "Message is NULL";
             return;
         }
 
-        reply = dbus_connection_send_with_reply_and_block(mNetwork.mConnection, message, -1, &err);
+        reply = mNetwork.sendWithReplyAndBlock(message, &err, options);
         dbus_message_unref(message);
 
         if (dbus_error_is_set(&err)) {
-            std::cerr << "Error starting discovery: " << err.message << std::endl;
+            NETWORK_LOG(Error) << "Error stopping discovery" << logField("error", err.message);
             dbus_error_free(&err);
             return;
         }
 
         dbus_message_unref(reply);
     }
-    std::cout << "Stop Bluetooth discovery\n";
+    NETWORK_LOG(Info) << "Stop Bluetooth discovery";
 }
 
-void BluetoothAdapter::toggleBluetoothPower()
+void BluetoothAdapter::toggleBluetoothPower(const CallOptions& options)
 {
-    DBusMessage* messageSend = nullptr;
-    DBusMessage* messageReply = nullptr;
     bool networkStatus = getBluetoothPower();
-    messageSend = mNetwork.createMethod(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_INTERFACE_DBUS_PROP , G_METHOD_SET);
-    messageReply = mNetwork.invokeMethod(messageSend, G_BT_ADAPTER_INTERFACE, G_METHOD_POWERED_PROP, !networkStatus);
-    if (nullptr != messageReply) {
-        dbus_message_unref(messageReply);
-    }
-    if (nullptr != messageSend) {
-        dbus_message_unref(messageSend);
-    }   
+    mNetwork.call<void>(options, G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_SET,
+                        G_BT_ADAPTER_INTERFACE, G_METHOD_POWERED_PROP, DBusVariant<bool>{!networkStatus});
 }
 
 bool BluetoothAdapter::getBluetoothPower() const
 {
-    DBusMessageIter iter;
-    DBusMessageIter variant;
+    return loadAdapterProperties()->powered;
+}
+
+bool BluetoothAdapter::isDiscovering() const
+{
+    return loadAdapterProperties()->discovering;
+}
+
+std::shared_ptr<const AdapterProperties> BluetoothAdapter::loadAdapterProperties() const
+{
+    return std::atomic_load(&mAdapterProperties);
+}
+
+/**
+ * Replace the cached adapter properties with one GetAll round trip.
+ * The cache is otherwise kept current by PropertiesChanged on G_BT_OBJECT_PATH.
+ */
+bool BluetoothAdapter::refresh(const CallOptions& options)
+{
+    PropertyDict dict;
     DBusMessage* messageSend = nullptr;
-    DBusMessage* messageReply = nullptr;   
-    dbus_bool_t ret = FALSE;
+    DBusMessage* messageReply = nullptr;
+    DBusError error;
+    bool ret = false;
 
+    dbus_error_init(&error);
     do
     {
         if (nullptr == mNetwork.mConnection) {
-            std::cout << "getBTStatus but empty connection\n";
+            NETWORK_LOG(Warn) << "refresh but empty connection";
             break;
         }
-        messageSend = mNetwork.createMethod(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_GET);
+        static const DBusMessageTemplate G_REQUEST(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_GET_ALL, G_BT_ADAPTER_INTERFACE);
+        messageSend = G_REQUEST.instantiate();
         if (nullptr == messageSend) {
-            std::cerr << "getBTStatus but messageSend creation failed\n" ;
+            NETWORK_LOG(Error) << "refresh but messageSend creation failed";
             break;
         }
-        messageReply = mNetwork.invokeMethod(messageSend,G_BT_ADAPTER_INTERFACE,G_METHOD_POWERED_PROP);
-        if (!dbus_message_iter_init(messageReply, &iter)) {
-            std::cerr << "getBTStatus but init message reply failed\n" ;
+        messageReply = mNetwork.sendWithReplyAndBlock(messageSend, &error, options);
+        if (dbus_error_is_set(&error)) {
+            NETWORK_LOG(Error) << "Error getting adapter properties" << logField("error", error.message);
+            dbus_error_free(&error);
             break;
         }
-        if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_VARIANT) {
-            dbus_message_iter_recurse(&iter, &variant);
-            if (dbus_message_iter_get_arg_type(&variant) == DBUS_TYPE_BOOLEAN) {
-                dbus_message_iter_get_basic(&variant, &ret);
-            }
+        if (!decodeMessage(messageReply, dict)) {
+            NETWORK_LOG(Error) << "refresh but unexpected reply signature";
+            break;
         }
 
+        std::shared_ptr<AdapterProperties> properties = std::make_shared<AdapterProperties>();
+        parseAdapterProperties(&dict.iter, *properties);
+        {
+            std::lock_guard<std::mutex> lock(mAdapterPropertiesMutex);
+            std::atomic_store(&mAdapterProperties, std::shared_ptr<const AdapterProperties>(std::move(properties)));
+        }
+        ret = true;
     } while (0);
 
     if (nullptr != messageSend) {
         dbus_message_unref(messageSend);
     }
-
     if (nullptr != messageReply) {
         dbus_message_unref(messageReply);
     }
-    return static_cast<bool>(ret);
+    return ret;
 }
 
-std::string BluetoothAdapter::getBluetoothName() const
+/**
+ * Apply the Adapter1 keys of an a{sv} dictionary onto adapter, other keys are skipped.
+ */
+void BluetoothAdapter::parseAdapterProperties(DBusMessageIter* properties, AdapterProperties& adapter)
 {
-    DBusError error;
-    dbus_error_init(&error);
+    forEachProperty(properties, [&adapter](std::string_view key, DBusMessageIter* value) {
+        std::string_view text;
+        switch (propertyKey(key)) {
+            case propertyKey(G_METHOD_POWERED_PROP): {
+                readVariant(value, adapter.powered);
+                break;
+            }
+            case propertyKey(G_PROP_DISCOVERING): {
+                readVariant(value, adapter.discovering);
+                break;
+            }
+            case propertyKey(G_ALIAS): {
+                if (readVariant(value, text)) {
+                    adapter.alias = std::string(text);
+                }
+                break;
+            }
+            case propertyKey(G_METHOD_GET_ADDRESS): {
+                if (readVariant(value, text)) {
+                    adapter.address = std::string(text);
+                }
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    });
+}
 
-    DBusMessage* message = mNetwork.createMethod(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_GET);
-    
-    if (nullptr == message) {
-        std::cerr << "Message is NULL\n";
-        return "";
+/**
+ * Invalidated properties go back to their defaults, like the device ones, instead of serving a stale value.
+ * refresh() is not an option: this runs on the reactor thread, which must not block.
+ */
+void BluetoothAdapter::parseInvalidatedProperties(const std::vector<std::string_view>& invalidated, AdapterProperties& adapter)
+{
+    for (std::string_view key : invalidated) {
+        switch (propertyKey(key)) {
+            case propertyKey(G_METHOD_POWERED_PROP): {
+                adapter.powered = false;
+                break;
+            }
+            case propertyKey(G_PROP_DISCOVERING): {
+                adapter.discovering = false;
+                break;
+            }
+            case propertyKey(G_ALIAS): {
+                adapter.alias.clear();
+                break;
+            }
+            case propertyKey(G_METHOD_GET_ADDRESS): {
+                adapter.address.clear();
+                break;
+            }
+            default: {
+                break;
+            }
+        }
     }
+}
 
-    dbus_message_append_args(message,
-                             DBUS_TYPE_STRING, &G_BT_ADAPTER_INTERFACE,
-                             DBUS_TYPE_STRING, &G_ALIAS,
-                             DBUS_TYPE_INVALID);
-
-    DBusMessage* reply = dbus_connection_send_with_reply_and_block(mNetwork.mConnection, message, -1, &error);
-    dbus_message_unref(message);
-        
-    DBusMessageIter args;
-    if (!dbus_message_iter_init(reply, &args)) {
-        std::cerr << "Reply has no arguments." << std::endl;
-    } else if (dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_VARIANT) {
-        DBusMessageIter variant;
-        dbus_message_iter_recurse(&args, &variant);
+void BluetoothAdapter::handleAdapterSignal(DBusMessage* message)
+{
+    std::string_view interfaceName;
+    PropertyDict changed;
+    std::vector<std::string_view> invalidated;
+    if (!decodeMessage(message, interfaceName, changed, invalidated) || (interfaceName != G_BT_ADAPTER_INTERFACE)) {
+        return;
+    }
 
-        const char* bluetoothName = nullptr;
-        if (dbus_message_iter_get_arg_type(&variant) == DBUS_TYPE_STRING) {
-            dbus_message_iter_get_basic(&variant, &bluetoothName);
-        }
+    std::lock_guard<std::mutex> lock(mAdapterPropertiesMutex);
+    std::shared_ptr<AdapterProperties> properties = std::make_shared<AdapterProperties>(*loadAdapterProperties());
+    parseAdapterProperties(&changed.iter, *properties);
+    parseInvalidatedProperties(invalidated, *properties);
+    std::atomic_store(&mAdapterProperties, std::shared_ptr<const AdapterProperties>(std::move(properties)));
+}
 
-        dbus_message_unref(reply);
-        return bluetoothName ? std::string(bluetoothName) : "";
+bool BluetoothAdapter::getAdapterProperty(const DBusMessageTemplate& request, NetworkProvider::StringCallback callback, const CallOptions& options) const
+{
+    DBusMessage* message = request.instantiate();
+    
+    if (nullptr == message) {
+        NETWORK_LOG(Error) << "Message is NULL";
+        callback("");
+        return false;
     }
 
-    dbus_message_unref(reply);
-    return "";
+    bool ret = mNetwork.sendWithReply(message, [callback](DBusMessage* reply) {
+        if (nullptr == reply) {
+            callback("");
+            return;
+        }
+        if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+            NETWORK_LOG(Warn) << "Error getting adapter property" << logField("error", dbus_message_get_error_name(reply));
+            callback("");
+            return;
+        }
+
+        DBusVariant<std::string_view> value;
+        if (!decodeMessage(reply, value)) {
+            NETWORK_LOG(Warn) << "Unexpected adapter property reply" << logField("signature", dbus_message_get_signature(reply));
+            callback("");
+            return;
+        }
+        callback(std::string(value.value));
+    }, options);
+    dbus_message_unref(message);
+    return ret;
+}
 
+std::string BluetoothAdapter::getBluetoothName() const
+{
+    return loadAdapterProperties()->alias;
 }
 
 std::string BluetoothAdapter::getBluetoothAddress() const
 {
-    DBusMessage *message = nullptr;
-    DBusMessage *reply = nullptr;
-    DBusError error;
-    if (nullptr == mNetwork.mConnection) {
-        std::cout << "getBluetoothAddress but not establish connection\n";
-        return "";
-    }
-
-    {
-        std::unique_lock<std::shared_mutex> lock(mMutex);
-        dbus_error_init(&error);
-        DBusMessage* message = mNetwork.createMethod(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_GET);
-        
-        if (nullptr == message) {
-            std::cerr << "Message is NULL\n";
-            return "";
-        }
-        
-        dbus_message_append_args(message,
-                                DBUS_TYPE_STRING, &G_BT_ADAPTER_INTERFACE,
-                                DBUS_TYPE_STRING, &G_METHOD_GET_ADDRESS,
-                                DBUS_TYPE_INVALID);
+    return loadAdapterProperties()->address;
+}
 
-        DBusMessage* reply = dbus_connection_send_with_reply_and_block(mNetwork.mConnection, message, -1, &error);
-        dbus_message_unref(message);
+std::future<std::string> BluetoothAdapter::getBluetoothNameAsync(const CallOptions& options) const
+{
+    std::shared_ptr<std::promise<std::string>> promise = std::make_shared<std::promise<std::string>>();
+    getBluetoothNameAsync([promise](const std::string& value) {
+        promise->set_value(value);
+    }, options);
+    return promise->get_future();
+}
 
-        if (dbus_error_is_set(&error)) {
-            std::cerr << "Error getBluetoothAddress: " << error.message << std::endl;
-            dbus_error_free(&error);
-            return "";
-        }
-        
-        DBusMessageIter args;
-        if (!dbus_message_iter_init(reply, &args)) {
-            std::cerr << "Reply has no arguments." << std::endl;
-        } else if (dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_VARIANT) {
-            DBusMessageIter variant;
-            dbus_message_iter_recurse(&args, &variant);
-
-            const char* bluetoothAddress = nullptr;
-            if (dbus_message_iter_get_arg_type(&variant) == DBUS_TYPE_STRING) {
-                dbus_message_iter_get_basic(&variant, &bluetoothAddress);
-            }
+void BluetoothAdapter::getBluetoothNameAsync(NetworkProvider::StringCallback callback, const CallOptions& options) const
+{
+    static const DBusMessageTemplate G_REQUEST(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_GET, G_BT_ADAPTER_INTERFACE, G_ALIAS);
+    getAdapterProperty(G_REQUEST, std::move(callback), options);
+}
 
-            dbus_message_unref(reply);
-            return bluetoothAddress ? std::string(bluetoothAddress) : "";
-        }
+std::future<std::string> BluetoothAdapter::getBluetoothAddressAsync(const CallOptions& options) const
+{
+    std::shared_ptr<std::promise<std::string>> promise = std::make_shared<std::promise<std::string>>();
+    getBluetoothAddressAsync([promise](const std::string& value) {
+        promise->set_value(value);
+    }, options);
+    return promise->get_future();
+}
 
-        dbus_message_unref(reply);
-        return "";
-    }
+void BluetoothAdapter::getBluetoothAddressAsync(NetworkProvider::StringCallback callback, const CallOptions& options) const
+{
+    static const DBusMessageTemplate G_REQUEST(G_BT_SERVICE_NAME, G_BT_OBJECT_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_GET, G_BT_ADAPTER_INTERFACE, G_METHOD_GET_ADDRESS);
+    getAdapterProperty(G_REQUEST, std::move(callback), options);
 }
 
 std::vector<std::shared_ptr<BluetoothDevice>> BluetoothAdapter::getBondedDevices() const
@@ -513,314 +754,764 @@ std::vector<std::shared_ptr<BluetoothDevice>> BluetoothAdapter::getBondedDevices
 
 bool BluetoothAdapter::existsPaired(const std::string& devicePath)
 {
-    bool ret = false;
-    std::unordered_map<std::string, std::shared_ptr<BluetoothDevice>>::iterator foundedItem = mDevicesTable.begin();
-    while (foundedItem != mDevicesTable.end())
-    {
-        if (foundedItem->first == devicePath) {
-            ret = true;
-            break;
-        }
-        foundedItem++;
+    return mDevices.read([&devicePath](const DeviceTable& table) {
+        return nullptr != table.findPath(devicePath);
+    });
+}
+
+std::shared_ptr<BluetoothDevice> BluetoothAdapter::findDevice(const char* devicePath) const
+{
+    if (nullptr == devicePath) {
+        return nullptr;
     }
-    return ret;
+    return mDevices.read([devicePath](const DeviceTable& table) {
+        return table.findPath(devicePath);
+    });
 }
 
 void BluetoothAdapter::bluetoothActionHandler()
 {
+    DeviceInfo info;
+    std::vector<DeviceInfo> batch;
+    std::chrono::seconds ttl = mNetwork.mOptions.unpairedDeviceTtl;
+    std::chrono::steady_clock::duration sweepInterval = std::chrono::steady_clock::duration::max();
+    if (ttl.count() > 0) {
+        sweepInterval = std::clamp<std::chrono::steady_clock::duration>(ttl / 4, G_DEVICE_SWEEP_MIN_INTERVAL, G_DEVICE_SWEEP_MAX_INTERVAL);
+    }
+    std::chrono::steady_clock::time_point nextSweep = (ttl.count() > 0) ? (std::chrono::steady_clock::now() + sweepInterval) : std::chrono::steady_clock::time_point::max();
     while (true)
     {
-        std::list<std::tuple<std::string, std::string, std::string, std::vector<std::string>>>  deviceInfosQueues;
         {
             std::unique_lock<std::mutex> cvLock(mBluetoothActionMutex);
-            if (deviceInfosQueues.empty()) {
-                mBluetoothActionCV.wait(cvLock);
-            }
+            mBluetoothActionCV.wait_until(cvLock, nextSweep, [this] {
+                return !mDeviceInfosQueue.empty() || isOverCap();
+            });
+        }
 
-            deviceInfosQueues = mDeviceInfosQueues;
-            mDeviceInfosQueues.clear();
-        }
-        while(!deviceInfosQueues.empty()) {
-            std::tuple<std::string, std::string, std::string, std::vector<std::string>> deviceInfo = deviceInfosQueues.front();
-            deviceInfosQueues.pop_front();
-            std::cout << "\nDevice found: \n" << " - Name: " << std::get<1>(deviceInfo) << "\n - Address: " << std::get<2>(deviceInfo) << "\n - DevicePath: " << std::get<0>(deviceInfo);
-            std::vector<std::string> uuids = std::get<3>(deviceInfo);
-            std::cout << "\n UUIDs: ";
-            for (int i = 0; i < uuids.size(); i++)
-            {
-                std::cout << getProfile(uuids[i]) << " | " ;
+        // Everything queued so far goes into one new table, so a burst costs one copy, not one per device
+        while (mDeviceInfosQueue.tryPop(info)) {
+            if (Logger::isEnabled(LogLevel::Debug)) {
+                LogLine line(LogLevel::Debug);
+                line << "Device found" << logField("name", info.deviceName) << logField("address", info.deviceAddress)
+                     << logField("path", info.devicePath) << " uuids=";
+                for (const BluetoothUuid& uuid : info.uuids) {
+                    line << getProfile(uuid) << '|';
+                }
+            }
+            std::shared_ptr<BluetoothDevice> known = findDevice(info.devicePath.c_str());
+            if (nullptr != known) {
+                // Announced again, e.g. after a bluetoothd restart: its dictionary is the current state
+                known->touch();
+                known->applyDelta(makeDeviceDelta(std::move(info)));
             }
-            if (!existsPaired(std::get<0>(deviceInfo))) {
-                mDevicesTable.emplace(std::get<0>(deviceInfo),new BluetoothDevice(*this, std::get<1>(deviceInfo),std::get<2>(deviceInfo),std::get<0>(deviceInfo), uuids));
+            else {
+                batch.push_back(std::move(info));
             }
         }
+        if (!batch.empty()) {
+            insertDevices(std::move(batch));
+            batch.clear();
+        }
+
+        bool sweepExpired = (std::chrono::steady_clock::now() >= nextSweep);
+        if (sweepExpired) {
+            nextSweep = std::chrono::steady_clock::now() + sweepInterval;
+        }
+        evictDevices(sweepExpired);
     }
 }
 
-void BluetoothAdapter::discoveringHandler()
+/**
+ * Drop unpaired devices not seen for the TTL (only when sweepExpired), then the least recently seen
+ * ones once more than maxUnpairedDevices remain. Eviction goes down to 7/8 of the cap so a discovery
+ * burst does not rescan the table for every new device. Runs on the action thread.
+ */
+void BluetoothAdapter::evictDevices(bool sweepExpired)
 {
-    std::function<void(DBusConnection*, const char*)> getDeviceInfo = [this](DBusConnection *conn, const char* device_path) {
-        DBusMessage* message;
-        DBusMessage* reply;
-        DBusError err;
-        std::string ret = "";
-        DBusMessageIter iter, dict_entry_iter, dict_value_iter;
-        
-        dbus_error_init(&err);
+    size_t cap = mNetwork.mOptions.maxUnpairedDevices;
+    if (!sweepExpired && !isOverCap()) {
+        return;
+    }
+
+    std::shared_ptr<const DeviceTable> table = mDevices.get();
+    std::vector<std::pair<int64_t, std::shared_ptr<BluetoothDevice>>> unpaired;
+    unpaired.reserve(table->size);
+    for (const std::shared_ptr<const DeviceTable::PathMap>& shard : table->byPath) {
+        for (const std::pair<const std::string, std::shared_ptr<BluetoothDevice>>& item : *shard) {
+            if (!item.second->isPinned()) {
+                unpaired.emplace_back(item.second->getLastSeen(), item.second);
+            }
+        }
+    }
 
-        message = mNetwork.createMethod(G_BT_SERVICE_NAME, device_path, G_INTERFACE_DBUS_PROP, G_METHOD_GET_ALL);
+    // Oldest first, expired ones lead the list
+    std::sort(unpaired.begin(), unpaired.end(), [](const std::pair<int64_t, std::shared_ptr<BluetoothDevice>>& a, const std::pair<int64_t, std::shared_ptr<BluetoothDevice>>& b) {
+        return a.first < b.first;
+    });
+    size_t expired = 0;
+    std::chrono::seconds ttl = mNetwork.mOptions.unpairedDeviceTtl;
+    if (sweepExpired && (ttl.count() > 0)) {
+        int64_t limit = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::steady_clock::now() - ttl).time_since_epoch()).count();
+        while ((expired < unpaired.size()) && (unpaired[expired].first < limit)) {
+            expired++;
+        }
+    }
+    size_t evicted = 0;
+    if ((cap > 0) && (unpaired.size() - expired > cap)) {
+        evicted = unpaired.size() - expired - (cap - cap / 8);
+    }
+    if (expired + evicted == 0) {
+        return;
+    }
 
-        dbus_message_append_args(message, DBUS_TYPE_STRING, &G_BT_INTERFACE_DEVICE1, DBUS_TYPE_INVALID);
+    std::vector<std::shared_ptr<BluetoothDevice>> victims;
+    victims.reserve(expired + evicted);
+    for (size_t i = 0; i < expired + evicted; i++) {
+        victims.push_back(std::move(unpaired[i].second));
+    }
+    removeDevices(victims);
+    mDevicesExpired.fetch_add(expired, std::memory_order_relaxed);
+    mDevicesEvicted.fetch_add(evicted, std::memory_order_relaxed);
+    NETWORK_LOG(Debug) << "Devices dropped" << logField("expired", expired) << logField("evicted", evicted);
+}
 
-        reply = dbus_connection_send_with_reply_and_block(conn, message, -1, &err);
-        dbus_message_unref(message);
+bool BluetoothAdapter::isOverCap() const
+{
+    size_t cap = mNetwork.mOptions.maxUnpairedDevices;
+    return (cap > 0) && (mUnpinnedDevices.load(std::memory_order_relaxed) > cap);
+}
 
-        if (dbus_error_is_set(&err)) {
-            std::cerr << "Error getting properties: " << err.message << std::endl;
-            dbus_error_free(&err);
-            return;
+/**
+ * A listed device got paired/connected (pinned) or lost both, called with the device locked.
+ * Unpinning past the cap wakes the action thread, which may otherwise sleep until the next sweep.
+ */
+void BluetoothAdapter::updatePinned(bool pinned)
+{
+    if (pinned) {
+        mUnpinnedDevices.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    mUnpinnedDevices.fetch_add(1, std::memory_order_relaxed);
+    if (isOverCap()) {
+        {
+            std::lock_guard<std::mutex> lock(mBluetoothActionMutex);
         }
-        std::string deviceName;
-        std::string deviceAddress;
-        std::vector<std::string> uuids;
-        if (nullptr != reply) {
-            if (dbus_message_iter_init(reply, &iter) && dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) {
-                dbus_message_iter_recurse(&iter, &dict_entry_iter);
-                while (dbus_message_iter_get_arg_type(&dict_entry_iter) == DBUS_TYPE_DICT_ENTRY) {
-
-                    DBusMessageIter dict_entry_key_iter, dict_entry_value_iter;
-                    dbus_message_iter_recurse(&dict_entry_iter, &dict_entry_key_iter);
-                    const char* property_name;
-                    dbus_message_iter_get_basic(&dict_entry_key_iter, &property_name);
-
-                    if (std::string(property_name) == "Name") {
-                        dbus_message_iter_next(&dict_entry_key_iter);
-                        dbus_message_iter_recurse(&dict_entry_key_iter, &dict_entry_value_iter);
-
-                        const char* device_name;
-                        dbus_message_iter_get_basic(&dict_entry_value_iter, &device_name);
-                        std::cout << "Device Name: " << device_name << std::endl;
-                        deviceName = std::string(device_name);
-                    }
-                    else if (std::string(property_name) == "Address") {
-                        dbus_message_iter_next(&dict_entry_key_iter);
-                        dbus_message_iter_recurse(&dict_entry_key_iter, &dict_entry_value_iter);
-
-                        const char* device_address;
-                        dbus_message_iter_get_basic(&dict_entry_value_iter, &device_address);
-                        std::cout << "Device address: " << device_address << std::endl;
-                        deviceAddress = std::string(device_address);
-                    }
-                    else if (std::string(property_name) == "Paired")
-                    {
-                        dbus_bool_t ret = FALSE;
-                        dbus_message_iter_next(&dict_entry_key_iter);
-                        dbus_message_iter_recurse(&dict_entry_key_iter, &dict_entry_value_iter);
-
-                        dbus_message_iter_get_basic(&dict_entry_value_iter, &ret);
-                        std::cout << "Device Paired: " << ret << std::endl;
-                    }
-                    else if (std::string(property_name) == "Bonded")
-                    {
-                        dbus_bool_t ret = FALSE;
-                        dbus_message_iter_next(&dict_entry_key_iter);
-                        dbus_message_iter_recurse(&dict_entry_key_iter, &dict_entry_value_iter);
-
-                        dbus_message_iter_get_basic(&dict_entry_value_iter, &ret);
-                        std::cout << "Device Bonded: " << ret << std::endl;
-                    }
-                    else if (std::string(property_name) == "Connected")
-                    {
-                        dbus_bool_t ret = FALSE;
-                        dbus_message_iter_next(&dict_entry_key_iter);
-                        dbus_message_iter_recurse(&dict_entry_key_iter, &dict_entry_value_iter);
-
-                        dbus_message_iter_get_basic(&dict_entry_value_iter, &ret);
-                        std::cout << "Device Connected: " << ret << std::endl;
-                    }
-                    else if (std::string(property_name) == "UUIDs")
-                    {
-                        dbus_message_iter_next(&dict_entry_key_iter);
-                        dbus_message_iter_recurse(&dict_entry_key_iter, &dict_entry_value_iter);
-                        
-                        if (dbus_message_iter_get_arg_type(&dict_entry_value_iter) == DBUS_TYPE_ARRAY) {
-                            DBusMessageIter uuid_iter;
-                            dbus_message_iter_recurse(&dict_entry_value_iter, &uuid_iter);
-                            std::cout << "UUIDs: " ;
-                            while (dbus_message_iter_get_arg_type(&uuid_iter) == DBUS_TYPE_STRING) {
-                                const char* uuid;
-                                dbus_message_iter_get_basic(&uuid_iter, &uuid);
-                                std::cout << BluetoothAdapter::getProfile(uuid) << " | ";
-                                uuids.emplace_back(std::string(uuid));
-                                dbus_message_iter_next(&uuid_iter);
-                            }
-                        }       
-                        std::cout << std::endl;
-                    }            
-                    else if (std::string(property_name) == "Adapter") {
-                        dbus_message_iter_next(&dict_entry_key_iter);
-                        dbus_message_iter_recurse(&dict_entry_key_iter, &dict_entry_value_iter);
-                        const char* adapter_path;
-                        dbus_message_iter_get_basic(&dict_entry_value_iter, &adapter_path);
-                        std::cout << "Adapter Path: " << adapter_path << std::endl;
-                    }
-                    else {
+        mBluetoothActionCV.notify_one();
+    }
+}
 
-                    }
-                    dbus_message_iter_next(&dict_entry_iter);
-                }
+uint64_t BluetoothAdapter::getDroppedDeviceInfos() const
+{
+    return mDeviceInfosQueue.getDropped();
+}
 
-                mDeviceInfosQueues.emplace_back(std::make_tuple(std::string(device_path),deviceName,deviceAddress, uuids));
-                mBluetoothActionCV.notify_all();
-            } else {
-                std::cerr << "Failed to initialize iterator or invalid response format\n";
-            }
-            dbus_message_unref(reply);
-        } else {
-            std::cerr << "Failed to get properties\n";
+void BluetoothAdapter::queueDeviceInfo(DeviceInfo&& info)
+{
+    // Runs on the reactor thread, which must never block: when the action thread lags, the oldest record goes
+    mDeviceInfosQueue.pushDropOldest(std::move(info));
+    mNetwork.mStats->recordDeviceInfoQueued(mDeviceInfosQueue.size());
+    {
+        // Pairs with the predicate check in bluetoothActionHandler so the notify cannot be lost
+        std::lock_guard<std::mutex> lock(mBluetoothActionMutex);
+    }
+    mBluetoothActionCV.notify_one();
+}
+
+void BluetoothAdapter::handleInterfacesAdded(DBusMessage* message)
+{
+    // Signature oa{sa{sv}}: the signal already carries every Device1 property, no GetAll needed
+    DBusMessageIter args;
+    ObjectPath devicePath;
+    if (!dbus_message_has_signature(message, "oa{sa{sv}}") || !dbus_message_iter_init(message, &args)) {
+        return;
+    }
+    DBusType<ObjectPath>::read(&args, devicePath);
+    if (0 != devicePath.value.compare(0, strlen(G_BT_OBJECT_PATH), G_BT_OBJECT_PATH)) {
+        NETWORK_LOG(Debug) << "Device found but not Bluetooth device" << logField("path", devicePath.value);
+        return;
+    }
+
+    dbus_message_iter_next(&args);
+    DBusMessageIter interfaces;
+    dbus_message_iter_recurse(&args, &interfaces);
+    while (dbus_message_iter_get_arg_type(&interfaces) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter interface;
+        std::string_view interfaceName;
+        dbus_message_iter_recurse(&interfaces, &interface);
+        DBusType<std::string_view>::read(&interface, interfaceName);
+        if (interfaceName == G_BT_INTERFACE_DEVICE1) {
+            dbus_message_iter_next(&interface);
+            DeviceDelta properties;
+            parseDeviceProperties(&interface, properties);
+            queueDeviceInfo(makeDeviceInfo(devicePath.value, std::move(properties)));
+            break;
         }
-    };
+        dbus_message_iter_next(&interfaces);
+    }
+}
 
-    DBusMessage *message;
-    DBusError err;
-    dbus_error_init(&err);
-    dbus_bus_add_match(mNetwork.mConnection, "type='signal',interface='org.freedesktop.DBus.ObjectManager',member='InterfacesAdded'", &err);
-    dbus_bus_add_match(mNetwork.mConnection, "type='signal',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged'", &err);
-    dbus_connection_flush(mNetwork.mConnection);
-    
-    if (dbus_error_is_set(&err)) {
-        std::cerr << "Match rule error: " << err.message << std::endl;
-        dbus_error_free(&err);
+/**
+ * Signature oas: bluetoothd dropped the object, prune the device right away whatever its state.
+ * An InterfacesAdded for the same path still waiting in the queue may bring it back, the TTL clears that.
+ */
+void BluetoothAdapter::handleInterfacesRemoved(DBusMessage* message)
+{
+    ObjectPath devicePath;
+    std::vector<std::string_view> interfaces;
+    if (!decodeMessage(message, devicePath, interfaces)) {
+        return;
+    }
+    if (std::find(interfaces.begin(), interfaces.end(), G_BT_INTERFACE_DEVICE1) == interfaces.end()) {
         return;
     }
+    std::shared_ptr<BluetoothDevice> device = findDevice(std::string(devicePath.value).c_str());
+    if (nullptr == device) {
+        return;
+    }
+    NETWORK_LOG(Debug) << "Device removed" << logField("path", devicePath.value);
+    removeDevices({device});
+    mDevicesRemoved.fetch_add(1, std::memory_order_relaxed);
+}
 
-    while (true) {
-        {
-            std::unique_lock<std::mutex> lock(mDiscoveringMutex);
-            mDiscoveringCV.wait(lock, [&]{
-                return mDiscovering;
+void BluetoothAdapter::handleDevicePropertiesChanged(DBusMessage* message)
+{
+    // Signature sa{sv}as: apply changed/invalidated properties to the known record, no GetAll needed
+    std::string_view interfaceName;
+    PropertyDict changed;
+    std::vector<std::string_view> invalidated;
+    if (!decodeMessage(message, interfaceName, changed, invalidated) || (interfaceName != G_BT_INTERFACE_DEVICE1)) {
+        return;
+    }
+
+    std::shared_ptr<BluetoothDevice> device = findDevice(dbus_message_get_path(message));
+    if (nullptr == device) {
+        return;
+    }
+
+    DeviceDelta delta;
+    parseDeviceProperties(&changed.iter, delta);
+    parseInvalidatedProperties(invalidated, delta);
+    NETWORK_LOG(Debug) << "Device properties changed" << logField("path", dbus_message_get_path(message));
+
+    // Advertisers repeat RSSI many times a second, only connection state changes are worth applying at once
+    std::chrono::milliseconds window = mNetwork.mOptions.devicePropertiesWindow;
+    bool immediate = (window.count() <= 0) || delta.paired.has_value() || delta.connected.has_value();
+    std::unordered_map<const BluetoothDevice*, PendingDelta>::iterator pending = mPendingDeltas.find(device.get());
+    if (pending != mPendingDeltas.end()) {
+        pending->second.delta.merge(std::move(delta));
+        mDevicePropertiesCoalesced.fetch_add(1, std::memory_order_relaxed);
+        if (!immediate) {
+            return;
+        }
+        // What waited goes out with the transition, nothing older can land after it
+        delta = std::move(pending->second.delta);
+        mPendingDeltas.erase(pending);
+    }
+    else if (!immediate) {
+        mPendingDeltas.emplace(device.get(), PendingDelta{device, std::move(delta)});
+        if (!mFlushScheduled) {
+            mFlushScheduled = true;
+            mNetwork.mSignalReactor->schedule(window, [this]() {
+                flushDeviceDeltas();
             });
         }
-        
+        return;
+    }
+    device->touch();
+    device->applyDelta(delta);
+}
 
-        dbus_connection_read_write(mNetwork.mConnection, 0);
-        message = dbus_connection_pop_message(mNetwork.mConnection);
+/**
+ * End of the coalescing window: one applyDelta per device however many signals it sent.
+ */
+void BluetoothAdapter::flushDeviceDeltas()
+{
+    mFlushScheduled = false;
+    for (std::pair<const BluetoothDevice* const, PendingDelta>& item : mPendingDeltas) {
+        item.second.device->touch();
+        item.second.device->applyDelta(item.second.delta);
+    }
+    mPendingDeltas.clear();
+}
 
-        if (message != nullptr) {
-            if (dbus_message_is_signal(message, "org.freedesktop.DBus.ObjectManager", "InterfacesAdded")) {
-                DBusMessageIter args;
-                dbus_message_iter_init(message, &args);
+void BluetoothAdapter::dumpDevicesUnpaired()
+{
+    std::shared_ptr<const DeviceTable> table = mDevices.get();
+    for (const std::shared_ptr<const DeviceTable::PathMap>& shard : table->byPath) {
+        for (const std::pair<const std::string, std::shared_ptr<BluetoothDevice>>& item : *shard) {
+            if (item.second->getStatus() == Status::Unpaired) {
+                item.second->dump();
+            }
+        }
+    }
+}
 
-                if (dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_OBJECT_PATH) {
-                    const char *device_path;
-                    dbus_message_iter_get_basic(&args, &device_path);
-                    static std::regex pattern("/org/bluez/");
-                    if (!std::regex_search(std::string(device_path), pattern)) {
-                        std::cout << "\nDevice found: " << device_path << " not Bluetooth device "<< std::endl;
-                        goto Unref;
-                    }
-                    {
-                        std::lock_guard<std::mutex> lock(mBluetoothActionMutex);
-                        getDeviceInfo(mNetwork.mConnection, device_path);
-                    }
-                }
-            } else if (dbus_message_is_signal(message, G_INTERFACE_DBUS_PROP, G_SIGNAL_PROPERTIES_CHANGED)) {
-                DBusMessageIter args;
-                dbus_message_iter_init(message, &args);
+void BluetoothAdapter::dumpDevicesPaired()
+{
+    std::shared_ptr<const DeviceTable> table = mDevices.get();
+    for (const std::shared_ptr<const DeviceTable::PathMap>& shard : table->byPath) {
+        for (const std::pair<const std::string, std::shared_ptr<BluetoothDevice>>& item : *shard) {
+            if (item.second->getStatus() >= Status::Disconnected) {
+                item.second->dump();
+            }
+        }
+    }
+}
 
-                const char *interface_name;
-                dbus_message_iter_get_basic(&args, &interface_name);
+std::shared_ptr<BluetoothDevice> BluetoothAdapter::getBluetoothDevice(const std::string& address)
+{
+    std::optional<uint64_t> key = parseAddress(address);
+    if (!key.has_value()) {
+        return nullptr;
+    }
 
-                if (0 == strcmp(interface_name, G_BT_INTERFACE_DEVICE1)) {
-                    std::cout << "\nDevice properties changed!" << std::endl;
-                    const char *device_path = dbus_message_get_path(message);
-                    getDeviceInfo(mNetwork.mConnection, device_path);
-                }
+    return mDevices.read([&key](const DeviceTable& table) {
+        return table.findAddress(key.value());
+    });
+}
+
+/**
+ * Pack "AA:BB:CC:DD:EE:FF" (any case) into the low 48 bits, std::nullopt when malformed.
+ */
+std::optional<uint64_t> BluetoothAdapter::parseAddress(const std::string& address)
+{
+    static constexpr size_t G_ADDRESS_LENGTH = 17;
+    if (address.size() != G_ADDRESS_LENGTH) {
+        return std::nullopt;
+    }
+
+    uint64_t ret = 0;
+    for (size_t i = 0; i < G_ADDRESS_LENGTH; i++) {
+        char c = address[i];
+        if ((i % 3) == 2) {
+            if (c != ':') {
+                return std::nullopt;
             }
-Unref:
-            dbus_message_unref(message);
+            continue;
+        }
 
-        } else {
-            usleep(200000);
+        uint64_t nibble = 0;
+        if ((c >= '0') && (c <= '9')) {
+            nibble = c - '0';
+        }
+        else if ((c >= 'a') && (c <= 'f')) {
+            nibble = c - 'a' + 10;
+        }
+        else if ((c >= 'A') && (c <= 'F')) {
+            nibble = c - 'A' + 10;
         }
+        else {
+            return std::nullopt;
+        }
+        ret = (ret << 4) | nibble;
     }
+    return ret;
 }
 
-void BluetoothAdapter::dumpDevicesUnpaired()
+DeviceTable::DeviceTable()
 {
-    std::unordered_map<std::string, std::shared_ptr<BluetoothDevice>>::iterator item = mDevicesTable.begin();
-    while (item != mDevicesTable.end())
-    {
-        if (item->second->getStatus() == Status::Unpaired) {
-            item->second->dump();
+    for (size_t i = 0; i < G_DEVICE_TABLE_SHARDS; i++) {
+        byPath[i] = std::make_shared<const PathMap>();
+        byAddress[i] = std::make_shared<const AddressMap>();
+    }
+}
+
+std::shared_ptr<BluetoothDevice> DeviceTable::findPath(const std::string& devicePath) const
+{
+    const PathMap& shard = *byPath[pathShard(devicePath)];
+    PathMap::const_iterator item = shard.find(devicePath);
+    return (item != shard.end()) ? item->second : nullptr;
+}
+
+std::shared_ptr<BluetoothDevice> DeviceTable::findAddress(uint64_t address) const
+{
+    const AddressMap& shard = *byAddress[addressShard(address)];
+    AddressMap::const_iterator item = shard.find(address);
+    return (item != shard.end()) ? item->second : nullptr;
+}
+
+size_t DeviceTable::pathShard(const std::string& devicePath)
+{
+    return std::hash<std::string>()(devicePath) % G_DEVICE_TABLE_SHARDS;
+}
+
+/**
+ * The low bytes of a MAC are the device specific part, fold the vendor prefix in anyway.
+ */
+size_t DeviceTable::addressShard(uint64_t address)
+{
+    return (address ^ (address >> 24)) % G_DEVICE_TABLE_SHARDS;
+}
+
+/**
+ * Publish a table without devices, each touched shard copied once. The MAC index entry only goes
+ * when it still points at the removed record.
+ */
+void BluetoothAdapter::removeDevices(const std::vector<std::shared_ptr<BluetoothDevice>>& devices)
+{
+    std::lock_guard<std::mutex> lock(mDevicesMutex);
+    std::shared_ptr<DeviceTable> table = std::make_shared<DeviceTable>(*mDevices.get());
+    std::array<std::shared_ptr<DeviceTable::PathMap>, G_DEVICE_TABLE_SHARDS> paths;
+    std::array<std::shared_ptr<DeviceTable::AddressMap>, G_DEVICE_TABLE_SHARDS> addresses;
+    for (const std::shared_ptr<BluetoothDevice>& device : devices) {
+        size_t pathShard = DeviceTable::pathShard(device->mDevicePath);
+        DeviceTable::PathMap::const_iterator item = table->byPath[pathShard]->find(device->mDevicePath);
+        if ((item == table->byPath[pathShard]->end()) || (item->second != device)) {
+            continue;
+        }
+        if (nullptr == paths[pathShard]) {
+            paths[pathShard] = std::make_shared<DeviceTable::PathMap>(*table->byPath[pathShard]);
+            table->byPath[pathShard] = paths[pathShard];
         }
-        item++;
-    }    
+        paths[pathShard]->erase(device->mDevicePath);
+        table->size--;
+        {
+            std::unique_lock<std::shared_mutex> deviceLock(device->mMutex);
+            device->mListed = false;
+            if (device->mState == Status::Unpaired) {
+                mUnpinnedDevices.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        std::optional<uint64_t> key = parseAddress(device->mDeviceAddress);
+        if (!key.has_value()) {
+            continue;
+        }
+        size_t addressShard = DeviceTable::addressShard(key.value());
+        if (table->findAddress(key.value()) != device) {
+            continue;
+        }
+        if (nullptr == addresses[addressShard]) {
+            addresses[addressShard] = std::make_shared<DeviceTable::AddressMap>(*table->byAddress[addressShard]);
+            table->byAddress[addressShard] = addresses[addressShard];
+        }
+        addresses[addressShard]->erase(key.value());
+    }
+    mDevices.publish(std::move(table));
 }
 
-void BluetoothAdapter::dumpDevicesPaired()
+void BluetoothAdapter::getDeviceStats(NetworkProvider::Stats& stats) const
 {
-    std::unordered_map<std::string, std::shared_ptr<BluetoothDevice>>::iterator item = mDevicesTable.begin();
-    while (item != mDevicesTable.end())
-    {
-        if (item->second->getStatus() >= Status::Disconnected) {
-            item->second->dump();
+    // Hash nodes: the value, the next pointer, the cached hash, plus one bucket slot per element
+    static constexpr size_t G_PATH_NODE_SIZE = sizeof(DeviceTable::PathMap::value_type) + 3 * sizeof(void*);
+    static constexpr size_t G_ADDRESS_NODE_SIZE = sizeof(DeviceTable::AddressMap::value_type) + 2 * sizeof(void*);
+    std::shared_ptr<const DeviceTable> table = mDevices.get();
+    uint64_t memory = 0;
+    uint64_t pinned = 0;
+    for (const std::shared_ptr<const DeviceTable::PathMap>& shard : table->byPath) {
+        for (const std::pair<const std::string, std::shared_ptr<BluetoothDevice>>& item : *shard) {
+            memory += item.second->getMemoryUsage() + G_PATH_NODE_SIZE + G_ADDRESS_NODE_SIZE;
+            if (item.first.capacity() > std::string().capacity()) {
+                memory += item.first.capacity() + 1;
+            }
+            if (item.second->isPinned()) {
+                pinned++;
+            }
         }
-        item++;
-    }    
+    }
+    stats.deviceCount = table->size;
+    stats.pinnedDeviceCount = pinned;
+    stats.deviceMemoryBytes = memory;
+    stats.bytesPerDevice = (table->size > 0) ? (memory / table->size) : 0;
+    stats.devicesEvicted = mDevicesEvicted.load(std::memory_order_relaxed);
+    stats.devicesExpired = mDevicesExpired.load(std::memory_order_relaxed);
+    stats.devicesRemoved = mDevicesRemoved.load(std::memory_order_relaxed);
+    stats.devicePropertiesCoalesced = mDevicePropertiesCoalesced.load(std::memory_order_relaxed);
 }
 
-std::shared_ptr<BluetoothDevice> BluetoothAdapter::getBluetoothDevice(const std::string& address)
+/**
+ * Publish a table with infos added to both indexes, records of paths already known are refreshed instead.
+ * Each touched shard is copied once per batch, readers keep using the previous snapshot meanwhile.
+ */
+void BluetoothAdapter::insertDevices(std::vector<DeviceInfo>&& infos)
 {
-    std::unordered_map<std::string, std::shared_ptr<BluetoothDevice>>::iterator foundedItem = mDevicesTable.begin();
-    while (foundedItem != mDevicesTable.end())
-    {
-        if (foundedItem->second->getDeviceAddress() == address) {
-            return foundedItem->second;
+    std::lock_guard<std::mutex> lock(mDevicesMutex);
+    std::shared_ptr<DeviceTable> table = std::make_shared<DeviceTable>(*mDevices.get());
+    std::array<std::shared_ptr<DeviceTable::PathMap>, G_DEVICE_TABLE_SHARDS> paths;
+    std::array<std::shared_ptr<DeviceTable::AddressMap>, G_DEVICE_TABLE_SHARDS> addresses;
+    for (DeviceInfo& info : infos) {
+        size_t pathShard = DeviceTable::pathShard(info.devicePath);
+        if (nullptr == paths[pathShard]) {
+            paths[pathShard] = std::make_shared<DeviceTable::PathMap>(*table->byPath[pathShard]);
+            table->byPath[pathShard] = paths[pathShard];
+        }
+        DeviceTable::PathMap::iterator known = paths[pathShard]->find(info.devicePath);
+        if (known != paths[pathShard]->end()) {
+            // Announced twice within one batch, the later dictionary wins
+            known->second->applyDelta(makeDeviceDelta(std::move(info)));
+            continue;
+        }
+
+        std::shared_ptr<BluetoothDevice> device(new BluetoothDevice(*this, std::move(info)));
+        paths[pathShard]->emplace(device->mDevicePath, device);
+        table->size++;
+        // Not visible to anyone yet, no lock needed
+        device->mListed = true;
+        if (device->mState == Status::Unpaired) {
+            mUnpinnedDevices.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::optional<uint64_t> key = parseAddress(device->mDeviceAddress);
+        if (key.has_value()) {
+            size_t addressShard = DeviceTable::addressShard(key.value());
+            if (nullptr == addresses[addressShard]) {
+                addresses[addressShard] = std::make_shared<DeviceTable::AddressMap>(*table->byAddress[addressShard]);
+                table->byAddress[addressShard] = addresses[addressShard];
+            }
+            (*addresses[addressShard])[key.value()] = device;
         }
-        foundedItem++;
     }
-    return nullptr;
+    mDevices.publish(std::move(table));
 }
 
-void BluetoothAdapter::disconnectBluetooth(const std::string& address)
+void BluetoothAdapter::disconnectBluetooth(const std::string& address, const CallOptions& options)
 {
     std::shared_ptr<BluetoothDevice> device = getBluetoothDevice(address);
     if (nullptr == device) {
-        std::cout << "Not found device : " << address << '\n';
+        NETWORK_LOG(Warn) << "Not found device" << logField("address", address);
         return;
     }
-    device->disconnect();
+    device->disconnect(options);
 }
 
-void BluetoothAdapter::connectProfile(const std::string& address, const std::string& profile)
+void BluetoothAdapter::connectProfile(const std::string& address, const std::string& profile, const CallOptions& options)
 {
     std::shared_ptr<BluetoothDevice> device = getBluetoothDevice(address);
     if (nullptr == device) {
-        std::cout << "Not found device : " << address << '\n';
+        NETWORK_LOG(Warn) << "Not found device" << logField("address", address);
         return;
     }
-    device->connectProfile(profile);
+    device->connectProfile(profile, options);
 }
 
-void BluetoothAdapter::disconnectProfile(const std::string& address, const std::string& profile)
+void BluetoothAdapter::disconnectProfile(const std::string& address, const std::string& profile, const CallOptions& options)
 {
     std::shared_ptr<BluetoothDevice> device = getBluetoothDevice(address);
     if (nullptr == device) {
-        std::cout << "Not found device : " << address << '\n';
+        NETWORK_LOG(Warn) << "Not found device" << logField("address", address);
         return;
     }
-    device->disconnectProfile(profile);
+    device->disconnectProfile(profile, options);
+}
+
+std::future<bool> BluetoothAdapter::connectProfileAsync(const std::string& address, const std::string& profile, const CallOptions& options)
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    connectProfileAsync(address, profile, [promise](bool success) {
+        promise->set_value(success);
+    }, options);
+    return promise->get_future();
+}
+
+void BluetoothAdapter::connectProfileAsync(const std::string& address, const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options)
+{
+    std::shared_ptr<BluetoothDevice> device = getBluetoothDevice(address);
+    if (nullptr == device) {
+        NETWORK_LOG(Warn) << "Not found device" << logField("address", address);
+        callback(false);
+        return;
+    }
+    device->connectProfileAsync(profile, std::move(callback), options);
+}
+
+std::future<bool> BluetoothAdapter::disconnectProfileAsync(const std::string& address, const std::string& profile, const CallOptions& options)
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    disconnectProfileAsync(address, profile, [promise](bool success) {
+        promise->set_value(success);
+    }, options);
+    return promise->get_future();
+}
+
+void BluetoothAdapter::disconnectProfileAsync(const std::string& address, const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options)
+{
+    std::shared_ptr<BluetoothDevice> device = getBluetoothDevice(address);
+    if (nullptr == device) {
+        NETWORK_LOG(Warn) << "Not found device" << logField("address", address);
+        callback(false);
+        return;
+    }
+    device->disconnectProfileAsync(profile, std::move(callback), options);
+}
+
+std::future<bool> BluetoothAdapter::disconnectBluetoothAsync(const std::string& address, const CallOptions& options)
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    disconnectBluetoothAsync(address, [promise](bool success) {
+        promise->set_value(success);
+    }, options);
+    return promise->get_future();
+}
+
+void BluetoothAdapter::disconnectBluetoothAsync(const std::string& address, NetworkProvider::CompletionCallback callback, const CallOptions& options)
+{
+    std::shared_ptr<BluetoothDevice> device = getBluetoothDevice(address);
+    if (nullptr == device) {
+        NETWORK_LOG(Warn) << "Not found device" << logField("address", address);
+        callback(false);
+        return;
+    }
+    device->disconnectAsync(std::move(callback), options);
+}
+
+struct BluetoothAdapter::BulkOperation
+{
+    bool isConnect = true;
+    CallOptions options;
+    size_t maxConcurrent = 0;
+    std::vector<NetworkProvider::ProfileResult> results;
+    std::promise<std::vector<NetworkProvider::ProfileResult>> promise;
+
+    std::mutex mutex;
+    size_t next = 0;
+    size_t inFlight = 0;
+    size_t completed = 0;
+    bool pumping = false; // One thread at a time starts calls, the others only free slots
+};
+
+std::future<std::vector<NetworkProvider::ProfileResult>> BluetoothAdapter::connectProfilesAsync(const std::vector<NetworkProvider::ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options)
+{
+    return runBulk(true, requests, maxConcurrent, options);
+}
+
+std::future<std::vector<NetworkProvider::ProfileResult>> BluetoothAdapter::disconnectProfilesAsync(const std::vector<NetworkProvider::ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options)
+{
+    return runBulk(false, requests, maxConcurrent, options);
+}
+
+/**
+ * Fan requests out as concurrent pending calls. Each completion frees a slot and starts the next
+ * request from whichever thread delivered it, the last one fulfils the future.
+ */
+std::future<std::vector<NetworkProvider::ProfileResult>> BluetoothAdapter::runBulk(bool isConnect, const std::vector<NetworkProvider::ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options)
+{
+    std::shared_ptr<BulkOperation> bulk = std::make_shared<BulkOperation>();
+    bulk->isConnect = isConnect;
+    bulk->options = options;
+    bulk->maxConcurrent = (0 == maxConcurrent) ? requests.size() : maxConcurrent;
+    bulk->results.reserve(requests.size());
+    for (const NetworkProvider::ProfileRequest& request : requests) {
+        NetworkProvider::ProfileResult result;
+        result.address = request.address;
+        result.profile = request.profile;
+        bulk->results.push_back(std::move(result));
+    }
+
+    std::future<std::vector<NetworkProvider::ProfileResult>> ret = bulk->promise.get_future();
+    if (requests.empty()) {
+        bulk->promise.set_value(std::vector<NetworkProvider::ProfileResult>());
+        return ret;
+    }
+    pumpBulk(bulk);
+    return ret;
+}
+
+void BluetoothAdapter::pumpBulk(const std::shared_ptr<BulkOperation>& bulk)
+{
+    {
+        std::lock_guard<std::mutex> lock(bulk->mutex);
+        if (bulk->pumping) {
+            return;
+        }
+        bulk->pumping = true;
+    }
+
+    while (true) {
+        size_t index = 0;
+        {
+            std::lock_guard<std::mutex> lock(bulk->mutex);
+            if ((bulk->next >= bulk->results.size()) || (bulk->inFlight >= bulk->maxConcurrent)) {
+                bulk->pumping = false;
+                return;
+            }
+            index = bulk->next++;
+            bulk->inFlight++;
+        }
+
+        // address and profile are never written after runBulk, only success is
+        const std::string& address = bulk->results[index].address;
+        const std::string& profile = bulk->results[index].profile;
+        NetworkProvider::CompletionCallback done = [this, bulk, index](bool success) {
+            finishBulkItem(bulk, index, success);
+        };
+
+        std::shared_ptr<BluetoothDevice> device = getBluetoothDevice(address);
+        if (nullptr == device) {
+            NETWORK_LOG(Warn) << "Not found device" << logField("address", address);
+            done(false);
+        }
+        else if (bulk->isConnect) {
+            device->callProfileMethod(G_METHOD_CONNECT_PROFILE, profile, std::move(done), bulk->options);
+        }
+        else if (profile.empty()) {
+            device->callMethod(G_METHOD_DISCONNECT, nullptr, std::move(done), bulk->options);
+        }
+        else {
+            device->callProfileMethod(G_METHOD_DISCONNECT_PROFILE, profile, std::move(done), bulk->options);
+        }
+    }
+}
+
+void BluetoothAdapter::finishBulkItem(const std::shared_ptr<BulkOperation>& bulk, size_t index, bool success)
+{
+    std::vector<NetworkProvider::ProfileResult> results;
+    {
+        std::lock_guard<std::mutex> lock(bulk->mutex);
+        bulk->results[index].success = success;
+        bulk->inFlight--;
+        bulk->completed++;
+        if (bulk->completed == bulk->results.size()) {
+            // Every request was started already, a racing pumpBulk() sees an empty batch and stops
+            results.swap(bulk->results);
+        }
+    }
+
+    if (!results.empty()) {
+        bulk->promise.set_value(std::move(results));
+        return;
+    }
+    pumpBulk(bulk);
 }
 
 /*========================================================================================================*/
-BluetoothDevice::BluetoothDevice(BluetoothAdapter& adapter, const std::string& deviceName, const std::string& deviceAddress, const std::string& devicePath ,const std::vector<std::string>& uuids) : mAdapter(adapter), 
-                                                                                                                                                                                                     mDeviceName(deviceName),
-                                                                                                                                                                                                     mDeviceAddress(deviceAddress),
-                                                                                                                                                                                                     mDevicePath(devicePath),
-                                                                                                                                                                                                     mUUIDs(uuids)
+BluetoothDevice::BluetoothDevice(BluetoothAdapter& adapter, DeviceInfo&& info) : mAdapter(adapter),
+                                                                                 mUUIDs(std::move(info.uuids)),
+                                                                                 mDeviceName(std::move(info.deviceName)),
+                                                                                 mDeviceAddress(std::move(info.deviceAddress)),
+                                                                                 mDevicePath(std::move(info.devicePath)),
+                                                                                 mState(BluetoothAdapter::getStatus(info)),
+                                                                                 mPaired(info.paired),
+                                                                                 mRSSI(info.rssi),
+                                                                                 mLastSeen(0),
+                                                                                 mListed(false)
+{
+    touch();
+}
+
+bool BluetoothDevice::isPinned() const
+{
+    return getStatus() != Status::Unpaired;
+}
+
+int64_t BluetoothDevice::getLastSeen() const
+{
+    return mLastSeen.load(std::memory_order_relaxed);
+}
+
+void BluetoothDevice::touch()
 {
+    mLastSeen.store(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+}
 
+size_t BluetoothDevice::getMemoryUsage() const
+{
+    // A shared_ptr built from new allocates its control block separately
+    static constexpr size_t G_CONTROL_BLOCK_SIZE = 3 * sizeof(void*);
+    std::function<size_t(const std::string&)> heap = [](const std::string& value) -> size_t {
+        return (value.capacity() > std::string().capacity()) ? (value.capacity() + 1) : 0;
+    };
+    std::shared_lock<std::shared_mutex> lock(mMutex);
+    return sizeof(BluetoothDevice) + G_CONTROL_BLOCK_SIZE + heap(mDeviceName) + heap(mDeviceAddress) + heap(mDevicePath) +
+           mUUIDs.capacity() * sizeof(BluetoothUuid);
 }
 
 std::string BluetoothDevice::getDeviceName() const
@@ -847,7 +1538,7 @@ Status BluetoothDevice::getStatus() const
     return mState;
 }
 
-std::vector<std::string> BluetoothDevice::getUUIDs() const
+std::vector<BluetoothUuid> BluetoothDevice::getUUIDs() const
 {
     std::lock_guard<std::shared_mutex> lock(mMutex);
     return mUUIDs;
@@ -863,244 +1554,193 @@ void BluetoothDevice::destroyBond()
 
 }
 
-void BluetoothDevice::connectProfile(const std::string& profile)
+bool BluetoothDevice::callProfileMethod(const char* method, const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options)
 {
-    DBusError err;
-    std::string uuid = "";
-    static std::function<std::string(std::string)> upperCase = [](std::string letter) -> std::string {
-        std::transform(letter.begin(), letter.end(), letter.begin(), [](unsigned char c){
-            if (c >= 'a' && c <= 'z') {
-                return std::toupper(static_cast<int>(c));
-            }
-            return static_cast<int>(c);
-        });
-        return letter;
-    };
-    std::unordered_map<std::string, std::string>::iterator foundedItem = BluetoothAdapter::gProfileMap.begin();
-    while (foundedItem != BluetoothAdapter::gProfileMap.end())
-    {
-        if (upperCase(foundedItem->second) == upperCase(profile)) {
-            uuid = foundedItem->first;
-            break;
-        }
-        foundedItem ++;
-    }
-    
-    if (uuid.empty()) {
-        std::cout << "Invalid profile request\n";
-        return;
-    }
-  
-    DBusMessage *message = dbus_message_new_method_call(
-        "org.bluez",
-        mDevicePath.c_str(),
-        "org.bluez.Device1",
-        "ConnectProfile"
-    );
-
-    if (nullptr == message) {
-        std::cerr << "Failed to create DBus message." << std::endl;
-        return;
+    const ProfileEntry* entry = findProfileByName(profile);
+    if (nullptr == entry) {
+        NETWORK_LOG(Warn) << "Invalid profile request" << logField("profile", profile);
+        callback(false);
+        return false;
     }
 
-    DBusMessageIter args;
-    dbus_message_iter_init_append(message, &args);
-    if (!dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &uuid)) {
-        std::cerr << "Failed to append UUID to DBus message." << std::endl;
-        dbus_message_unref(message);
-        return;
-    }
+    char uuid[BluetoothUuid::G_STRING_LENGTH + 1];
+    entry->uuid.toChars(uuid);
+    return callMethod(method, uuid, std::move(callback), options);
+}
 
-    DBusPendingCall *pending = nullptr;
-    if (!dbus_connection_send_with_reply(mAdapter.mNetwork.mConnection, message, &pending, -1)) {
-        std::cerr << "Failed to send DBus message." << std::endl;
-        dbus_message_unref(message);
-        return;
-    }
+bool BluetoothDevice::callMethod(const char* method, const char* argument, NetworkProvider::CompletionCallback callback, const CallOptions& options)
+{
+    DBusMessage *message = (nullptr != argument) ? newMethodCall(G_BT_SERVICE_NAME, mDevicePath.c_str(), G_BT_INTERFACE_DEVICE1, method, argument)
+                                                 : newMethodCall(G_BT_SERVICE_NAME, mDevicePath.c_str(), G_BT_INTERFACE_DEVICE1, method);
 
-    if (nullptr == pending) {
-        std::cerr << "Failed to create pending call for DBus message." << std::endl;
-        dbus_message_unref(message);
-        return;
+    if (nullptr == message) {
+        NETWORK_LOG(Error) << "Failed to create DBus message" << logField("method", method);
+        callback(false);
+        return false;
     }
 
+    bool ret = mAdapter.mNetwork.sendWithReply(message, [callback](DBusMessage* reply) {
+        if (nullptr == reply) {
+            NETWORK_LOG(Warn) << "Failed to get reply from DBus";
+            callback(false);
+            return;
+        }
 
-    dbus_connection_flush(mAdapter.mNetwork.mConnection);
+        if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+            NETWORK_LOG(Warn) << "Error in DBus reply" << logField("error", dbus_message_get_error_name(reply));
+            callback(false);
+            return;
+        }
+        callback(true);
+    }, options);
     dbus_message_unref(message);
+    return ret;
+}
 
-    dbus_pending_call_block(pending);
-    DBusMessage *reply = dbus_pending_call_steal_reply(pending);
-    dbus_pending_call_unref(pending);
-
-    if (nullptr == reply) {
-        std::cerr << "Failed to get reply from DBus." << std::endl;
-        return;
+void BluetoothDevice::connectProfile(const std::string& profile, const CallOptions& options)
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+    // Completes on reply, on the call's own timeout or on cancel, so this wait is bounded by options
+    callProfileMethod(G_METHOD_CONNECT_PROFILE, profile, [promise](bool success) {
+        promise->set_value(success);
+    }, options);
+
+    if (future.get()) {
+        NETWORK_LOG(Info) << "Connected to Bluetooth profile successfully" << logField("profile", profile);
     }
+}
 
-    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
-        std::cerr << "Error in DBus reply: " << dbus_message_get_error_name(reply) << std::endl;
-        dbus_message_unref(reply);
-        return;
+void BluetoothDevice::disconnectProfile(const std::string& profile, const CallOptions& options)
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+    callProfileMethod(G_METHOD_DISCONNECT_PROFILE, profile, [promise](bool success) {
+        promise->set_value(success);
+    }, options);
+
+    if (future.get()) {
+        NETWORK_LOG(Info) << "Disconnected to Bluetooth profile successfully" << logField("profile", profile);
     }
-
-    std::cout << "Connected to Bluetooth profile successfully!" << std::endl;
-    dbus_message_unref(reply);
-    return;
 }
 
-void BluetoothDevice::disconnectProfile(const std::string& profile)
+void BluetoothDevice::disconnect(const CallOptions& options)
 {
-    DBusError err;
-    dbus_error_init(&err);
-    std::string uuid = "";
-    static std::function<std::string(std::string)> upperCase = [](std::string letter) -> std::string {
-        std::transform(letter.begin(), letter.end(), letter.begin(), [](unsigned char c){
-            if (c >= 'a' && c <= 'z') {
-                return std::toupper(static_cast<int>(c));
-            }
-            return static_cast<int>(c);
-        });
-        return letter;
-    };
-
-    std::unordered_map<std::string, std::string>::iterator foundedItem = BluetoothAdapter::gProfileMap.begin();
-    while (foundedItem != BluetoothAdapter::gProfileMap.end())
-    {
-        if (upperCase(foundedItem->second) == upperCase(profile)) {
-            uuid = foundedItem->first;
-            break;
-        }
-        foundedItem ++;
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+    callMethod(G_METHOD_DISCONNECT, nullptr, [promise](bool success) {
+        promise->set_value(success);
+    }, options);
+
+    if (future.get()) {
+        NETWORK_LOG(Info) << "Disconnected Bluetooth device successfully" << logField("address", mDeviceAddress);
     }
-    
-    if (uuid.empty()) {
-        std::cout << "Invalid profile request\n";
-        return;
-    }
-    
-    
-    DBusMessage *message = dbus_message_new_method_call(
-        "org.bluez",
-        mDevicePath.c_str(),
-        "org.bluez.Device1",
-        "DisconnectProfile"
-    );
+}
 
-    if (nullptr == message) {
-        std::cerr << "Failed to create DBus message." << std::endl;
-        return;
-    }
+std::future<bool> BluetoothDevice::connectProfileAsync(const std::string& profile, const CallOptions& options)
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    connectProfileAsync(profile, [promise](bool success) {
+        promise->set_value(success);
+    }, options);
+    return promise->get_future();
+}
 
-    DBusMessageIter args;
-    dbus_message_iter_init_append(message, &args);
-    if (!dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &uuid)) {
-        std::cerr << "Failed to append UUID to DBus message." << std::endl;
-        dbus_message_unref(message);
-        return;
-    }
+void BluetoothDevice::connectProfileAsync(const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options)
+{
+    callProfileMethod(G_METHOD_CONNECT_PROFILE, profile, std::move(callback), options);
+}
 
-    DBusPendingCall *pending = nullptr;
-    if (!dbus_connection_send_with_reply(mAdapter.mNetwork.mConnection, message, &pending, -1)) {
-        std::cerr << "Failed to send DBus message." << std::endl;
-        dbus_message_unref(message);
-        return;
-    }
-    if (nullptr == pending) {
-        std::cerr << "Failed to create pending call for DBus message." << std::endl;
-        dbus_message_unref(message);
-        return;
-    }
+std::future<bool> BluetoothDevice::disconnectProfileAsync(const std::string& profile, const CallOptions& options)
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    disconnectProfileAsync(profile, [promise](bool success) {
+        promise->set_value(success);
+    }, options);
+    return promise->get_future();
+}
 
+void BluetoothDevice::disconnectProfileAsync(const std::string& profile, NetworkProvider::CompletionCallback callback, const CallOptions& options)
+{
+    callProfileMethod(G_METHOD_DISCONNECT_PROFILE, profile, std::move(callback), options);
+}
 
-    dbus_connection_flush(mAdapter.mNetwork.mConnection);
-    dbus_message_unref(message);
+std::future<bool> BluetoothDevice::disconnectAsync(const CallOptions& options)
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    disconnectAsync([promise](bool success) {
+        promise->set_value(success);
+    }, options);
+    return promise->get_future();
+}
 
-    dbus_pending_call_block(pending);
-    DBusMessage *reply = dbus_pending_call_steal_reply(pending);
-    dbus_pending_call_unref(pending);
+void BluetoothDevice::disconnectAsync(NetworkProvider::CompletionCallback callback, const CallOptions& options)
+{
+    callMethod(G_METHOD_DISCONNECT, nullptr, std::move(callback), options);
+}
 
-    if (nullptr == reply) {
-        std::cerr << "Failed to get reply from DBus." << std::endl;
+void BluetoothDevice::dump()
+{
+    if (!Logger::isEnabled(LogLevel::Info)) {
         return;
     }
-
-    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
-        std::cerr << "Error in DBus reply: " << dbus_message_get_error_name(reply) << std::endl;
-        dbus_message_unref(reply);
-        return;
+    // applyDelta() reassigns these on the signal reactor thread
+    std::shared_lock<std::shared_mutex> lock(mMutex);
+    LogLine line(LogLevel::Info);
+    line << "Device" << logField("address", mDeviceAddress) << logField("name", mDeviceName)
+         << logField("path", mDevicePath) << logField("status", statusName(mState)) << " uuids=";
+    for (size_t i = 0; i < mUUIDs.size(); i++) {
+        line << BluetoothAdapter::getProfile(mUUIDs[i]) << '|';
     }
-
-    std::cout << "Disconnected to Bluetooth profile successfully!" << std::endl;
-    dbus_message_unref(reply);
-    return;
 }
 
-void BluetoothDevice::disconnect()
+int16_t BluetoothDevice::getRSSI() const
 {
-    DBusError err;
-    dbus_error_init(&err);
-   
-    DBusMessage *message = dbus_message_new_method_call(
-        "org.bluez",
-        mDevicePath.c_str(),
-        "org.bluez.Device1",
-        "Disconnect"
-    );
+    std::shared_lock<std::shared_mutex> lock(mMutex);
+    return mRSSI;
+}
 
-    if (nullptr == message) {
-        std::cerr << "Failed to create DBus message." << std::endl;
-        return;
+/**
+ * Apply a PropertiesChanged delta field by field, Status follows the Paired/Connected transitions.
+ */
+void BluetoothDevice::applyDelta(const DeviceDelta& delta)
+{
+    std::unique_lock<std::shared_mutex> lock(mMutex);
+    bool wasPinned = (mState != Status::Unpaired);
+    if (delta.deviceName.has_value()) {
+        mDeviceName = delta.deviceName.value();
     }
-
-    DBusPendingCall *pending = nullptr;
-    if (!dbus_connection_send_with_reply(mAdapter.mNetwork.mConnection, message, &pending, -1)) {
-        std::cerr << "Failed to send DBus message." << std::endl;
-        dbus_message_unref(message);
-        return;
+    if (delta.uuids.has_value()) {
+        mUUIDs = delta.uuids.value();
     }
-    if (nullptr == pending) {
-        std::cerr << "Failed to create pending call for DBus message." << std::endl;
-        dbus_message_unref(message);
-        return;
+    if (delta.rssi.has_value()) {
+        mRSSI = delta.rssi.value();
     }
-
-
-    dbus_connection_flush(mAdapter.mNetwork.mConnection);
-    dbus_message_unref(message);
-
-    dbus_pending_call_block(pending);
-    DBusMessage *reply = dbus_pending_call_steal_reply(pending);
-    dbus_pending_call_unref(pending);
-
-    if (nullptr == reply) {
-        std::cerr << "Failed to get reply from DBus." << std::endl;
-        return;
+    if (delta.paired.has_value()) {
+        mPaired = delta.paired.value();
+        if (mState != Status::Connected) {
+            mState = mPaired ? Status::Disconnected : Status::Unpaired;
+        }
     }
-
-    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
-        std::cerr << "Error in DBus reply: " << dbus_message_get_error_name(reply) << std::endl;
-        dbus_message_unref(reply);
-        return;
+    if (delta.connected.has_value()) {
+        if (delta.connected.value()) {
+            mState = Status::Connected;
+        }
+        else {
+            mState = mPaired ? Status::Disconnected : Status::Unpaired;
+        }
     }
-
-    std::cout << "Disconnected to Bluetooth profile successfully!" << std::endl;
-    dbus_message_unref(reply);
-    return;
-}
-
-void BluetoothDevice::dump()
-{
-    std::cout << "\n Device : " << mDeviceAddress << "\n\t Name: " << mDeviceName 
-                                                  << "\n\t DevicePath: " << mDevicePath
-                                                  << "\n\t Status: " << mState
-                                                  << "\n\t UUIDs: ";
-    for (int i = 0; i < mUUIDs.size(); i++) {
-        std::cout << BluetoothAdapter::getProfile(mUUIDs[i]) << " | " ;
+    if (mListed && (wasPinned != (mState != Status::Unpaired))) {
+        mAdapter.updatePinned(!wasPinned);
     }
 }
 
 void BluetoothDevice::setStatus(const Status& state)
 {
     std::unique_lock<std::shared_mutex> lock(mMutex);
+    bool wasPinned = (mState != Status::Unpaired);
     mState = state;
+    if (mListed && (wasPinned != (mState != Status::Unpaired))) {
+        mAdapter.updatePinned(!wasPinned);
+    }
 }
@@ -0,0 +1,317 @@
+#include "DBusDispatcher.h"
+#include "Hash.h"
+#include "Logger.h"
+#include <cstring>
+#include <stdexcept>
+
+static constexpr const char* G_SIGNAL_NAME_OWNER_CHANGED = "NameOwnerChanged";
+static constexpr const char* G_METHOD_GET_NAME_OWNER = "GetNameOwner";
+
+static std::string nameOwnerRule(const std::string& name)
+{
+    return std::string("type='signal',sender='") + DBUS_SERVICE_DBUS + "',interface='" + DBUS_INTERFACE_DBUS +
+           "',member='" + G_SIGNAL_NAME_OWNER_CHANGED + "',arg0='" + name + "'";
+}
+
+DBusDispatcher::DBusDispatcher(DBusConnection* connection, Caller caller) : mConnection(connection), mCaller(std::move(caller)), mTable(std::make_shared<const Table>()), mNextId(1)
+{
+    if (!dbus_connection_add_filter(mConnection, &DBusDispatcher::messageFilter, this, nullptr)) {
+        throw std::runtime_error("DBusDispatcher: cannot add message filter");
+    }
+
+    // Follows the owners of subscribed well-known names, watchName() adds one match rule per name
+    std::shared_ptr<Table> table = std::make_shared<Table>();
+    Subscription subscription;
+    subscription.id = mNextId++;
+    subscription.sender = DBUS_SERVICE_DBUS;
+    subscription.owner = DBUS_SERVICE_DBUS;
+    subscription.path = DBUS_PATH_DBUS;
+    subscription.interface = DBUS_INTERFACE_DBUS;
+    subscription.member = G_SIGNAL_NAME_OWNER_CHANGED;
+    subscription.handler = [this](DBusMessage* message) {
+        handleNameOwnerChanged(message);
+    };
+    table->subscriptions.push_back(std::move(subscription));
+    rebuildIndex(*table);
+    std::atomic_store(&mTable, std::shared_ptr<const Table>(std::move(table)));
+}
+
+DBusDispatcher::~DBusDispatcher()
+{
+    dbus_connection_remove_filter(mConnection, &DBusDispatcher::messageFilter, this);
+}
+
+uint64_t DBusDispatcher::subscribe(const MatchRule& rule, Handler handler)
+{
+    Subscription subscription;
+    subscription.sender = (nullptr != rule.sender) ? rule.sender : "";
+    subscription.path = (nullptr != rule.path) ? rule.path : "";
+    subscription.interface = (nullptr != rule.interface) ? rule.interface : "";
+    subscription.member = (nullptr != rule.member) ? rule.member : "";
+    subscription.matchRule = buildMatchRule(rule);
+    subscription.handler = std::move(handler);
+
+    DBusError error;
+    dbus_error_init(&error);
+    dbus_bus_add_match(mConnection, subscription.matchRule.c_str(), &error);
+    if (dbus_error_is_set(&error)) {
+        NETWORK_LOG(Error) << "Match rule error" << logField("rule", subscription.matchRule) << logField("error", error.message);
+        dbus_error_free(&error);
+        return 0;
+    }
+
+    if (!subscription.sender.empty()) {
+        watchName(subscription.sender);
+        subscription.owner = resolveOwner(subscription.sender);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    uint64_t id = mNextId++;
+    subscription.id = id;
+    std::shared_ptr<Table> table = std::make_shared<Table>();
+    table->subscriptions = std::atomic_load(&mTable)->subscriptions;
+    table->subscriptions.push_back(std::move(subscription));
+    rebuildIndex(*table);
+    std::atomic_store(&mTable, std::shared_ptr<const Table>(std::move(table)));
+    return id;
+}
+
+void DBusDispatcher::unsubscribe(uint64_t id)
+{
+    std::string matchRule;
+    std::string sender;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::shared_ptr<Table> table = std::make_shared<Table>();
+        for (const Subscription& subscription : std::atomic_load(&mTable)->subscriptions) {
+            if ((subscription.id == id) && !subscription.matchRule.empty()) {
+                matchRule = subscription.matchRule;
+                sender = subscription.sender;
+                continue;
+            }
+            table->subscriptions.push_back(subscription);
+        }
+        if (matchRule.empty()) {
+            return;
+        }
+        rebuildIndex(*table);
+        std::atomic_store(&mTable, std::shared_ptr<const Table>(std::move(table)));
+    }
+
+    // No reply needed, passing no error keeps this from blocking
+    dbus_bus_remove_match(mConnection, matchRule.c_str(), nullptr);
+    if (!sender.empty()) {
+        unwatchName(sender);
+    }
+}
+
+size_t DBusDispatcher::getSubscriptionCount() const
+{
+    // Leave out the internal NameOwnerChanged subscription
+    return std::atomic_load(&mTable)->subscriptions.size() - 1;
+}
+
+DBusHandlerResult DBusDispatcher::messageFilter(DBusConnection*, DBusMessage* message, void* data)
+{
+    if (dbus_message_get_type(message) == DBUS_MESSAGE_TYPE_SIGNAL) {
+        static_cast<DBusDispatcher*>(data)->dispatch(message);
+    }
+    // Replies and other filters must still see the message
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+void DBusDispatcher::dispatch(DBusMessage* message)
+{
+    // Holding the snapshot keeps every handler alive even if it unsubscribes meanwhile
+    std::shared_ptr<const Table> table = std::atomic_load(&mTable);
+    const char* interface = dbus_message_get_interface(message);
+    const char* member = dbus_message_get_member(message);
+
+    if ((nullptr != interface) && (nullptr != member)) {
+        std::unordered_map<uint64_t, std::vector<size_t>>::const_iterator item = table->index.find(hashKey(interface, member));
+        if (item != table->index.end()) {
+            for (size_t position : item->second) {
+                const Subscription& subscription = table->subscriptions[position];
+                if (matches(subscription, message)) {
+                    subscription.handler(message);
+                }
+            }
+        }
+    }
+
+    for (size_t position : table->wildcards) {
+        const Subscription& subscription = table->subscriptions[position];
+        if (matches(subscription, message)) {
+            subscription.handler(message);
+        }
+    }
+}
+
+/**
+ * FNV-1a over "interface\0member".
+ */
+uint64_t DBusDispatcher::hashKey(const char* interface, const char* member)
+{
+    // The terminator of interface is hashed too, so ("ab", "c") and ("a", "bc") differ
+    return fnv1a(member, fnv1a(std::string_view(interface, strlen(interface) + 1)));
+}
+
+bool DBusDispatcher::matches(const Subscription& subscription, DBusMessage* message)
+{
+    if (!subscription.interface.empty() && !dbus_message_has_interface(message, subscription.interface.c_str())) {
+        return false;
+    }
+    if (!subscription.member.empty() && !dbus_message_has_member(message, subscription.member.c_str())) {
+        return false;
+    }
+    if (!subscription.path.empty() && !dbus_message_has_path(message, subscription.path.c_str())) {
+        return false;
+    }
+    if (!subscription.sender.empty()) {
+        const char* sender = dbus_message_get_sender(message);
+        if (subscription.owner.empty() || (nullptr == sender) || (0 != strcmp(sender, subscription.owner.c_str()))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string DBusDispatcher::buildMatchRule(const MatchRule& rule)
+{
+    std::string ret = "type='signal'";
+    if (nullptr != rule.sender) {
+        ret += std::string(",sender='") + rule.sender + "'";
+    }
+    if (nullptr != rule.path) {
+        ret += std::string(",path='") + rule.path + "'";
+    }
+    if (nullptr != rule.interface) {
+        ret += std::string(",interface='") + rule.interface + "'";
+    }
+    if (nullptr != rule.member) {
+        ret += std::string(",member='") + rule.member + "'";
+    }
+    return ret;
+}
+
+void DBusDispatcher::rebuildIndex(Table& table)
+{
+    table.index.clear();
+    table.wildcards.clear();
+    for (size_t i = 0; i < table.subscriptions.size(); i++) {
+        const Subscription& subscription = table.subscriptions[i];
+        if (subscription.interface.empty() || subscription.member.empty()) {
+            table.wildcards.push_back(i);
+        }
+        else {
+            table.index[hashKey(subscription.interface.c_str(), subscription.member.c_str())].push_back(i);
+        }
+    }
+}
+
+void DBusDispatcher::handleNameOwnerChanged(DBusMessage* message)
+{
+    const char* name = nullptr;
+    const char* oldOwner = nullptr;
+    const char* newOwner = nullptr;
+    if (!dbus_message_get_args(message, nullptr,
+                               DBUS_TYPE_STRING, &name,
+                               DBUS_TYPE_STRING, &oldOwner,
+                               DBUS_TYPE_STRING, &newOwner,
+                               DBUS_TYPE_INVALID)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::shared_ptr<const Table> current = std::atomic_load(&mTable);
+    bool changed = false;
+    for (const Subscription& subscription : current->subscriptions) {
+        if (subscription.sender == name) {
+            changed = true;
+            break;
+        }
+    }
+    if (!changed) {
+        return;
+    }
+
+    std::shared_ptr<Table> table = std::make_shared<Table>(*current);
+    for (Subscription& subscription : table->subscriptions) {
+        if (subscription.sender == name) {
+            subscription.owner = newOwner;
+        }
+    }
+    std::atomic_store(&mTable, std::shared_ptr<const Table>(std::move(table)));
+}
+
+/**
+ * Unique name owning name, empty when nobody does. Unique names resolve to themselves.
+ */
+std::string DBusDispatcher::resolveOwner(const std::string& name)
+{
+    if ((name[0] == ':') || (name == DBUS_SERVICE_DBUS)) {
+        return name;
+    }
+
+    std::string ret;
+    DBusError error;
+    dbus_error_init(&error);
+    DBusMessage* message = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, G_METHOD_GET_NAME_OWNER);
+    if (nullptr == message) {
+        return ret;
+    }
+
+    const char* argument = name.c_str();
+    dbus_message_append_args(message, DBUS_TYPE_STRING, &argument, DBUS_TYPE_INVALID);
+    DBusMessage* reply = mCaller(message, &error);
+    dbus_message_unref(message);
+    if (dbus_error_is_set(&error)) {
+        // NameHasNoOwner is expected while the service is not running, NameOwnerChanged fills it in later
+        if (!dbus_error_has_name(&error, DBUS_ERROR_NAME_HAS_NO_OWNER)) {
+            NETWORK_LOG(Warn) << "Cannot resolve name owner" << logField("name", name) << logField("error", error.message);
+        }
+        dbus_error_free(&error);
+        return ret;
+    }
+
+    const char* owner = nullptr;
+    if (dbus_message_get_args(reply, nullptr, DBUS_TYPE_STRING, &owner, DBUS_TYPE_INVALID)) {
+        ret = owner;
+    }
+    dbus_message_unref(reply);
+    return ret;
+}
+
+void DBusDispatcher::watchName(const std::string& name)
+{
+    if ((name[0] == ':') || (name == DBUS_SERVICE_DBUS)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mWatchedNames[name]++ > 0) {
+            return;
+        }
+    }
+
+    std::string rule = nameOwnerRule(name);
+    dbus_bus_add_match(mConnection, rule.c_str(), nullptr);
+}
+
+void DBusDispatcher::unwatchName(const std::string& name)
+{
+    if ((name[0] == ':') || (name == DBUS_SERVICE_DBUS)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::unordered_map<std::string, size_t>::iterator item = mWatchedNames.find(name);
+        if ((item == mWatchedNames.end()) || (--item->second > 0)) {
+            return;
+        }
+        mWatchedNames.erase(item);
+    }
+
+    std::string rule = nameOwnerRule(name);
+    dbus_bus_remove_match(mConnection, rule.c_str(), nullptr);
+}
@@ -0,0 +1,383 @@
+#include "DBusReactor.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static constexpr int G_REACTOR_MAX_EVENTS = 8;
+
+DBusReactor::DBusReactor(DBusConnection* connection) : mConnection(connection), mEpollFd(-1), mEventFd(-1), mStopped(false), mDispatched(0), mQueueDepth(0), mMaxQueueDepth(0)
+{
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if ((mEpollFd < 0) || (mEventFd < 0)) {
+        throw std::runtime_error("DBusReactor: cannot create epoll/eventfd");
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = mEventFd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mEventFd, &event) < 0) {
+        throw std::runtime_error("DBusReactor: cannot watch eventfd");
+    }
+
+    if (!dbus_connection_set_watch_functions(mConnection, &DBusReactor::addWatch, &DBusReactor::removeWatch, &DBusReactor::toggleWatch, this, nullptr)) {
+        throw std::runtime_error("DBusReactor: cannot set watch functions");
+    }
+    if (!dbus_connection_set_timeout_functions(mConnection, &DBusReactor::addTimeout, &DBusReactor::removeTimeout, &DBusReactor::toggleTimeout, this, nullptr)) {
+        throw std::runtime_error("DBusReactor: cannot set timeout functions");
+    }
+    dbus_connection_set_dispatch_status_function(mConnection, &DBusReactor::dispatchStatusChanged, this, nullptr);
+    dbus_connection_set_wakeup_main_function(mConnection, &DBusReactor::wakeupMain, this, nullptr);
+}
+
+DBusReactor::~DBusReactor()
+{
+    dbus_connection_set_wakeup_main_function(mConnection, nullptr, nullptr, nullptr);
+    dbus_connection_set_dispatch_status_function(mConnection, nullptr, nullptr, nullptr);
+    dbus_connection_set_timeout_functions(mConnection, nullptr, nullptr, nullptr, nullptr, nullptr);
+    dbus_connection_set_watch_functions(mConnection, nullptr, nullptr, nullptr, nullptr, nullptr);
+
+    if (mEventFd >= 0) {
+        close(mEventFd);
+    }
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+    }
+}
+
+DBusConnection* DBusReactor::getConnection() const
+{
+    return mConnection;
+}
+
+bool DBusReactor::isReactorThread() const
+{
+    return mThread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+void DBusReactor::wakeup()
+{
+    uint64_t value = 1;
+    if (write(mEventFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        NETWORK_LOG(Error) << "DBusReactor wakeup failed" << logField("error", strerror(errno));
+    }
+}
+
+void DBusReactor::stop()
+{
+    mStopped.store(true, std::memory_order_release);
+    // Returns the loop from epoll_wait, it checks isStopped() before iterating again
+    wakeup();
+}
+
+bool DBusReactor::isStopped() const
+{
+    return mStopped.load(std::memory_order_acquire);
+}
+
+void DBusReactor::schedule(std::chrono::steady_clock::duration delay, std::function<void()> callback)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTimers.push_back({std::chrono::steady_clock::now() + delay, std::move(callback)});
+    }
+    // The loop may be sleeping on a later deadline
+    wakeup();
+}
+
+void DBusReactor::iterate(int timeoutMs)
+{
+    epoll_event events[G_REACTOR_MAX_EVENTS];
+    int waitMs = 0;
+    mThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+    if (DBUS_DISPATCH_DATA_REMAINS != dbus_connection_get_dispatch_status(mConnection)) {
+        waitMs = nextTimeout(timeoutMs);
+    }
+
+    int count = epoll_wait(mEpollFd, events, G_REACTOR_MAX_EVENTS, waitMs);
+    if ((count < 0) && (errno != EINTR)) {
+        NETWORK_LOG(Error) << "DBusReactor epoll_wait failed" << logField("error", strerror(errno));
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (events[i].data.fd == mEventFd) {
+            uint64_t value = 0;
+            while (read(mEventFd, &value, sizeof(value)) > 0) {
+                // Drain wakeups
+            }
+            continue;
+        }
+        handleWatches(events[i].data.fd, events[i].events);
+    }
+
+    handleTimeouts();
+    handleTimers();
+
+    // Dispatch everything already queued, one message per dbus_connection_dispatch call
+    uint32_t depth = 0;
+    if (DBUS_DISPATCH_DATA_REMAINS == dbus_connection_get_dispatch_status(mConnection)) {
+        do {
+            depth++;
+        } while (DBUS_DISPATCH_DATA_REMAINS == dbus_connection_dispatch(mConnection));
+    }
+
+    mDispatched.fetch_add(depth, std::memory_order_relaxed);
+    mQueueDepth.store(depth, std::memory_order_relaxed);
+    if (depth > mMaxQueueDepth.load(std::memory_order_relaxed)) {
+        // Only the iterating thread writes it
+        mMaxQueueDepth.store(depth, std::memory_order_relaxed);
+    }
+}
+
+DBusReactor::Metrics DBusReactor::getMetrics() const
+{
+    Metrics ret;
+    ret.dispatched = mDispatched.load(std::memory_order_relaxed);
+    ret.queueDepth = mQueueDepth.load(std::memory_order_relaxed);
+    ret.maxQueueDepth = mMaxQueueDepth.load(std::memory_order_relaxed);
+    ret.outgoingBytes = dbus_connection_get_outgoing_size(mConnection);
+    return ret;
+}
+
+bool DBusReactor::updateEpoll(int fd)
+{
+    uint32_t events = 0;
+    std::unordered_map<int, std::vector<DBusWatch*>>::iterator item = mWatches.find(fd);
+    if (item != mWatches.end()) {
+        for (DBusWatch* watch : item->second) {
+            if (!dbus_watch_get_enabled(watch)) {
+                continue;
+            }
+            unsigned int flags = dbus_watch_get_flags(watch);
+            if (flags & DBUS_WATCH_READABLE) {
+                events |= EPOLLIN;
+            }
+            if (flags & DBUS_WATCH_WRITABLE) {
+                events |= EPOLLOUT;
+            }
+        }
+    }
+
+    if (0 == events) {
+        if ((epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr) < 0) && (errno != ENOENT) && (errno != EBADF)) {
+            NETWORK_LOG(Error) << "DBusReactor cannot remove fd" << logField("fd", fd) << logField("error", strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &event) < 0) {
+        if ((errno != ENOENT) || (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) < 0)) {
+            NETWORK_LOG(Error) << "DBusReactor cannot watch fd" << logField("fd", fd) << logField("error", strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+int DBusReactor::nextTimeout(int timeoutMs)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    for (const TimeoutEntry& entry : mTimeouts) {
+        if (dbus_timeout_get_enabled(entry.timeout)) {
+            deadline = std::min(deadline, entry.deadline);
+        }
+    }
+    for (const TimerEntry& entry : mTimers) {
+        deadline = std::min(deadline, entry.deadline);
+    }
+    if (deadline == std::chrono::steady_clock::time_point::max()) {
+        return timeoutMs;
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    int remaining = 0;
+    if (deadline > now) {
+        // Round up so an expired deadline is never polled with 0 in a loop
+        remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()) + 1;
+    }
+    return ((timeoutMs < 0) || (remaining < timeoutMs)) ? remaining : timeoutMs;
+}
+
+void DBusReactor::handleWatches(int fd, uint32_t events)
+{
+    unsigned int ready = 0;
+    if (events & EPOLLIN) {
+        ready |= DBUS_WATCH_READABLE;
+    }
+    if (events & EPOLLOUT) {
+        ready |= DBUS_WATCH_WRITABLE;
+    }
+    if (events & EPOLLHUP) {
+        ready |= DBUS_WATCH_HANGUP;
+    }
+    if (events & EPOLLERR) {
+        ready |= DBUS_WATCH_ERROR;
+    }
+
+    std::vector<std::pair<DBusWatch*, unsigned int>> watches;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::unordered_map<int, std::vector<DBusWatch*>>::iterator item = mWatches.find(fd);
+        if (item == mWatches.end()) {
+            return;
+        }
+        for (DBusWatch* watch : item->second) {
+            if (!dbus_watch_get_enabled(watch)) {
+                continue;
+            }
+            unsigned int flags = ready & (dbus_watch_get_flags(watch) | DBUS_WATCH_HANGUP | DBUS_WATCH_ERROR);
+            if (0 != flags) {
+                watches.emplace_back(watch, flags);
+            }
+        }
+    }
+
+    // libdbus calls back into toggleWatch() from dbus_watch_handle, so our lock must be released here
+    for (const std::pair<DBusWatch*, unsigned int>& watch : watches) {
+        dbus_watch_handle(watch.first, watch.second);
+    }
+}
+
+void DBusReactor::handleTimeouts()
+{
+    std::vector<DBusTimeout*> expired;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        for (TimeoutEntry& entry : mTimeouts) {
+            if (!dbus_timeout_get_enabled(entry.timeout) || (entry.deadline > now)) {
+                continue;
+            }
+            expired.push_back(entry.timeout);
+            entry.deadline = now + std::chrono::milliseconds(dbus_timeout_get_interval(entry.timeout));
+        }
+    }
+
+    for (DBusTimeout* timeout : expired) {
+        // An earlier handler may have completed or cancelled the call owning this one, which frees it
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (std::none_of(mTimeouts.begin(), mTimeouts.end(), [timeout](const TimeoutEntry& entry) {
+                return entry.timeout == timeout;
+            })) {
+                continue;
+            }
+        }
+        dbus_timeout_handle(timeout);
+    }
+}
+
+void DBusReactor::handleTimers()
+{
+    std::vector<std::function<void()>> expired;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mTimers.empty()) {
+            return;
+        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::vector<TimerEntry>::iterator end = std::remove_if(mTimers.begin(), mTimers.end(), [now, &expired](TimerEntry& entry) {
+            if (entry.deadline > now) {
+                return false;
+            }
+            expired.push_back(std::move(entry.callback));
+            return true;
+        });
+        mTimers.erase(end, mTimers.end());
+    }
+
+    // Outside the lock: a callback may schedule() again
+    for (std::function<void()>& callback : expired) {
+        callback();
+    }
+}
+
+dbus_bool_t DBusReactor::addWatch(DBusWatch* watch, void* data)
+{
+    DBusReactor* reactor = static_cast<DBusReactor*>(data);
+    int fd = dbus_watch_get_unix_fd(watch);
+    std::lock_guard<std::mutex> lock(reactor->mMutex);
+    reactor->mWatches[fd].push_back(watch);
+    return reactor->updateEpoll(fd) ? TRUE : FALSE;
+}
+
+void DBusReactor::removeWatch(DBusWatch* watch, void* data)
+{
+    DBusReactor* reactor = static_cast<DBusReactor*>(data);
+    int fd = dbus_watch_get_unix_fd(watch);
+    std::lock_guard<std::mutex> lock(reactor->mMutex);
+    std::unordered_map<int, std::vector<DBusWatch*>>::iterator item = reactor->mWatches.find(fd);
+    if (item == reactor->mWatches.end()) {
+        return;
+    }
+    item->second.erase(std::remove(item->second.begin(), item->second.end(), watch), item->second.end());
+    reactor->updateEpoll(fd);
+    if (item->second.empty()) {
+        reactor->mWatches.erase(item);
+    }
+}
+
+void DBusReactor::toggleWatch(DBusWatch* watch, void* data)
+{
+    DBusReactor* reactor = static_cast<DBusReactor*>(data);
+    std::lock_guard<std::mutex> lock(reactor->mMutex);
+    reactor->updateEpoll(dbus_watch_get_unix_fd(watch));
+}
+
+dbus_bool_t DBusReactor::addTimeout(DBusTimeout* timeout, void* data)
+{
+    DBusReactor* reactor = static_cast<DBusReactor*>(data);
+    {
+        std::lock_guard<std::mutex> lock(reactor->mMutex);
+        reactor->mTimeouts.push_back({timeout, std::chrono::steady_clock::now() + std::chrono::milliseconds(dbus_timeout_get_interval(timeout))});
+    }
+    reactor->wakeup();
+    return TRUE;
+}
+
+void DBusReactor::removeTimeout(DBusTimeout* timeout, void* data)
+{
+    DBusReactor* reactor = static_cast<DBusReactor*>(data);
+    std::lock_guard<std::mutex> lock(reactor->mMutex);
+    reactor->mTimeouts.erase(std::remove_if(reactor->mTimeouts.begin(), reactor->mTimeouts.end(), [timeout](const TimeoutEntry& entry) {
+        return entry.timeout == timeout;
+    }), reactor->mTimeouts.end());
+}
+
+void DBusReactor::toggleTimeout(DBusTimeout* timeout, void* data)
+{
+    DBusReactor* reactor = static_cast<DBusReactor*>(data);
+    {
+        std::lock_guard<std::mutex> lock(reactor->mMutex);
+        for (TimeoutEntry& entry : reactor->mTimeouts) {
+            if (entry.timeout == timeout) {
+                entry.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(dbus_timeout_get_interval(timeout));
+            }
+        }
+    }
+    reactor->wakeup();
+}
+
+void DBusReactor::dispatchStatusChanged(DBusConnection*, DBusDispatchStatus status, void* data)
+{
+    // Called with the connection locked, only poke the eventfd
+    if (DBUS_DISPATCH_DATA_REMAINS == status) {
+        static_cast<DBusReactor*>(data)->wakeup();
+    }
+}
+
+void DBusReactor::wakeupMain(void* data)
+{
+    static_cast<DBusReactor*>(data)->wakeup();
+}
@@ -0,0 +1,226 @@
+#include "Logger.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+static constexpr std::chrono::milliseconds G_LOG_FLUSH_INTERVAL(50);
+
+static const char* levelName(LogLevel level)
+{
+    switch (level) {
+        case LogLevel::Trace: return "TRACE";
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO";
+        case LogLevel::Warn: return "WARN";
+        case LogLevel::Error: return "ERROR";
+        default: return "";
+    }
+}
+
+LogLine::LogLine(LogLevel level)
+{
+    mRecord.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    mRecord.level = level;
+}
+
+LogLine::~LogLine()
+{
+    Logger::getInstance().submit(std::move(mRecord));
+}
+
+LogLine& LogLine::operator<<(std::string_view value)
+{
+    size_t length = std::min(value.size(), G_LOG_TEXT_SIZE - mRecord.length);
+    memcpy(mRecord.text + mRecord.length, value.data(), length);
+    mRecord.length += length;
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const char* value)
+{
+    return *this << std::string_view((nullptr != value) ? value : "(null)");
+}
+
+LogLine& LogLine::operator<<(const std::string& value)
+{
+    return *this << std::string_view(value);
+}
+
+LogLine& LogLine::operator<<(char value)
+{
+    return *this << std::string_view(&value, 1);
+}
+
+LogLine& LogLine::operator<<(bool value)
+{
+    return *this << std::string_view(value ? "true" : "false");
+}
+
+LogLine& LogLine::operator<<(double value)
+{
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%g", value);
+    return *this << std::string_view(buffer, std::max(length, 0));
+}
+
+LogLine& LogLine::operator<<(long long value)
+{
+    char buffer[24];
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return *this << std::string_view(buffer, result.ptr - buffer);
+}
+
+LogLine& LogLine::operator<<(unsigned long long value)
+{
+    char buffer[24];
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return *this << std::string_view(buffer, result.ptr - buffer);
+}
+
+/**
+ * Never destroyed: reactor threads may still log while static destructors run at exit.
+ * What is pending then is written by an atexit handler instead.
+ */
+Logger& Logger::getInstance()
+{
+    static Logger* instance = new Logger();
+    return *instance;
+}
+
+Logger::Logger() : mDropped(0)
+{
+    mBatch.reserve(G_LOG_RING_CAPACITY);
+    mFlushThread = std::thread(&Logger::flushHandler, this);
+    mFlushThread.detach();
+    std::atexit([]() {
+        Logger::getInstance().flush();
+    });
+}
+
+void Logger::setLevel(LogLevel level)
+{
+    mLevel.store(level, std::memory_order_relaxed);
+}
+
+/**
+ * Each thread registers its ring on first use, the Logger keeps it so records
+ * logged right before the thread exits are still written.
+ */
+Logger::Ring& Logger::localRing()
+{
+    thread_local std::shared_ptr<Ring> ring;
+    if (!ring) {
+        std::lock_guard<std::mutex> lock(mRingsMutex);
+        ring = std::make_shared<Ring>(mNextThread++);
+        mRings.push_back(ring);
+    }
+    return *ring;
+}
+
+void Logger::submit(LogRecord&& record)
+{
+    Ring& ring = localRing();
+    record.thread = ring.id;
+    LogLevel level = record.level;
+    if (!ring.records.tryPush(std::move(record))) {
+        mDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (level >= LogLevel::Warn) {
+        mWake.notify_one();
+    }
+}
+
+void Logger::flush()
+{
+    drain();
+}
+
+uint64_t Logger::getDropped() const
+{
+    return mDropped.load(std::memory_order_relaxed);
+}
+
+void Logger::flushHandler()
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mWakeMutex);
+            mWake.wait_for(lock, G_LOG_FLUSH_INTERVAL);
+        }
+        drain();
+    }
+}
+
+/**
+ * Formatting of the timestamp prefix and all writes happen here, off the logging threads.
+ */
+void Logger::drain()
+{
+    std::lock_guard<std::mutex> drainLock(mDrainMutex);
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(mRingsMutex);
+        // A ring only the Logger still holds belongs to a finished thread, drop it once empty
+        mRings.erase(std::remove_if(mRings.begin(), mRings.end(), [](const std::shared_ptr<Ring>& ring) {
+            return (ring.use_count() == 1) && ring->records.empty();
+        }), mRings.end());
+        rings = mRings;
+    }
+
+    mBatch.clear();
+    LogRecord record;
+    for (const std::shared_ptr<Ring>& ring : rings) {
+        while (ring->records.tryPop(record)) {
+            mBatch.push_back(record);
+        }
+    }
+
+    uint64_t dropped = mDropped.load(std::memory_order_relaxed);
+    if (dropped != mReportedDropped) {
+        LogRecord report;
+        report.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        report.level = LogLevel::Warn;
+        int length = snprintf(report.text, G_LOG_TEXT_SIZE, "Logger dropped %llu records, ring full", static_cast<unsigned long long>(dropped - mReportedDropped));
+        report.length = static_cast<uint16_t>(std::max(length, 0));
+        mBatch.push_back(report);
+        mReportedDropped = dropped;
+    }
+    if (mBatch.empty()) {
+        return;
+    }
+
+    // Rings are ordered per thread only, interleave them by time
+    std::stable_sort(mBatch.begin(), mBatch.end(), [](const LogRecord& left, const LogRecord& right) {
+        return left.timestamp < right.timestamp;
+    });
+
+    mOut.clear();
+    mErr.clear();
+    for (const LogRecord& item : mBatch) {
+        time_t seconds = static_cast<time_t>(item.timestamp / 1000000000);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char prefix[64];
+        size_t length = strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &local);
+        length += snprintf(prefix + length, sizeof(prefix) - length, ".%06lld %-5s [%u] ",
+                           static_cast<long long>((item.timestamp % 1000000000) / 1000), levelName(item.level), item.thread);
+
+        std::string& out = (item.level >= LogLevel::Warn) ? mErr : mOut;
+        out.append(prefix, length);
+        out.append(item.text, item.length);
+        out.push_back('\n');
+    }
+    if (!mOut.empty()) {
+        fwrite(mOut.data(), 1, mOut.size(), stdout);
+        fflush(stdout);
+    }
+    if (!mErr.empty()) {
+        fwrite(mErr.data(), 1, mErr.size(), stderr);
+        fflush(stderr);
+    }
+}
@@ -1,497 +1,635 @@
 #include "NetworkProvider.h"
 #include "../include/private/BluetoothManager.h"
+#include "../include/private/DBusReactor.h"
+#include "../include/private/DBusDispatcher.h"
+#include "../include/private/NetworkCall.h"
+#include "../include/private/NetworkStats.h"
+#include "../include/private/Logger.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
 
-static void dumpDbusMessage(DBusMessage* msg) {
-    if (!msg) {
-        std::cerr << "Message is null." << std::endl;
-        return;
-    }
+static NetworkProvider* gInstance = nullptr;
 
-    // Get message type
-    int type = dbus_message_get_type(msg);
-    std::cout << "Message Type: " << type << std::endl;
+static DBusHandlerResult countSignal(DBusConnection*, DBusMessage* message, void* data);
 
-    // Get object path
-    const char* path = dbus_message_get_path(msg);
-    if (nullptr != path) {
-        std::cout << "Object Path: " << path << std::endl;
-    } 
-    else {
-        std::cout << "Object Path is NULL" << std::endl;
-    }
+static_assert(std::atomic<NetworkProvider::WifiProperties>::is_always_lock_free, "WifiProperties reads must not take a lock");
 
-    // Get interface
-    const char* iface = dbus_message_get_interface(msg);
-    if (nullptr != iface) {
-        std::cout << "Interface: " << iface << std::endl;
-    } 
-    else {
-        std::cout << "Interface is NULL" << std::endl;
-    }
+NetworkProvider& NetworkProvider::initialize() {
+    return initialize(Options());
+}
 
-    // Get method/member
-    const char* member = dbus_message_get_member(msg);
-    if (nullptr != member) {
-        std::cout << "Member: " << member << std::endl;
-    } 
-    else {
-        std::cout << "Member is NULL" << std::endl;
+NetworkProvider& NetworkProvider::initialize(const Options& options) {
+    if (nullptr == gInstance) {
+        gInstance = new NetworkProvider(options);
     }
+    return *gInstance;    
+}
 
-    // Get sender
-    const char* sender = dbus_message_get_sender(msg);
-    if (nullptr != sender) {
-        std::cout << "Sender: " << sender << std::endl;
-    } 
-    else {
-        std::cout << "Sender is NULL" << std::endl;
+NetworkProvider& NetworkProvider::getInstance() {
+    if (nullptr == gInstance) {
+        throw std::runtime_error("NetworkProvider must initialize first");
     }
+    return *gInstance;    
+}
 
-    // Get destination
-    const char* destination = dbus_message_get_destination(msg);
-    if (nullptr != destination) {
-        std::cout << "Destination: " << destination << std::endl;
-    } 
-    else {
-        std::cout << "Destination is NULL" << std::endl;
+NetworkProvider::NetworkProvider(const Options& options) {
+    if(!doInit(options)) {
+        throw std::runtime_error("Initialize failed");
     }
+}
 
-    // Get serial number of the message
-    unsigned int serial = dbus_message_get_serial(msg);
-    std::cout << "Serial: " << serial << std::endl;
-
-    // Get reply serial if it's a reply message
-    unsigned int reply_serial = dbus_message_get_reply_serial(msg);
-    if (reply_serial != 0) {
-        std::cout << "Reply Serial: " << reply_serial << std::endl;
-    } 
-    else {
-        std::cout << "Reply Serial is not applicable." << std::endl;
+/**
+ * Reactor threads go first so nothing iterates while the dispatcher, reactors and connections are torn down.
+ */
+NetworkProvider::~NetworkProvider()
+{
+    for (DBusReactor* reactor : {mSignalReactor, mReactor}) {
+        if (nullptr != reactor) {
+            reactor->stop();
+        }
+    }
+    for (std::thread** thread : {&mWorkerThread, &mCallThread}) {
+        if (nullptr != *thread) {
+            (*thread)->join();
+            delete *thread;
+            *thread = nullptr;
+        }
     }
 
-    // Get error name (for error messages)
-    const char* errorName = dbus_message_get_error_name(msg);
-    if (nullptr != errorName) {
-        std::cout << "Error Name: " << errorName << std::endl;
-    } 
-    else {
-        std::cout << "Error Name is not applicable." << std::endl;
+    delete mDispatcher;
+    mDispatcher = nullptr;
+    if (nullptr != mSignalConnection) {
+        dbus_connection_remove_filter(mSignalConnection, &countSignal, mStats);
     }
+    if (mSignalReactor != mReactor) {
+        delete mSignalReactor;
+    }
+    delete mReactor;
+    mSignalReactor = nullptr;
+    mReactor = nullptr;
 
-    // Get signature of the message
-    const char* signature = dbus_message_get_signature(msg);
-    if (nullptr != signature) {
-        std::cout << "Signature: " << signature << std::endl;
-    } 
-    else {
-        std::cout << "Signature is NULL" << std::endl;
-    }
-
-    // Dump message arguments
-    DBusMessageIter args;
-    if (dbus_message_iter_init(msg, &args)) {
-        std::cout << "Arguments: ";
-        do {
-            int argType = dbus_message_iter_get_arg_type(&args);
-            if (argType == DBUS_TYPE_STRING) {
-                const char* arg;
-                dbus_message_iter_get_basic(&args, &arg);
-                std::cout << arg << " ";
-            } 
-            else if (argType == DBUS_TYPE_INT32) {
-                int arg;
-                dbus_message_iter_get_basic(&args, &arg);
-                std::cout << arg << " ";
-            } 
-            else if (argType == DBUS_TYPE_BOOLEAN) {
-                dbus_bool_t arg;
-                dbus_message_iter_get_basic(&args, &arg);
-                std::cout << (arg ? "true" : "false") << " ";
-            }
-            else if (argType == DBUS_TYPE_ARRAY) {
-                DBusMessageIter sub_iter;
-                dbus_message_iter_recurse(&args, &sub_iter);
-                std::cout << "[ ";
-                while (dbus_message_iter_get_arg_type(&sub_iter) != DBUS_TYPE_INVALID) {
-                    int arrayElemType = dbus_message_iter_get_arg_type(&sub_iter);
-                    if (arrayElemType == DBUS_TYPE_STRING) {
-                        const char* str_value;
-                        dbus_message_iter_get_basic(&sub_iter, &str_value);
-                        std::cout << str_value << " ";
-                    } 
-                    else if (arrayElemType == DBUS_TYPE_INT32) {
-                        int int_value;
-                        dbus_message_iter_get_basic(&sub_iter, &int_value);
-                        std::cout << int_value << " ";
-                    } 
-                    else if (arrayElemType == DBUS_TYPE_BOOLEAN) {
-                        dbus_bool_t bool_value;
-                        dbus_message_iter_get_basic(&sub_iter, &bool_value);
-                        std::cout << (bool_value ? "true" : "false") << " ";
-                    } 
-                    else {
-                        std::cout << "Unsupported element type in array: " << arrayElemType << " ";
-                    }
-                    dbus_message_iter_next(&sub_iter);
-                }
-                std::cout << "] ";
-            }
-            else {
-                std::cout << "Unsupported argument type: " << argType << " ";
-            }
-        } while (dbus_message_iter_next(&args));
-        std::cout << std::endl;
-    } else {
-        std::cout << "No arguments in message." << std::endl;
+    // Shared connections are only unreferenced, libdbus keeps them for other users in the process
+    if ((nullptr != mSignalConnection) && (mSignalConnection != mConnection)) {
+        dbus_connection_close(mSignalConnection);
+        dbus_connection_unref(mSignalConnection);
+    }
+    if (nullptr != mConnection) {
+        if (mOptions.privateConnections) {
+            dbus_connection_close(mConnection);
+        }
+        dbus_connection_unref(mConnection);
     }
-    std::cout << "\n=============================================================\n";
+    mSignalConnection = nullptr;
+    mConnection = nullptr;
+    delete mStats;
+    mStats = nullptr;
 }
 
-static void dumDbusMessageIter(DBusMessageIter* iter) {
-    if (!iter) {
-        std::cerr << "DBusMessageIter is null." << std::endl;
-        return;
+/**
+ * Shared connections are owned by libdbus, private ones are ours to close.
+ * An explicit busAddress is opened directly and registered with that bus by hand.
+ */
+static DBusConnection* openBus(const std::string& busAddress, bool isPrivate)
+{
+    DBusError err;
+    dbus_error_init(&err);
+    DBusConnection* connection = nullptr;
+    if (busAddress.empty()) {
+        connection = isPrivate ? dbus_bus_get_private(DBUS_BUS_SYSTEM, &err) : dbus_bus_get(DBUS_BUS_SYSTEM, &err);
     }
-
-    int arg_type;
-    while ((arg_type = dbus_message_iter_get_arg_type(iter)) != DBUS_TYPE_INVALID) {
-        switch (arg_type) {
-            case DBUS_TYPE_STRING: {
-                const char* str_value;
-                dbus_message_iter_get_basic(iter, &str_value);
-                std::cout << "String: " << str_value << std::endl;
-                break;
-            }
-            case DBUS_TYPE_INT32: {
-                int32_t int_value;
-                dbus_message_iter_get_basic(iter, &int_value);
-                std::cout << "Int32: " << int_value << std::endl;
-                break;
-            }
-            case DBUS_TYPE_UINT32: {
-                uint32_t uint_value;
-                dbus_message_iter_get_basic(iter, &uint_value);
-                std::cout << "UInt32: " << uint_value << std::endl;
-                break;
-            }
-            case DBUS_TYPE_BOOLEAN: {
-                dbus_bool_t bool_value;
-                dbus_message_iter_get_basic(iter, &bool_value);
-                std::cout << "Boolean: " << (bool_value ? "true" : "false") << std::endl;
-                break;
-            }
-            case DBUS_TYPE_DOUBLE: {
-                double double_value;
-                dbus_message_iter_get_basic(iter, &double_value);
-                std::cout << "Double: " << double_value << std::endl;
-                break;
-            }
-            case DBUS_TYPE_ARRAY: {
-                DBusMessageIter sub_iter;
-                dbus_message_iter_recurse(iter, &sub_iter);
-                std::cout << "Array: [" << std::endl;
-                dumDbusMessageIter(&sub_iter);
-                std::cout << "]" << std::endl;
-                break;
-            }
-            case DBUS_TYPE_STRUCT: {
-                DBusMessageIter sub_iter;
-                dbus_message_iter_recurse(iter, &sub_iter);
-                std::cout << "Struct: {" << std::endl;
-                dumDbusMessageIter(&sub_iter);
-                std::cout << "}" << std::endl;
-                break;
-            }
-            case DBUS_TYPE_VARIANT: {
-                DBusMessageIter sub_iter;
-                dbus_message_iter_recurse(iter, &sub_iter);
-                std::cout << "Variant: (" << std::endl;
-                dumDbusMessageIter(&sub_iter);
-                std::cout << ")" << std::endl;
-                break;
-            }
-            case DBUS_TYPE_DICT_ENTRY: {
-                DBusMessageIter dict_iter;
-                dbus_message_iter_recurse(iter, &dict_iter);
-                std::cout << "Dict Entry: {" << std::endl;
-                
-                int key_type = dbus_message_iter_get_arg_type(&dict_iter);
-                if (key_type != DBUS_TYPE_INVALID) {
-                    std::cout << "  Key: ";
-                    dumDbusMessageIter(&dict_iter);
-                }
-
-                if (dbus_message_iter_next(&dict_iter)) {
-                    std::cout << "  Value: ";
-                    dumDbusMessageIter(&dict_iter);
-                }
-                
-                std::cout << "}" << std::endl;
-                break;
+    else {
+        connection = isPrivate ? dbus_connection_open_private(busAddress.c_str(), &err) : dbus_connection_open(busAddress.c_str(), &err);
+        if ((nullptr != connection) && !dbus_bus_register(connection, &err)) {
+            if (isPrivate) {
+                dbus_connection_close(connection);
             }
-            default:
-                std::cout << "Unsupported type: " << arg_type << std::endl;
-                break;
+            dbus_connection_unref(connection);
+            connection = nullptr;
         }
-        dbus_message_iter_next(iter);  // Chuyển sang tham số tiếp theo
     }
-}
-
-static NetworkProvider* gInstance = nullptr;
-
-NetworkProvider& NetworkProvider::initialize() {
-    if (nullptr == gInstance) {
-        gInstance = new NetworkProvider();
+    if (dbus_error_is_set(&err)) {
+        NETWORK_LOG(Error) << "Connection Error" << logField("error", err.message);
+        dbus_error_free(&err);
+        return nullptr;
     }
-    return *gInstance;    
-}
-
-NetworkProvider& NetworkProvider::getInstance() {
-    if (nullptr == gInstance) {
-        throw std::runtime_error("NetworkProvider must initialize first");
+    if (nullptr == connection) {
+        NETWORK_LOG(Error) << "Failed to connect to the D-Bus bus" << logField("address", busAddress.empty() ? "system" : busAddress.c_str());
+        return nullptr;
     }
-    return *gInstance;    
-}
-
-NetworkProvider::NetworkProvider() {
-    if(!doInit()) {
-        throw std::runtime_error("Initialize failed");
+    if (isPrivate) {
+        dbus_connection_set_exit_on_disconnect(connection, FALSE);
     }
+    return connection;
 }
 
-NetworkProvider::~NetworkProvider()
+/**
+ * Counts every signal the signal connection ingests, whether or not a subscriber wants it.
+ */
+static DBusHandlerResult countSignal(DBusConnection*, DBusMessage* message, void* data)
 {
-    if (nullptr == mWorkerThread) {
-        mWorkerThread->join();
-        delete mWorkerThread;
-        mWorkerThread = nullptr;
+    if (dbus_message_get_type(message) == DBUS_MESSAGE_TYPE_SIGNAL) {
+        static_cast<NetworkStats*>(data)->recordSignal(message);
     }
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
-bool NetworkProvider::doInit()
+bool NetworkProvider::doInit(const Options& options)
 {
     bool ret = true;
     do
     {
-        DBusError err;
-        dbus_error_init(&err);
-        mConnection = dbus_bus_get(DBUS_BUS_SYSTEM, &err);
-        if (dbus_error_is_set(&err)) {
-            std::cerr << "Connection Error: " << err.message << std::endl;
-            dbus_error_free(&err);
+        mOptions = options;
+        mStats = new NetworkStats();
+        mConnection = openBus(options.busAddress, options.privateConnections);
+        if (nullptr == mConnection) {
             ret = false;
             break;
         }
-        if (nullptr == mConnection) {
-            std::cerr << "Failed to connect to the D-Bus system bus." << std::endl;
-            ret = false;
-            break;        
+        mReactor = new DBusReactor(mConnection);
+
+        if (options.privateConnections) {
+            // Signal bursts queue on their own socket and thread, replies are never stuck behind them
+            mSignalConnection = openBus(options.busAddress, true);
+            if (nullptr == mSignalConnection) {
+                ret = false;
+                break;
+            }
+            mSignalReactor = new DBusReactor(mSignalConnection);
+        }
+        else {
+            mSignalConnection = mConnection;
+            mSignalReactor = mReactor;
+        }
+        mDispatcher = new DBusDispatcher(mSignalConnection, [this](DBusMessage* message, DBusError* error) {
+            return sendWithReplyAndBlock(message, error, internalCallOptions());
+        });
+        if (!dbus_connection_add_filter(mSignalConnection, &countSignal, mStats, nullptr)) {
+            NETWORK_LOG(Warn) << "Failed to add the signal statistics filter";
         }
 
-        // mWorkerThread = new std::thread(std::bind(&NetworkProvider::signalHandler, this));
-        BluetoothAdapter::initialize(*this);
+        // Blocking calls wait for their reply through the reactor, it must run before the first one
+        mWorkerThread = new std::thread(std::bind(&NetworkProvider::reactorHandler, this, mSignalReactor));
+        if (mSignalReactor != mReactor) {
+            mCallThread = new std::thread(std::bind(&NetworkProvider::reactorHandler, this, mReactor));
+        }
+
+        // NetworkManager sends the standard Properties signal, older releases also its own PropertiesChanged
+        mDispatcher->subscribe({G_NM_DBUS_SERVICE, G_NM_DBUS_PATH, G_INTERFACE_DBUS_PROP, G_SIGNAL_PROPERTIES_CHANGED}, [this](DBusMessage* message) {
+            handleWifiSignal(message);
+        });
+        mDispatcher->subscribe({G_NM_DBUS_SERVICE, G_NM_DBUS_PATH, G_NM_DBUS_INTERFACE, G_SIGNAL_PROPERTIES_CHANGED}, [this](DBusMessage* message) {
+            handleWifiSignal(message);
+        });
+        refreshWifiProperties();
 
+        BluetoothAdapter::initialize(*this);
     } while (0);
 
     return ret;
 }
 
-void NetworkProvider::signalHandler()
+/**
+ * The only thread reading the reactor's connection: signals reach subscribers through mDispatcher,
+ * replies complete their DBusPendingCall, both from here.
+ */
+void NetworkProvider::reactorHandler(DBusReactor* reactor)
 {
-    std::string introspect = "type='signal',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged'";
-    DBusError error;
-    DBusMessage *message = nullptr;
-
-    dbus_error_init(&error);
-    dbus_bus_add_match(mConnection, introspect.c_str(), &error);
-    dbus_connection_flush(mConnection);
+    while (!reactor->isStopped()) {
+        reactor->iterate();
+    }
+}
 
-    if (dbus_error_is_set(&error)) {
-        std::cerr << "Error adding match: " << error.message << std::endl;
-        dbus_error_free(&error);
-        return;
+std::vector<NetworkProvider::ConnectionStats> NetworkProvider::getConnectionStats() const
+{
+    std::vector<ConnectionStats> ret;
+    std::function<void(const char*, const DBusReactor*)> append = [&ret](const char* name, const DBusReactor* reactor) {
+        DBusReactor::Metrics metrics = reactor->getMetrics();
+        ConnectionStats stats;
+        stats.name = name;
+        stats.dispatched = metrics.dispatched;
+        stats.queueDepth = metrics.queueDepth;
+        stats.maxQueueDepth = metrics.maxQueueDepth;
+        stats.outgoingBytes = metrics.outgoingBytes;
+        ret.push_back(stats);
+    };
+
+    if (nullptr == mReactor) {
+        return ret;
+    }
+    if (mSignalReactor == mReactor) {
+        append("shared", mReactor);
     }
-    std::cout << "Listening for Bluetooth power changes..." << std::endl;
+    else {
+        append("call", mReactor);
+        append("signal", mSignalReactor);
+    }
+    return ret;
+}
 
-    while (true)
-    {
-        dbus_connection_read_write(mConnection, 0);
-        message = dbus_connection_pop_message(mConnection);
-        if (nullptr == message) {
-            continue;
-        }
+NetworkProvider::Stats NetworkProvider::getStats() const
+{
+    Stats ret;
+    if (nullptr == mStats) {
+        return ret;
+    }
+    mStats->snapshot(ret);
+    ret.connections = getConnectionStats();
+    BluetoothAdapter& adapter = BluetoothAdapter::getInstance();
+    ret.deviceInfosDropped = adapter.getDroppedDeviceInfos();
+    ret.deviceInfosQueueDepth = static_cast<uint32_t>(adapter.mDeviceInfosQueue.size());
+    ret.deviceInfosQueueCapacity = static_cast<uint32_t>(adapter.mDeviceInfosQueue.capacity());
+    adapter.getDeviceStats(ret);
+    return ret;
+}
 
-        dumpDbusMessage(message);
+uint64_t NetworkProvider::subscribeSignal(const char* sender, const char* path, const char* interface, const char* member, SignalHandler handler)
+{
+    if (nullptr == mDispatcher) {
+        return 0;
+    }
+    return mDispatcher->subscribe({sender, path, interface, member}, std::move(handler));
+}
 
-        if (!dbus_message_is_signal(message, G_INTERFACE_DBUS_PROP, G_SIGNAL_PROPERTIES_CHANGED)) {
-            continue;
-        }
-        
-        DBusMessageIter args;
-        dbus_message_iter_init(message, &args);
-        const char *interface;
+void NetworkProvider::unsubscribeSignal(uint64_t id)
+{
+    if (nullptr != mDispatcher) {
+        mDispatcher->unsubscribe(id);
+    }
+}
 
-        if (dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_STRING) {
-            continue;
+void CancelToken::cancel()
+{
+    std::vector<std::pair<uint64_t, std::function<void()>>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mCancelled) {
+            return;
         }
-                
-        dbus_message_iter_get_basic(&args, &interface);
+        mCancelled = true;
+        callbacks.swap(mCallbacks);
+    }
+    // Outside the lock, a callback completing its call detaches itself
+    for (std::pair<uint64_t, std::function<void()>>& callback : callbacks) {
+        callback.second();
+    }
+}
 
-        if (std::string(interface) != std::string(G_BT_ADAPTER_INTERFACE)) {
-            continue;
-        }
+bool CancelToken::isCancelled() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCancelled;
+}
 
-        dbus_message_iter_next(&args);
+uint64_t CancelToken::attach(std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mCancelled) {
+        return 0;
+    }
+    uint64_t id = mNextId++;
+    mCallbacks.emplace_back(id, std::move(callback));
+    return id;
+}
 
-        if (dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_ARRAY) {
-            continue;
+void CancelToken::detach(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (size_t i = 0; i < mCallbacks.size(); i++) {
+        if (mCallbacks[i].first == id) {
+            mCallbacks[i] = std::move(mCallbacks.back());
+            mCallbacks.pop_back();
+            return;
         }
+    }
+}
 
-        DBusMessageIter dictIter;
-        dbus_message_iter_recurse(&args, &dictIter);
-        while (dbus_message_iter_get_arg_type(&dictIter) == DBUS_TYPE_DICT_ENTRY) 
+namespace {
+    /**
+     * One logical call across its attempts. Completes exactly once: with a reply, an error,
+     * or nullptr after a cancel.
+     */
+    struct CallContext
+    {
+        ~CallContext()
         {
+            if (nullptr != message) {
+                dbus_message_unref(message);
+            }
+        }
 
-            DBusMessageIter entryIter;
-            dbus_message_iter_recurse(&dictIter, &entryIter);
-            const char *propertyName;
+        DBusConnection* connection = nullptr;
+        DBusReactor* reactor = nullptr; // Drives connection
+        DBusMessage* message = nullptr; // Kept for resending, only touched by the thread running the attempt
+        NetworkProvider::ReplyHandler handler;
+        MethodCounters* stats = nullptr;
+        std::chrono::steady_clock::time_point start;
+        CallOptions options;
+        int retriesLeft = 0;
+        uint64_t cancelId = 0;
+
+        std::mutex mutex;
+        DBusPendingCall* pending = nullptr; // Current attempt
+        bool completed = false;
+    };
+
+    struct AttemptContext
+    {
+        std::shared_ptr<CallContext> call;
+        std::atomic<bool> fired{false};
+    };
 
-            if (dbus_message_iter_get_arg_type(&entryIter) != DBUS_TYPE_STRING) {
-                goto NextIter;
-            }
-                
-            dbus_message_iter_get_basic(&entryIter, &propertyName);
+    bool startAttempt(const std::shared_ptr<CallContext>& call);
 
-            if (dbus_message_iter_get_arg_type(&entryIter) != DBUS_TYPE_STRING) {
-                goto NextIter;
+    /**
+     * Drop a reference to pending, cancelling it first if asked. The last reference frees the pending
+     * call's DBusTimeout, which the reactor may be handling at that moment unless this runs on its thread.
+     */
+    void releasePending(DBusReactor* reactor, DBusPendingCall* pending, bool cancel)
+    {
+        if (reactor->isReactorThread()) {
+            if (cancel) {
+                dbus_pending_call_cancel(pending);
             }
-
-            if (std::string(propertyName) != std::string(G_METHOD_POWERED_PROP)) {
-                goto NextIter;
+            dbus_pending_call_unref(pending);
+            return;
+        }
+        reactor->schedule(std::chrono::steady_clock::duration::zero(), [pending, cancel]() {
+            if (cancel) {
+                dbus_pending_call_cancel(pending);
             }
-                    
-            dbus_message_iter_next(&entryIter);
-
+            dbus_pending_call_unref(pending);
+        });
+    }
 
-            if (dbus_message_iter_get_arg_type(&entryIter) != DBUS_TYPE_VARIANT) {
-                goto NextIter;
+    void finishCall(const std::shared_ptr<CallContext>& call, DBusMessage* reply)
+    {
+        DBusPendingCall* pending = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(call->mutex);
+            if (call->completed) {
+                return;
             }
+            call->completed = true;
+            std::swap(pending, call->pending);
+        }
+        if (nullptr != pending) {
+            releasePending(call->reactor, pending, false);
+        }
+        if (0 != call->cancelId) {
+            call->options.cancelToken->detach(call->cancelId);
+        }
 
-            DBusMessageIter valueIter;
-            dbus_message_iter_recurse(&entryIter, &valueIter);
-            bool powered;
+        call->stats->record(call->start, reply);
+        call->handler(reply);
+    }
 
-            if (dbus_message_iter_get_arg_type(&valueIter) != DBUS_TYPE_BOOLEAN) {
-                goto NextIter;
+    void cancelCall(const std::shared_ptr<CallContext>& call)
+    {
+        DBusPendingCall* pending = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(call->mutex);
+            if (call->completed) {
+                return;
             }
+            call->completed = true;
+            std::swap(pending, call->pending);
+        }
+        if (nullptr != pending) {
+            // A cancelled pending call never notifies, the reply is dropped when it arrives
+            releasePending(call->reactor, pending, true);
+        }
 
-            dbus_message_iter_get_basic(&valueIter, &powered);
-            std::cout << "\nBluetooth state: " << (powered ? "ON" : "OFF") << std::endl;
-
-NextIter:
-            dbus_message_iter_next(&dictIter);
+        call->stats->record(call->start, nullptr);
+        call->handler(nullptr);
+    }
 
+    /**
+     * Milliseconds left for the next attempt, 0 when the deadline has passed.
+     */
+    int attemptTimeout(const CallOptions& options)
+    {
+        if (options.deadline == std::chrono::steady_clock::time_point::max()) {
+            return options.attemptTimeout;
         }
+        std::chrono::steady_clock::duration left = options.deadline - std::chrono::steady_clock::now();
+        if (left <= std::chrono::steady_clock::duration::zero()) {
+            return 0;
+        }
+        // Round up, a sub-millisecond remainder still gets one attempt
+        int64_t milliseconds = std::chrono::ceil<std::chrono::milliseconds>(left).count();
+        if ((options.attemptTimeout > 0) && (options.attemptTimeout < milliseconds)) {
+            return options.attemptTimeout;
+        }
+        return static_cast<int>(std::min<int64_t>(milliseconds, INT_MAX));
     }
 
-    if (nullptr == message) {
-        dbus_message_unref(message);
+    bool isRetryable(DBusMessage* reply)
+    {
+        return dbus_message_is_error(reply, DBUS_ERROR_NO_REPLY) || dbus_message_is_error(reply, DBUS_ERROR_TIMEOUT);
     }
-}
 
-DBusMessage* NetworkProvider::createMethod(const char* serviceName, const char* objectPath, const char* interface, const char* method)
-{
-    DBusMessage* message = nullptr;
-    do
+    void completeAttempt(DBusPendingCall* pending, void* data)
     {
-        if ((nullptr == serviceName) || (nullptr == objectPath) || (nullptr == method)) {
-            std::cout << "createMethod but empty parameter\n";
-            break;
+        AttemptContext* attempt = static_cast<AttemptContext*>(data);
+        if (attempt->fired.exchange(true)) {
+            return;
         }
-        message = dbus_message_new_method_call(
-            serviceName,                        // Service name
-            objectPath,                         // object path 
-            interface,                          // Interface Dbus
-            method                              // Method name
-        );
 
-    } while (0);
-    
-    return message;
-}
+        std::shared_ptr<CallContext> call = attempt->call;
+        DBusMessage* reply = dbus_pending_call_steal_reply(pending);
+        bool retry = (nullptr != reply) && (call->retriesLeft > 0) && isRetryable(reply) && (attemptTimeout(call->options) != 0);
+        if (retry) {
+            std::lock_guard<std::mutex> lock(call->mutex);
+            retry = !call->completed;
+            if (retry) {
+                call->retriesLeft--;
+                releasePending(call->reactor, call->pending, false);
+                call->pending = nullptr;
+            }
+        }
 
-DBusMessage* NetworkProvider::invokeMethod(DBusMessage* messageSend, const char* interface, const char* property, bool value)
-{
-    DBusMessageIter iter;
-    DBusMessageIter variant;
-    DBusError error;
-    DBusMessage* message = nullptr;
-    bool valueSend = value;
-    do
-    {
-        if (nullptr == messageSend) {
-            std::cout << "createMethod but empty parameter\n";
-            break;
+        if (retry) {
+            dbus_message_unref(reply);
+            // A sent message keeps its serial, the copy gets a fresh one so a late reply cannot match
+            DBusMessage* copy = dbus_message_copy(call->message);
+            if (nullptr == copy) {
+                finishCall(call, nullptr);
+                return;
+            }
+            dbus_message_unref(call->message);
+            call->message = copy;
+            startAttempt(call);
+            return;
         }
-        if (nullptr == mConnection) {
-            std::cout << "createMethod but empty connection\n";
-            break;
+        finishCall(call, reply);
+        if (nullptr != reply) {
+            dbus_message_unref(reply);
         }
+    }
 
-        dbus_error_init(&error);
+    void freeAttempt(void* data)
+    {
+        delete static_cast<AttemptContext*>(data);
+    }
 
-        if (std::string(dbus_message_get_interface(messageSend)) == G_BT_ADAPTER_INTERFACE) {
-            goto Sending;
+    /**
+     * Send one attempt of call. Every failure completes call, the return value only tells the first
+     * attempt's caller whether the message left.
+     */
+    bool startAttempt(const std::shared_ptr<CallContext>& call)
+    {
+        int timeout = attemptTimeout(call->options);
+        if (0 == timeout) {
+            // call->message may never have been sent, so it has no serial dbus_message_new_error() could reply to
+            DBusMessage* reply = dbus_message_new(DBUS_MESSAGE_TYPE_ERROR);
+            if (nullptr != reply) {
+                const char* text = "Deadline exceeded";
+                dbus_message_set_error_name(reply, DBUS_ERROR_TIMEOUT);
+                dbus_message_append_args(reply, DBUS_TYPE_STRING, &text, DBUS_TYPE_INVALID);
+            }
+            finishCall(call, reply);
+            if (nullptr != reply) {
+                dbus_message_unref(reply);
+            }
+            return true;
         }
-        
-        dbus_message_iter_init_append(messageSend, &iter);
-        if (!dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &interface)) {
-            std::cerr << "createMethod but out of memory for interface!\n";
-            break;
+
+        DBusPendingCall* pending = nullptr;
+        if (!dbus_connection_send_with_reply(call->connection, call->message, &pending, timeout) || (nullptr == pending)) {
+            NETWORK_LOG(Error) << "Failed to send DBus message" << logField("member", dbus_message_get_member(call->message));
+            finishCall(call, nullptr);
+            return false;
         }
 
-        if (!dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &property)) {
-            std::cerr << "createMethod but out of memory for property!\n";
-            break;
+        AttemptContext* attempt = new AttemptContext();
+        attempt->call = call;
+        if (!dbus_pending_call_set_notify(pending, &completeAttempt, attempt, &freeAttempt)) {
+            NETWORK_LOG(Error) << "Failed to set pending call notify";
+            releasePending(call->reactor, pending, true);
+            delete attempt;
+            finishCall(call, nullptr);
+            return false;
         }
-        
-        if (dbus_message_is_method_call(messageSend,G_INTERFACE_DBUS_PROP,G_METHOD_SET)) {  
-            dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, "b", &variant);
-            if (!dbus_message_iter_append_basic(&variant, DBUS_TYPE_BOOLEAN, &valueSend)) {
-                std::cerr << "Out of memory!" << std::endl;
-                break;
+
+        bool cancelled = false;
+        {
+            std::lock_guard<std::mutex> lock(call->mutex);
+            cancelled = call->completed;
+            if (!cancelled) {
+                call->pending = dbus_pending_call_ref(pending);
             }
-            dbus_message_iter_close_container(&iter, &variant);
         }
+        if (cancelled) {
+            releasePending(call->reactor, pending, true);
+            return true;
+        }
+        // The reactor may have dispatched the reply before the notify function was attached
+        if (dbus_pending_call_get_completed(pending)) {
+            completeAttempt(pending, attempt);
+        }
+        releasePending(call->reactor, pending, false);
+        return true;
+    }
+}
 
-Sending:
-        message = dbus_connection_send_with_reply_and_block(mConnection, messageSend, -1, &error);
-        if (dbus_error_is_set(&error)) {
-            std::cerr << "Error in reply: " << error.message << std::endl;
-            dbus_error_free(&error);
-            break;
+/**
+ * Send messageSend without blocking, handler receives the reply (or an error message) on the reactor thread.
+ * Retries resend a copy of the message, options.deadline turns into DBUS_ERROR_TIMEOUT and a cancel
+ * into nullptr. On failure to send handler is called synchronously with nullptr and false is returned.
+ */
+bool NetworkProvider::sendWithReply(DBusMessage* messageSend, ReplyHandler handler, const CallOptions& options)
+{
+    if (nullptr == mConnection) {
+        NETWORK_LOG(Warn) << "sendWithReply but empty connection";
+        handler(nullptr);
+        return false;
+    }
+    MethodCounters* stats = mStats->getMethod(messageSend);
+    if ((nullptr != options.cancelToken) && options.cancelToken->isCancelled()) {
+        stats->record(std::chrono::steady_clock::now(), nullptr);
+        handler(nullptr);
+        return false;
+    }
+
+    std::shared_ptr<CallContext> call = std::make_shared<CallContext>();
+    call->stats = stats;
+    call->start = std::chrono::steady_clock::now();
+    call->connection = mConnection;
+    call->reactor = mReactor;
+    call->message = dbus_message_ref(messageSend);
+    call->handler = std::move(handler);
+    call->options = options;
+    call->retriesLeft = options.retries;
+    if (nullptr != options.cancelToken) {
+        std::weak_ptr<CallContext> weak = call;
+        call->cancelId = options.cancelToken->attach([weak]() {
+            std::shared_ptr<CallContext> call = weak.lock();
+            if (nullptr != call) {
+                cancelCall(call);
+            }
+        });
+        if (0 == call->cancelId) {
+            cancelCall(call);
+            return false;
         }
-    } while (0);
-    return message;
+    }
+    return startAttempt(call);
 }
 
-void NetworkProvider::toggleNetWork(const NetworkType& type)
+/**
+ * Blocking counterpart of sendWithReply() with the contract of dbus_connection_send_with_reply_and_block():
+ * returns the reply, or nullptr with error set. The reply is delivered by the reactor thread,
+ * never call this from one of its callbacks.
+ */
+DBusMessage* NetworkProvider::sendWithReplyAndBlock(DBusMessage* messageSend, DBusError* error, const CallOptions& options)
 {
-    bool networkStatus = false;
-    DBusMessage* messageSend = nullptr;
-    DBusMessage* messageReply = nullptr;
+    std::shared_ptr<std::promise<DBusMessage*>> promise = std::make_shared<std::promise<DBusMessage*>>();
+    std::future<DBusMessage*> future = promise->get_future();
+    sendWithReply(messageSend, [promise](DBusMessage* reply) {
+        if (nullptr != reply) {
+            dbus_message_ref(reply);
+        }
+        promise->set_value(reply);
+    }, options);
 
+    DBusMessage* reply = future.get();
+    if (nullptr == reply) {
+        dbus_set_error_const(error, DBUS_ERROR_FAILED, "Call cancelled or not sent");
+        return nullptr;
+    }
+    if (dbus_set_error_from_message(error, reply)) {
+        dbus_message_unref(reply);
+        return nullptr;
+    }
+    return reply;
+}
+
+/**
+ * Options of the blocking calls the library makes on its own, bounded by Options::internalCallTimeout.
+ */
+CallOptions NetworkProvider::internalCallOptions() const
+{
+    CallOptions ret = CallOptions::withTimeout(mOptions.internalCallTimeout);
+    ret.retries = std::max(mOptions.internalCallRetries, 0);
+    ret.attemptTimeout = static_cast<int>(mOptions.internalCallTimeout.count() / (ret.retries + 1));
+    return ret;
+}
+
+void NetworkProvider::toggleNetWork(const NetworkType& type, const CallOptions& options)
+{
     switch (type)
     {
         case NetworkType::Wifi: {
-            networkStatus = getWiFiStatus();
-            messageSend = createMethod(G_NM_DBUS_SERVICE, G_NM_DBUS_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_SET);
-            messageReply = invokeMethod(messageSend, G_NM_DBUS_INTERFACE, G_METHOD_WIRELESS_ENABLED, !networkStatus);
+            bool networkStatus = getWiFiStatus();
+            call<void>(options, G_NM_DBUS_SERVICE, G_NM_DBUS_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_SET,
+                       G_NM_DBUS_INTERFACE, G_METHOD_WIRELESS_ENABLED, DBusVariant<bool>{!networkStatus});
             break;
         }
 
         case NetworkType::Bluetooth: {
-            BluetoothAdapter::getInstance().toggleBluetoothPower();
+            BluetoothAdapter::getInstance().toggleBluetoothPower(options);
             break;
         }
 
@@ -499,84 +637,154 @@ void NetworkProvider::toggleNetWork(const NetworkType& type)
             return;
         }
     }
-    if (nullptr != messageReply) {
-        dbus_message_unref(messageReply);
-    }
-    if (nullptr != messageSend) {
-        dbus_message_unref(messageSend);
-    }   
 }
 
-void NetworkProvider::setScanMode(bool isScan)
+void NetworkProvider::setScanMode(bool isScan, const CallOptions& options)
 {
     if (isScan) {
-        BluetoothAdapter::getInstance().startDiscovery();
+        BluetoothAdapter::getInstance().startDiscovery(options);
     }
     else {
-        BluetoothAdapter::getInstance().stopDiscovery();
+        BluetoothAdapter::getInstance().stopDiscovery(options);
     } 
 }
-void NetworkProvider::connectProfile(const std::string& address, const std::string& profile)
+
+void NetworkProvider::startDiscovery(const DiscoveryFilter& filter, const CallOptions& options)
+{
+    BluetoothAdapter::getInstance().startDiscovery(filter, options);
+}
+
+void NetworkProvider::connectProfile(const std::string& address, const std::string& profile, const CallOptions& options)
 {
-    BluetoothAdapter::getInstance().connectProfile(address,profile);
+    BluetoothAdapter::getInstance().connectProfile(address, profile, options);
 }
 
-void NetworkProvider::disconnectProfile(const std::string& address, const std::string& profile)
+void NetworkProvider::disconnectProfile(const std::string& address, const std::string& profile, const CallOptions& options)
 {
-    BluetoothAdapter::getInstance().disconnectProfile(address,profile);
+    BluetoothAdapter::getInstance().disconnectProfile(address, profile, options);
 }
 
-void NetworkProvider::disconnectBluetoothDevice(const std::string& address)
+void NetworkProvider::disconnectBluetoothDevice(const std::string& address, const CallOptions& options)
 {
-    BluetoothAdapter::getInstance().disconnectBluetooth(address);
+    BluetoothAdapter::getInstance().disconnectBluetooth(address, options);
 }
 
 bool NetworkProvider::getWiFiStatus()
 {
-    DBusMessageIter iter;
-    DBusMessageIter variant;
+    return getWifiProperties().wirelessEnabled;
+}
+
+NetworkProvider::WifiProperties NetworkProvider::getWifiProperties() const
+{
+    return mWifiProperties.load(std::memory_order_acquire);
+}
+
+/**
+ * Replace the cached NetworkManager state with one GetAll round trip.
+ */
+bool NetworkProvider::refreshWifiProperties(const CallOptions& options)
+{
+    PropertyDict properties;
     DBusMessage* messageSend = nullptr;
     DBusMessage* messageReply = nullptr;
+    DBusError error;
+    bool ret = false;
 
-    /**
-     * Note: Do not use bool type, DBus writes 4 bytes to a bool, 
-     *       which only expects 1 byte. This can overwrite adjacent memory, 
-     *       leading to corruption and eventually a crash.
-     */
-    dbus_bool_t ret = FALSE;
+    dbus_error_init(&error);
     do
     {
         if (nullptr == mConnection) {
-            std::cout << "getWiFiStatus but empty connection\n";
+            NETWORK_LOG(Warn) << "refreshWifiProperties but empty connection";
             break;
         }
-        messageSend = createMethod(G_NM_DBUS_SERVICE, G_NM_DBUS_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_GET);
+        static const DBusMessageTemplate G_REQUEST(G_NM_DBUS_SERVICE, G_NM_DBUS_PATH, G_INTERFACE_DBUS_PROP, G_METHOD_GET_ALL, G_NM_DBUS_INTERFACE);
+        messageSend = G_REQUEST.instantiate();
         if (nullptr == messageSend) {
-            std::cerr << "getWiFiStatus but messageSend creation failed\n" ;
+            NETWORK_LOG(Error) << "refreshWifiProperties but messageSend creation failed";
             break;
         }
-        messageReply = invokeMethod(messageSend,G_NM_DBUS_INTERFACE,G_METHOD_WIRELESS_ENABLED);
-        if (!dbus_message_iter_init(messageReply, &iter)) {
-            std::cerr << "getWiFiStatus but init message reply failed\n" ;
+        messageReply = sendWithReplyAndBlock(messageSend, &error, options);
+        if (dbus_error_is_set(&error)) {
+            NETWORK_LOG(Error) << "Error getting NetworkManager properties" << logField("error", error.message);
+            dbus_error_free(&error);
             break;
         }
-        if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_VARIANT) {
-            dbus_message_iter_recurse(&iter, &variant);
-            if (dbus_message_iter_get_arg_type(&variant) == DBUS_TYPE_BOOLEAN) {
-                dbus_message_iter_get_basic(&variant, &ret);
-            }
+        if (!decodeMessage(messageReply, properties)) {
+            NETWORK_LOG(Error) << "refreshWifiProperties but unexpected reply signature";
+            break;
         }
 
+        WifiProperties wifi;
+        parseWifiProperties(&properties.iter, wifi);
+        {
+            std::lock_guard<std::mutex> lock(mWifiPropertiesMutex);
+            mWifiProperties.store(wifi, std::memory_order_release);
+        }
+        ret = true;
     } while (0);
 
     if (nullptr != messageSend) {
         dbus_message_unref(messageSend);
     }
-
     if (nullptr != messageReply) {
         dbus_message_unref(messageReply);
     }
-    return static_cast<bool>(ret);
+    return ret;
+}
+
+/**
+ * Apply the NetworkManager keys of an a{sv} dictionary onto wifi, other keys are skipped.
+ */
+void NetworkProvider::parseWifiProperties(DBusMessageIter* properties, WifiProperties& wifi)
+{
+    forEachProperty(properties, [&wifi](std::string_view key, DBusMessageIter* value) {
+        switch (propertyKey(key)) {
+            case propertyKey(G_METHOD_WIRELESS_ENABLED): {
+                readVariant(value, wifi.wirelessEnabled);
+                break;
+            }
+            case propertyKey(G_PROP_WIRELESS_HARDWARE_ENABLED): {
+                readVariant(value, wifi.wirelessHardwareEnabled);
+                break;
+            }
+            case propertyKey(G_PROP_STATE): {
+                readVariant(value, wifi.state);
+                break;
+            }
+            case propertyKey(G_PROP_CONNECTIVITY): {
+                uint32_t connectivity = 0;
+                if (readVariant(value, connectivity)) {
+                    wifi.connectivity = static_cast<uint16_t>(connectivity);
+                }
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    });
+}
+
+void NetworkProvider::handleWifiSignal(DBusMessage* message)
+{
+    std::string_view interfaceName;
+    PropertyDict changed;
+    std::vector<std::string_view> invalidated;
+    if (decodeMessage(message, interfaceName, changed, invalidated)) {
+        // org.freedesktop.DBus.Properties signature sa{sv}as
+        if (interfaceName != G_NM_DBUS_INTERFACE) {
+            return;
+        }
+    }
+    else if (!decodeMessage(message, changed)) {
+        // Legacy NetworkManager signal has signature a{sv}
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mWifiPropertiesMutex);
+    WifiProperties wifi = mWifiProperties.load(std::memory_order_relaxed);
+    parseWifiProperties(&changed.iter, wifi);
+    mWifiProperties.store(wifi, std::memory_order_release);
 }
 
 bool NetworkProvider::getBTStatus()
@@ -594,6 +802,86 @@ std::string NetworkProvider::getBluetoothAddress() const
     return BluetoothAdapter::getInstance().getBluetoothAddress();
 }
 
+bool NetworkProvider::isBluetoothDiscovering() const
+{
+    return BluetoothAdapter::getInstance().isDiscovering();
+}
+
+bool NetworkProvider::refreshBluetoothProperties(const CallOptions& options)
+{
+    return BluetoothAdapter::getInstance().refresh(options);
+}
+
+std::future<bool> NetworkProvider::connectProfileAsync(const std::string& address, const std::string& profile, const CallOptions& options)
+{
+    return BluetoothAdapter::getInstance().connectProfileAsync(address, profile, options);
+}
+
+void NetworkProvider::connectProfileAsync(const std::string& address, const std::string& profile, CompletionCallback callback, const CallOptions& options)
+{
+    BluetoothAdapter::getInstance().connectProfileAsync(address, profile, std::move(callback), options);
+}
+
+std::future<bool> NetworkProvider::disconnectProfileAsync(const std::string& address, const std::string& profile, const CallOptions& options)
+{
+    return BluetoothAdapter::getInstance().disconnectProfileAsync(address, profile, options);
+}
+
+void NetworkProvider::disconnectProfileAsync(const std::string& address, const std::string& profile, CompletionCallback callback, const CallOptions& options)
+{
+    BluetoothAdapter::getInstance().disconnectProfileAsync(address, profile, std::move(callback), options);
+}
+
+std::future<bool> NetworkProvider::disconnectBluetoothDeviceAsync(const std::string& address, const CallOptions& options)
+{
+    return BluetoothAdapter::getInstance().disconnectBluetoothAsync(address, options);
+}
+
+void NetworkProvider::disconnectBluetoothDeviceAsync(const std::string& address, CompletionCallback callback, const CallOptions& options)
+{
+    BluetoothAdapter::getInstance().disconnectBluetoothAsync(address, std::move(callback), options);
+}
+
+std::vector<NetworkProvider::ProfileResult> NetworkProvider::connectProfiles(const std::vector<ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options)
+{
+    return connectProfilesAsync(requests, maxConcurrent, options).get();
+}
+
+std::vector<NetworkProvider::ProfileResult> NetworkProvider::disconnectProfiles(const std::vector<ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options)
+{
+    return disconnectProfilesAsync(requests, maxConcurrent, options).get();
+}
+
+std::future<std::vector<NetworkProvider::ProfileResult>> NetworkProvider::connectProfilesAsync(const std::vector<ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options)
+{
+    return BluetoothAdapter::getInstance().connectProfilesAsync(requests, maxConcurrent, options);
+}
+
+std::future<std::vector<NetworkProvider::ProfileResult>> NetworkProvider::disconnectProfilesAsync(const std::vector<ProfileRequest>& requests, size_t maxConcurrent, const CallOptions& options)
+{
+    return BluetoothAdapter::getInstance().disconnectProfilesAsync(requests, maxConcurrent, options);
+}
+
+std::future<std::string> NetworkProvider::getBluetoothNameAsync(const CallOptions& options) const
+{
+    return BluetoothAdapter::getInstance().getBluetoothNameAsync(options);
+}
+
+void NetworkProvider::getBluetoothNameAsync(StringCallback callback, const CallOptions& options) const
+{
+    BluetoothAdapter::getInstance().getBluetoothNameAsync(std::move(callback), options);
+}
+
+std::future<std::string> NetworkProvider::getBluetoothAddressAsync(const CallOptions& options) const
+{
+    return BluetoothAdapter::getInstance().getBluetoothAddressAsync(options);
+}
+
+void NetworkProvider::getBluetoothAddressAsync(StringCallback callback, const CallOptions& options) const
+{
+    BluetoothAdapter::getInstance().getBluetoothAddressAsync(std::move(callback), options);
+}
+
 void NetworkProvider::dumpBluetoothDevices()
 {
     BluetoothAdapter::getInstance().dumpDevicesUnpaired();
@@ -604,6 +892,12 @@ extern "C" {
         return &NetworkProvider::initialize();
     }
 
+    NetworkProvider* np_initialize_at(const char* busAddress) {
+        NetworkProvider::Options options;
+        options.busAddress = (nullptr != busAddress) ? busAddress : "";
+        return &NetworkProvider::initialize(options);
+    }
+
     NetworkProvider* np_get_instance() {
         return &NetworkProvider::getInstance();
     }
@@ -644,6 +938,16 @@ extern "C" {
         np->dumpBluetoothDevices();
     }
 
+    size_t np_get_stats(NetworkProvider* np, char* buffer, size_t size) {
+        std::string json = NetworkStats::toJson(np->getStats());
+        if (size > 0) {
+            size_t length = std::min(json.size(), size - 1);
+            memcpy(buffer, json.data(), length);
+            buffer[length] = '\0';
+        }
+        return json.size();
+    }
+
     void np_destroy(NetworkProvider* np) {
         // delete g_instance;
         // g_instance = nullptr;
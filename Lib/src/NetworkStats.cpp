@@ -0,0 +1,276 @@
+#include "../include/private/NetworkStats.h"
+#include "../include/private/Hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+LatencyHistogram::LatencyHistogram() : mCount(0), mSum(0), mMax(0)
+{
+    for (std::atomic<uint64_t>& bucket : mBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Values below 2 * G_HISTOGRAM_SUB_BUCKETS get a bucket each, above that the bucket is picked by
+ * the position of the highest set bit plus the G_HISTOGRAM_SUB_BUCKET_BITS bits following it.
+ */
+size_t LatencyHistogram::bucketIndex(uint64_t value)
+{
+    static constexpr uint64_t maxValue = (uint64_t(1) << (G_HISTOGRAM_MAX_EXPONENT + 1)) - 1;
+    value = std::min(value, maxValue);
+    if (value < 2 * G_HISTOGRAM_SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+    size_t shift = (63 - __builtin_clzll(value)) - G_HISTOGRAM_SUB_BUCKET_BITS;
+    return shift * G_HISTOGRAM_SUB_BUCKETS + static_cast<size_t>(value >> shift);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index)
+{
+    if (index < 2 * G_HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    size_t shift = index / G_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t mantissa = index % G_HISTOGRAM_SUB_BUCKETS + G_HISTOGRAM_SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t microseconds)
+{
+    mBuckets[bucketIndex(microseconds)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mSum.fetch_add(microseconds, std::memory_order_relaxed);
+    uint64_t max = mMax.load(std::memory_order_relaxed);
+    while ((microseconds > max) && !mMax.compare_exchange_weak(max, microseconds, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+    return mCount.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getSum() const
+{
+    return mSum.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getMax() const
+{
+    return mMax.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::valueAtQuantile(double quantile) const
+{
+    // Count the buckets themselves, mCount may already include a sample whose bucket is not visible yet
+    std::array<uint64_t, G_HISTOGRAM_BUCKETS> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < G_HISTOGRAM_BUCKETS; i++) {
+        counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (0 == total) {
+        return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::min(1.0, std::max(0.0, quantile)) * total + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < G_HISTOGRAM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), getMax());
+        }
+    }
+    return getMax();
+}
+
+void MethodCounters::record(std::chrono::steady_clock::time_point start, DBusMessage* reply)
+{
+    if (nullptr == reply) {
+        failed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+        if (dbus_message_is_error(reply, DBUS_ERROR_NO_REPLY) || dbus_message_is_error(reply, DBUS_ERROR_TIMEOUT)) {
+            timeouts.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    latency.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+NetworkStats::NetworkStats() :
+    mMethods(std::make_shared<const Table<MethodCounters>>()),
+    mSignals(std::make_shared<const Table<SignalCounters>>()),
+    mDeviceInfosQueued(0),
+    mMaxDeviceInfosQueueDepth(0)
+{
+}
+
+/**
+ * FNV-1a over "interface\0member", the key DBusDispatcher uses.
+ */
+uint64_t NetworkStats::hashKey(const char* interface, const char* member)
+{
+    // The terminator of interface is hashed too, so ("ab", "c") and ("a", "bc") differ
+    return fnv1a(member, fnv1a(std::string_view(interface, strlen(interface) + 1)));
+}
+
+/**
+ * Entry names are "interface.member", both halves are compared without building the string.
+ */
+template<typename Entry>
+Entry* NetworkStats::lookup(const Table<Entry>& table, uint64_t key, const char* interface, const char* member)
+{
+    typename std::unordered_map<uint64_t, std::vector<std::shared_ptr<Entry>>>::const_iterator item = table.entries.find(key);
+    if (item == table.entries.end()) {
+        return nullptr;
+    }
+    size_t interfaceLength = strlen(interface);
+    for (const std::shared_ptr<Entry>& entry : item->second) {
+        const std::string& name = entry->name;
+        if ((name.size() > interfaceLength) && (0 == name.compare(0, interfaceLength, interface)) &&
+            (name[interfaceLength] == '.') && (0 == name.compare(interfaceLength + 1, std::string::npos, member))) {
+            return entry.get();
+        }
+    }
+    return nullptr;
+}
+
+template<typename Entry>
+Entry* NetworkStats::find(std::shared_ptr<const Table<Entry>>& table, std::mutex& mutex, DBusMessage* message)
+{
+    const char* interface = dbus_message_get_interface(message);
+    const char* member = dbus_message_get_member(message);
+    interface = (nullptr != interface) ? interface : "";
+    member = (nullptr != member) ? member : "";
+    uint64_t key = hashKey(interface, member);
+
+    Entry* ret = lookup(*std::atomic_load(&table), key, interface, member);
+    if (nullptr != ret) {
+        return ret;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const Table<Entry>> current = std::atomic_load(&table);
+    ret = lookup(*current, key, interface, member);
+    if (nullptr == ret) {
+        std::shared_ptr<Table<Entry>> next = std::make_shared<Table<Entry>>(*current);
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>(std::string(interface) + "." + member);
+        ret = entry.get();
+        next->entries[key].push_back(std::move(entry));
+        std::atomic_store(&table, std::shared_ptr<const Table<Entry>>(std::move(next)));
+    }
+    return ret;
+}
+
+MethodCounters* NetworkStats::getMethod(DBusMessage* message)
+{
+    return find(mMethods, mMutex, message);
+}
+
+void NetworkStats::recordSignal(DBusMessage* message)
+{
+    SignalCounters* counters = find(mSignals, mMutex, message);
+    if (nullptr != counters) {
+        counters->received.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void NetworkStats::recordDeviceInfoQueued(size_t depth)
+{
+    mDeviceInfosQueued.fetch_add(1, std::memory_order_relaxed);
+    uint32_t value = static_cast<uint32_t>(depth);
+    uint32_t max = mMaxDeviceInfosQueueDepth.load(std::memory_order_relaxed);
+    while ((value > max) && !mMaxDeviceInfosQueueDepth.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+void NetworkStats::snapshot(NetworkProvider::Stats& stats) const
+{
+    std::shared_ptr<const Table<MethodCounters>> methods = std::atomic_load(&mMethods);
+    for (const std::pair<const uint64_t, std::vector<std::shared_ptr<MethodCounters>>>& item : methods->entries) {
+        for (const std::shared_ptr<MethodCounters>& counters : item.second) {
+            NetworkProvider::MethodStats method;
+            method.method = counters->name;
+            uint64_t replied = counters->latency.getCount();
+            method.failed = counters->failed.load(std::memory_order_relaxed);
+            method.calls = replied + method.failed;
+            method.errors = counters->errors.load(std::memory_order_relaxed);
+            method.timeouts = counters->timeouts.load(std::memory_order_relaxed);
+            method.meanUs = (replied > 0) ? (static_cast<double>(counters->latency.getSum()) / replied) : 0;
+            method.p50Us = counters->latency.valueAtQuantile(0.5);
+            method.p90Us = counters->latency.valueAtQuantile(0.9);
+            method.p99Us = counters->latency.valueAtQuantile(0.99);
+            method.p999Us = counters->latency.valueAtQuantile(0.999);
+            method.maxUs = counters->latency.getMax();
+            stats.methods.push_back(std::move(method));
+        }
+    }
+    std::sort(stats.methods.begin(), stats.methods.end(), [](const NetworkProvider::MethodStats& a, const NetworkProvider::MethodStats& b) {
+        return a.method < b.method;
+    });
+
+    std::shared_ptr<const Table<SignalCounters>> signals = std::atomic_load(&mSignals);
+    for (const std::pair<const uint64_t, std::vector<std::shared_ptr<SignalCounters>>>& item : signals->entries) {
+        for (const std::shared_ptr<SignalCounters>& counters : item.second) {
+            stats.signals.push_back({counters->name, counters->received.load(std::memory_order_relaxed)});
+        }
+    }
+    std::sort(stats.signals.begin(), stats.signals.end(), [](const NetworkProvider::SignalStats& a, const NetworkProvider::SignalStats& b) {
+        return a.signal < b.signal;
+    });
+
+    stats.deviceInfosQueued = mDeviceInfosQueued.load(std::memory_order_relaxed);
+    stats.maxDeviceInfosQueueDepth = mMaxDeviceInfosQueueDepth.load(std::memory_order_relaxed);
+}
+
+/**
+ * DBus interface and member names are restricted to [A-Za-z0-9_.], nothing needs escaping.
+ */
+std::string NetworkStats::toJson(const NetworkProvider::Stats& stats)
+{
+    char buffer[512];
+    std::string ret = "{\"methods\":[";
+    for (size_t i = 0; i < stats.methods.size(); i++) {
+        const NetworkProvider::MethodStats& method = stats.methods[i];
+        snprintf(buffer, sizeof(buffer),
+                 "%s{\"method\":\"%s\",\"calls\":%llu,\"errors\":%llu,\"timeouts\":%llu,\"failed\":%llu,\"mean_us\":%.1f,"
+                 "\"p50_us\":%llu,\"p90_us\":%llu,\"p99_us\":%llu,\"p999_us\":%llu,\"max_us\":%llu}",
+                 (i > 0) ? "," : "", method.method.c_str(),
+                 static_cast<unsigned long long>(method.calls), static_cast<unsigned long long>(method.errors),
+                 static_cast<unsigned long long>(method.timeouts), static_cast<unsigned long long>(method.failed), method.meanUs,
+                 static_cast<unsigned long long>(method.p50Us), static_cast<unsigned long long>(method.p90Us),
+                 static_cast<unsigned long long>(method.p99Us), static_cast<unsigned long long>(method.p999Us),
+                 static_cast<unsigned long long>(method.maxUs));
+        ret += buffer;
+    }
+    ret += "],\"signals\":[";
+    for (size_t i = 0; i < stats.signals.size(); i++) {
+        snprintf(buffer, sizeof(buffer), "%s{\"signal\":\"%s\",\"received\":%llu}", (i > 0) ? "," : "",
+                 stats.signals[i].signal.c_str(), static_cast<unsigned long long>(stats.signals[i].received));
+        ret += buffer;
+    }
+    ret += "],\"connections\":[";
+    for (size_t i = 0; i < stats.connections.size(); i++) {
+        const NetworkProvider::ConnectionStats& connection = stats.connections[i];
+        snprintf(buffer, sizeof(buffer), "%s{\"name\":\"%s\",\"dispatched\":%llu,\"queue_depth\":%u,\"max_queue_depth\":%u,\"outgoing_bytes\":%ld}",
+                 (i > 0) ? "," : "", connection.name.c_str(), static_cast<unsigned long long>(connection.dispatched),
+                 connection.queueDepth, connection.maxQueueDepth, connection.outgoingBytes);
+        ret += buffer;
+    }
+    snprintf(buffer, sizeof(buffer),
+             "],\"device_infos\":{\"queued\":%llu,\"dropped\":%llu,\"queue_depth\":%u,\"max_queue_depth\":%u,\"capacity\":%u}",
+             static_cast<unsigned long long>(stats.deviceInfosQueued), static_cast<unsigned long long>(stats.deviceInfosDropped),
+             stats.deviceInfosQueueDepth, stats.maxDeviceInfosQueueDepth, stats.deviceInfosQueueCapacity);
+    ret += buffer;
+    snprintf(buffer, sizeof(buffer),
+             ",\"devices\":{\"count\":%llu,\"pinned\":%llu,\"memory_bytes\":%llu,\"bytes_per_device\":%llu,\"evicted\":%llu,\"expired\":%llu,\"removed\":%llu,\"properties_coalesced\":%llu}}",
+             static_cast<unsigned long long>(stats.deviceCount), static_cast<unsigned long long>(stats.pinnedDeviceCount),
+             static_cast<unsigned long long>(stats.deviceMemoryBytes), static_cast<unsigned long long>(stats.bytesPerDevice),
+             static_cast<unsigned long long>(stats.devicesEvicted), static_cast<unsigned long long>(stats.devicesExpired),
+             static_cast<unsigned long long>(stats.devicesRemoved), static_cast<unsigned long long>(stats.devicePropertiesCoalesced));
+    ret += buffer;
+    return ret;
+}